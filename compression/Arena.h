@@ -0,0 +1,60 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstdlib>
+#include <vector>
+
+#define ARENA_BLOCK (1 << 20)
+
+//a value inside the segment buffer (or any other buffer that outlives it), never owns memory
+typedef struct StrView
+{
+    const char* ptr;
+    int len;
+}StrView;
+
+//Bump allocator for short lived per-variable data: no per object free, reset() rewinds and keeps
+//the blocks for the next variable, release() (or the destructor) frees everything in one go
+class Arena{
+public:
+    Arena(size_t blockSize = ARENA_BLOCK){
+        block = blockSize;
+        cur = 0;
+        used = 0;
+    }
+    ~Arena(){ release(); }
+
+    void* alloc(size_t n){
+        n = (n + 7) & ~(size_t)7;
+        while(cur < blocks.size() && used + n > blocks[cur].second){
+            cur++;
+            used = 0;
+        }
+        if(cur == blocks.size()){
+            size_t size = (n > block) ? n : block;
+            blocks.push_back(std::make_pair((char*)malloc(size), size));
+            used = 0;
+        }
+        void* p = blocks[cur].first + used;
+        used += n;
+        return p;
+    }
+    template<class T> T* allocArray(size_t n){ return (T*)alloc(n * sizeof(T)); }
+
+    void reset(){
+        cur = 0;
+        used = 0;
+    }
+    void release(){
+        for(auto &b: blocks) free(b.first);
+        blocks.clear();
+        reset();
+    }
+
+private:
+    std::vector<std::pair<char*, size_t> > blocks;
+    size_t block;
+    size_t cur;
+    size_t used;
+};
+#endif
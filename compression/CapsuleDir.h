@@ -0,0 +1,64 @@
+#ifndef CAPSULEDIR_H
+#define CAPSULEDIR_H
+
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <stdint.h>
+
+// Binary capsule directory, the meta frame of a capsule group. Older archives carry text lines instead,
+// "name codec offset destLen srcLen lines eleLen [dictId] [stats]" per capsule, and never start with the magic.
+//   8 byte magic, uint32 record count, uint32 record size, then the records sorted by capsule id
+// Records are fixed size and read in place: a lookup is a binary search, no parsing and no allocation.
+// A later version may append fields to CapsuleRecord, readers only rely on the prefix they know.
+#define CAPSULE_DIR_MAGIC "LGDIR1\0\0"
+#define CAPSULE_DIR_MAGIC_LEN 8
+#define CAPSULE_DIR_HEAD 16
+
+typedef struct CapsuleRecord
+{
+    int64_t offset; //from the first capsule of the group
+    int64_t vmin, vmax;
+    int32_t id;
+    int32_t codec;
+    int32_t destLen, srcLen, lines, eleLen;
+    int32_t dictId;
+    int32_t hasStats; //the CofferStats fields below are valid
+    int32_t minLen, maxLen, charMask, empty, distinct, numeric;
+}CapsuleRecord;
+
+static inline void capsule_dir_head(std::string& out, uint32_t count){
+    uint32_t recSize = sizeof(CapsuleRecord);
+    out.assign(CAPSULE_DIR_MAGIC, CAPSULE_DIR_MAGIC_LEN);
+    out.append((const char*)&count, sizeof(count));
+    out.append((const char*)&recSize, sizeof(recSize));
+}
+
+//record count of a directory frame, -1 when buf is a text meta or malformed
+static inline int capsule_dir_count(const char* buf, size_t len, uint32_t& recSize){
+    if(len < CAPSULE_DIR_HEAD || memcmp(buf, CAPSULE_DIR_MAGIC, CAPSULE_DIR_MAGIC_LEN) != 0) return -1;
+    uint32_t count;
+    memcpy(&count, buf + 8, sizeof(count));
+    memcpy(&recSize, buf + 12, sizeof(recSize));
+    if(recSize < sizeof(CapsuleRecord) || recSize % 8 != 0) return -1;
+    if((len - CAPSULE_DIR_HEAD) / recSize < count) return -1;
+    return (int)count;
+}
+
+static inline const CapsuleRecord* capsule_dir_at(const char* buf, uint32_t recSize, int i){
+    return (const CapsuleRecord*)(buf + CAPSULE_DIR_HEAD + (size_t)recSize * i);
+}
+
+static inline const CapsuleRecord* capsule_dir_find(const char* buf, uint32_t recSize, int count, int id){
+    int lo = 0, hi = count - 1;
+    while(lo <= hi){
+        int mid = lo + (hi - lo) / 2;
+        const CapsuleRecord* r = capsule_dir_at(buf, recSize, mid);
+        if(r -> id == id) return r;
+        if(r -> id < id) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <string>
+#include <cstring>
+
+// Per-capsule codec, stored in the "compressed" column of the meta:
+//   CODEC_RAW   cdata is data as is
+//   CODEC_ZSTD  one zstd frame (optionally against the dictionary named by dictId)
+//   CODEC_RLE   fixed width column holding a single value: cdata is that element, repeated lines times
+//   CODEC_FOR   fixed width column of space padded decimals: int width, int bits, long long base,
+//               then (value - base) as a little endian bit stream with 8 bytes of tail pad
+//   CODEC_DELTA same column as FOR: int width, int bits, long long first value, then the zigzag
+//               deltas of rows 1..lines-1 as a little endian bit stream with 8 bytes of tail pad
+//   CODEC_SEEKABLE fixed width column in the zstd seekable format (contrib/seekable_format): frames of
+//               whole rows and a seek table, so a row range decompresses only the frames covering it
+// RAW and RLE need no decompression, FOR/DELTA decode with a shift (and a running sum) and an itoa per
+// row. FOR/DELTA are typed int64 columns: codec_int_decode hands the values out without any text.
+#define CODEC_RAW   0
+#define CODEC_ZSTD  1
+#define CODEC_RLE   2
+#define CODEC_FOR   3
+#define CODEC_DELTA 4
+#define CODEC_SEEKABLE 5
+
+// decode cost in 1/1000 stored byte per source byte, the cost model keeps the cheapest of
+// stored size + srcLen * cost, so raw wins over zstd when zstd saves less than 5%
+#define CODEC_COST_RAW  0
+#define CODEC_COST_RLE  1
+#define CODEC_COST_FOR  15
+#define CODEC_COST_DELTA 20
+#define CODEC_COST_ZSTD 50
+
+// fixed width capsules below this size only try RAW against ZSTD, the typed trials cost more than they save
+#define CODEC_TRIAL_MIN_BYTES 256
+
+#define CODEC_FOR_HEAD (2 * sizeof(int) + sizeof(long long))
+
+//fixed width column: every element of width bytes is the same
+static inline bool codec_rle_encode(const char* src, int srcLen, int width, int lines, std::string& out){
+    if(width <= 0 || lines <= 1 || (long long)width * lines != srcLen) return false;
+    for(int i = 1; i < lines; i++){
+        if(memcmp(src, src + (long long)i * width, width) != 0) return false;
+    }
+    out.assign(src, width);
+    return true;
+}
+
+static inline void codec_rle_decode(const unsigned char* in, int width, char* out, int srcLen){
+    for(int pos = 0; pos + width <= srcLen; pos += width) memcpy(out + pos, in, width);
+}
+
+//fixed width column of left space padded canonical unsigned decimals (no leading zeros), so text round trips
+static inline bool codec_parse_ints(const char* src, int srcLen, int width, int lines, long long* v){
+    if(width <= 0 || width > 18 || lines <= 0 || (long long)width * lines != srcLen) return false;
+    for(int i = 0; i < lines; i++){
+        const char* e = src + (long long)i * width;
+        int k = 0;
+        while(k < width && e[k] == ' ') k++;
+        if(k == width || (e[k] == '0' && k != width - 1)) return false;
+        long long x = 0;
+        for(; k < width; k++){
+            if(e[k] < '0' || e[k] > '9') return false;
+            x = x * 10 + (e[k] - '0');
+        }
+        v[i] = x;
+    }
+    return true;
+}
+
+static inline int codec_bits(unsigned long long range){
+    int bits = 0;
+    while(bits < 64 && (range >> bits)) bits++;
+    return bits;
+}
+
+//head + n values of bits each, the stream keeps 8 bytes of tail pad for the unaligned 64 bit loads
+static inline void codec_pack(int width, int bits, long long base, const unsigned long long* v, int n, std::string& out){
+    size_t streamLen = ((size_t)n * bits + 7) / 8;
+    out.assign(CODEC_FOR_HEAD + streamLen + 8, '\0');
+    memcpy(&out[0], &width, sizeof(int));
+    memcpy(&out[sizeof(int)], &bits, sizeof(int));
+    memcpy(&out[2 * sizeof(int)], &base, sizeof(long long));
+    unsigned char* p = (unsigned char*)&out[CODEC_FOR_HEAD];
+    for(int i = 0; bits > 0 && i < n; i++){
+        unsigned long long bit = (unsigned long long)i * bits;
+        unsigned long long w;
+        memcpy(&w, p + (bit >> 3), sizeof(w));
+        w |= v[i] << (bit & 7);
+        memcpy(p + (bit >> 3), &w, sizeof(w));
+    }
+}
+
+//v holds the parsed rows, FOR and DELTA share one parse in Coffer::selectCodec
+static inline bool codec_for_pack(const long long* v, int width, int lines, std::string& out){
+    if(lines <= 0) return false;
+    long long lo = v[0], hi = v[0];
+    for(int i = 1; i < lines; i++){
+        if(v[i] < lo) lo = v[i];
+        if(v[i] > hi) hi = v[i];
+    }
+    int bits = codec_bits((unsigned long long)(hi - lo));
+    if(bits > 56) return false;
+    std::string vals(lines * sizeof(long long), '\0');
+    unsigned long long* d = (unsigned long long*)&vals[0];
+    for(int i = 0; i < lines; i++) d[i] = (unsigned long long)(v[i] - lo);
+    codec_pack(width, bits, lo, d, lines, out);
+    return true;
+}
+
+static inline bool codec_for_encode(const char* src, int srcLen, int width, int lines, std::string& out){
+    if(width <= 0 || width > 18 || lines <= 0 || (long long)width * lines != srcLen) return false;
+    std::string vals(lines * sizeof(long long), '\0');
+    long long* v = (long long*)&vals[0];
+    return codec_parse_ints(src, srcLen, width, lines, v) && codec_for_pack(v, width, lines, out);
+}
+
+//sorted or slowly moving columns (ids, offsets, counters): small deltas pack tighter than the range
+static inline bool codec_delta_pack(const long long* v, int width, int lines, std::string& out){
+    if(lines <= 1) return false;
+    std::string vals((lines - 1) * sizeof(long long), '\0');
+    unsigned long long* z = (unsigned long long*)&vals[0];
+    unsigned long long maxZ = 0;
+    for(int i = 1; i < lines; i++){
+        long long d = v[i] - v[i - 1];
+        z[i - 1] = ((unsigned long long)d << 1) ^ (unsigned long long)(d >> 63);
+        if(z[i - 1] > maxZ) maxZ = z[i - 1];
+    }
+    int bits = codec_bits(maxZ);
+    if(bits > 56) return false;
+    codec_pack(width, bits, v[0], z, lines - 1, out);
+    return true;
+}
+
+static inline bool codec_delta_encode(const char* src, int srcLen, int width, int lines, std::string& out){
+    if(width <= 0 || width > 18 || lines <= 1 || (long long)width * lines != srcLen) return false;
+    std::string vals(lines * sizeof(long long), '\0');
+    long long* v = (long long*)&vals[0];
+    return codec_parse_ints(src, srcLen, width, lines, v) && codec_delta_pack(v, width, lines, out);
+}
+
+//typed reader of a FOR/DELTA capsule: fills out[0..srcLen/width), returns the row count or -1
+static inline int codec_int_decode(int codec, const unsigned char* in, int inLen, int srcLen, long long* out){
+    if((codec != CODEC_FOR && codec != CODEC_DELTA) || inLen < (int)CODEC_FOR_HEAD) return -1;
+    int width, bits;
+    long long base;
+    memcpy(&width, in, sizeof(int));
+    memcpy(&bits, in + sizeof(int), sizeof(int));
+    memcpy(&base, in + 2 * sizeof(int), sizeof(long long));
+    if(width <= 0 || bits < 0 || bits > 56 || srcLen % width != 0) return -1;
+    int lines = srcLen / width;
+    int n = (codec == CODEC_FOR) ? lines : lines - 1;
+    if(n < 0 || (long long)CODEC_FOR_HEAD + ((long long)n * bits + 7) / 8 + 8 > inLen) return -1;
+    const unsigned char* p = in + CODEC_FOR_HEAD;
+    unsigned long long mask = (bits == 0) ? 0 : ((1ULL << bits) - 1);
+    if(codec == CODEC_FOR){
+        for(int i = 0; i < lines; i++){
+            unsigned long long bit = (unsigned long long)i * bits;
+            unsigned long long w;
+            memcpy(&w, p + (bit >> 3), sizeof(w));
+            out[i] = base + (long long)((w >> (bit & 7)) & mask);
+        }
+        return lines;
+    }
+    long long x = base;
+    if(lines > 0) out[0] = x;
+    for(int i = 0; i < n; i++){
+        unsigned long long bit = (unsigned long long)i * bits;
+        unsigned long long w;
+        memcpy(&w, p + (bit >> 3), sizeof(w));
+        unsigned long long z = (w >> (bit & 7)) & mask;
+        x += (long long)(z >> 1) ^ -(long long)(z & 1);
+        out[i + 1] = x;
+    }
+    return lines;
+}
+
+//text of a FOR/DELTA capsule: the typed values formatted back into the space padded column
+static inline int codec_int_format(int codec, const unsigned char* in, int inLen, char* out, int srcLen){
+    if(inLen < (int)CODEC_FOR_HEAD) return -1;
+    int width;
+    memcpy(&width, in, sizeof(int));
+    if(width <= 0 || srcLen % width != 0) return -1;
+    int lines = srcLen / width;
+    std::string vals(lines * sizeof(long long), '\0');
+    long long* v = (long long*)&vals[0];
+    if(codec_int_decode(codec, in, inLen, srcLen, v) != lines) return -1;
+    char digits[24];
+    for(int i = 0; i < lines; i++){
+        long long x = v[i];
+        if(x < 0) return -1;
+        int n = 0;
+        do{ digits[n++] = '0' + x % 10; x /= 10; }while(x > 0);
+        if(n > width) return -1;
+        char* e = out + (long long)i * width;
+        memset(e, ' ', width - n);
+        for(int k = 0; k < n; k++) e[width - 1 - k] = digits[k];
+    }
+    return srcLen;
+}
+
+#endif
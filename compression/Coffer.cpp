@@ -2,17 +2,24 @@
 #include<cstring>
 #include<cstdio>
 #include<cstdlib>
+#include<algorithm>
 #include<zstd.h>
+#include<sys/types.h>
+#include "../zstd-dev/contrib/seekable_format/zstd_seekable.h"
 using namespace std;
 Coffer::Coffer(string filename, char* srcData, int srcL, int line, int typ, int ele){
     data = srcData;
     filenames = filename;
     cdata = NULL;
+    seekable = NULL;
     srcLen = srcL;
     lines = line;
     type = typ;
     eleLen = ele;
     compressed = 0;
+    dictId = 0;
+    hasStats = false;
+    mapped = false;
 }
 
 Coffer::Coffer(string filename, string srcData, int srcL, int line, int typ, int ele){
@@ -22,21 +29,37 @@ Coffer::Coffer(string filename, string srcData, int srcL, int line, int typ, int
     data[srcL] = '\0';
     filenames = filename;
     cdata = NULL;
+    seekable = NULL;
     srcLen = srcL;
     lines = line;
     eleLen = ele;
     type = typ;
     compressed = 0;
+    dictId = 0;
+    hasStats = false;
+    mapped = false;
 }
 
 Coffer::Coffer(string metaStr){
     data = NULL;
     cdata = NULL;
+    seekable = NULL;
+    mapped = false;
     type = -1;
    // cout << "Build based: " << metaStr << endl;
     char filename[128];
-    int _compressed, _offset, _destLen, _srcLen, _lines, _eleLen;
-    sscanf(metaStr.c_str(), "%s %d %d %d %d %d %d", filename, &_compressed, &_offset, &_destLen, &_srcLen, &_lines, &_eleLen);
+    int _compressed, _destLen, _srcLen, _lines, _eleLen, _dictId = 0;
+    long long _offset;
+    //dictId column is optional, older archives have 7 columns; column statistics follow it
+    int used = 0;
+    int n = sscanf(metaStr.c_str(), "%s %d %lld %d %d %d %d %d%n", filename, &_compressed, &_offset, &_destLen, &_srcLen, &_lines, &_eleLen, &_dictId, &used);
+    hasStats = false;
+    if(n == 8 && used > 0){
+        CofferStats& st = stats;
+        st.vmin = st.vmax = 0;
+        int k = sscanf(metaStr.c_str() + used, "%d %d %d %d %d %d %lld %lld", &st.minLen, &st.maxLen, &st.charMask, &st.empty, &st.distinct, &st.numeric, &st.vmin, &st.vmax);
+        hasStats = (k == 8 || (k == 6 && st.numeric == 0));
+    }
     //cout << filename << endl;
     //cout << _compressed << endl;
     //cout << _compressed << _offset << _destLen << _srcLen << _lines << _eleLen << endl;
@@ -47,37 +70,155 @@ Coffer::Coffer(string metaStr){
     srcLen = _srcLen;
     lines = _lines;
     eleLen = _eleLen;
+    dictId = _dictId;
+}
+
+Coffer::Coffer(const CapsuleRecord& rec){
+    data = NULL;
+    cdata = NULL;
+    seekable = NULL;
+    mapped = false;
+    type = -1;
+    filenames = to_string(rec.id);
+    compressed = rec.codec;
+    offset = rec.offset;
+    destLen = rec.destLen;
+    srcLen = rec.srcLen;
+    lines = rec.lines;
+    eleLen = rec.eleLen;
+    dictId = rec.dictId;
+    hasStats = rec.hasStats != 0;
+    stats.minLen = rec.minLen;
+    stats.maxLen = rec.maxLen;
+    stats.charMask = rec.charMask;
+    stats.empty = rec.empty;
+    stats.distinct = rec.distinct;
+    stats.numeric = rec.numeric;
+    stats.vmin = rec.vmin;
+    stats.vmax = rec.vmax;
 }
 
 Coffer::~Coffer()
 {
-    if(data){
+    release();
+}
+
+void Coffer::release(){
+    if(data && !(mapped && (unsigned char*)data == cdata)){
         delete[] data;
-        data = NULL;
     }
-    if(cdata){
+    data = NULL;
+    if(cdata && !mapped){
         delete[] cdata;
-        cdata = NULL;
+    }
+    cdata = NULL;
+    mapped = false;
+    if(seekable){
+        ZSTD_seekable_free(seekable);
+        seekable = NULL;
     }
 }
 
-int Coffer::compress(string compression_method, int compression_level){
+int Coffer::compress(string compression_method, int compression_level, ZSTD_CCtx* cctx){
     size_t com_space_size = ZSTD_compressBound(srcLen);
     cdata = new Byte[com_space_size];
-    int nb = 0; const char* wv = getenv("LOGGREP_ZSTD_WORKERS"); if(wv){ nb = atoi(wv); if(nb<0) nb=0; }
-    if(nb > 0){
-        ZSTD_CCtx* cctx = ZSTD_createCCtx();
-        ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, nb);
-        destLen = ZSTD_compress2(cctx, cdata, com_space_size, data, srcLen);
-        ZSTD_freeCCtx(cctx);
+    size_t res;
+    if(cctx){
+        res = ZSTD_compress2(cctx, cdata, com_space_size, data, srcLen);
     } else {
-        destLen = ZSTD_compress(cdata, com_space_size, data, srcLen, compression_level);
+        int nb = 0; const char* wv = getenv("LOGGREP_ZSTD_WORKERS"); if(wv){ nb = atoi(wv); if(nb<0) nb=0; }
+        if(nb > 0){
+            ZSTD_CCtx* cctx = ZSTD_createCCtx();
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, nb);
+            res = ZSTD_compress2(cctx, cdata, com_space_size, data, srcLen);
+            ZSTD_freeCCtx(cctx);
+        } else {
+            res = ZSTD_compress(cdata, com_space_size, data, srcLen, compression_level);
+        }
     }
-    compressed = 1;
+    if(ZSTD_isError(res)){
+        //keep the capsule readable: store it raw rather than writing an error code as its length
+        printf("varName: %s 压缩失败: %s, stored raw\n", filenames.c_str(), ZSTD_getErrorName(res));
+        delete[] cdata;
+        cdata = NULL;
+        compressed = CODEC_RAW;
+        destLen = srcLen;
+        return destLen;
+    }
+    destLen = (int)res;
+    compressed = CODEC_ZSTD;
     return destLen;
 }
 
-int Coffer::readFile(FILE* zipFile, int fstart){
+void Coffer::selectCodec(){
+    if(compressed != CODEC_ZSTD || srcLen <= 0) return;
+    long long best = destLen + (long long)srcLen * CODEC_COST_ZSTD / 1000;
+    int codec = CODEC_ZSTD;
+    string enc, alt;
+    if(srcLen + (long long)srcLen * CODEC_COST_RAW / 1000 < best){
+        best = srcLen + (long long)srcLen * CODEC_COST_RAW / 1000;
+        codec = CODEC_RAW;
+    }
+    //RLE/FOR/DELTA only apply to fixed width columns, FOR and DELTA share one parse and are skipped
+    //as soon as a row is not a canonical decimal
+    if(eleLen > 0 && lines > 1 && srcLen >= CODEC_TRIAL_MIN_BYTES){
+        if(codec_rle_encode(data, srcLen, eleLen, lines, alt) && (long long)alt.size() + (long long)srcLen * CODEC_COST_RLE / 1000 < best){
+            best = alt.size() + (long long)srcLen * CODEC_COST_RLE / 1000;
+            codec = CODEC_RLE;
+            enc.swap(alt);
+        }
+        vector<long long> v(lines);
+        if(codec != CODEC_RLE && codec_parse_ints(data, srcLen, eleLen, lines, &v[0])){
+            if(codec_for_pack(&v[0], eleLen, lines, alt) && (long long)alt.size() + (long long)srcLen * CODEC_COST_FOR / 1000 < best){
+                best = alt.size() + (long long)srcLen * CODEC_COST_FOR / 1000;
+                codec = CODEC_FOR;
+                enc.swap(alt);
+            }
+            if(codec_delta_pack(&v[0], eleLen, lines, alt) && (long long)alt.size() + (long long)srcLen * CODEC_COST_DELTA / 1000 < best){
+                best = alt.size() + (long long)srcLen * CODEC_COST_DELTA / 1000;
+                codec = CODEC_DELTA;
+                enc.swap(alt);
+            }
+        }
+    }
+    if(codec == CODEC_ZSTD) return;
+    delete[] cdata;
+    cdata = NULL;
+    compressed = codec;
+    if(codec == CODEC_RAW){
+        destLen = srcLen;
+        return;
+    }
+    cdata = new Byte[enc.size()];
+    memcpy(cdata, enc.data(), enc.size());
+    destLen = enc.size();
+}
+
+void Coffer::makeSeekable(int cp_level){
+    if(compressed != CODEC_ZSTD || dictId != 0 || eleLen <= 0 || lines <= 1) return;
+    int frameRows = max(1, SEEKABLE_FRAME_BYTES / eleLen);
+    unsigned frameBytes = (unsigned)frameRows * eleLen;
+    //every frame has its own header and a 12 byte seek table entry
+    size_t cap = ZSTD_compressBound(srcLen) + ((size_t)srcLen / frameBytes + 1) * 32 + 64;
+    Byte* out = new Byte[cap];
+    ZSTD_seekable_CStream* zcs = ZSTD_seekable_createCStream();
+    ZSTD_outBuffer ob = {out, cap, 0};
+    ZSTD_inBuffer ib = {data, (size_t)srcLen, 0};
+    size_t r = ZSTD_seekable_initCStream(zcs, cp_level, 0, frameBytes);
+    while(!ZSTD_isError(r) && ib.pos < ib.size) r = ZSTD_seekable_compressStream(zcs, &ob, &ib);
+    while(!ZSTD_isError(r) && (r = ZSTD_seekable_endStream(zcs, &ob)) > 0 && ob.pos < ob.size);
+    ZSTD_seekable_freeCStream(zcs);
+    if(ZSTD_isError(r) || r != 0 || ob.pos > (size_t)destLen + (size_t)destLen * SEEKABLE_MAX_GROWTH / 100){
+        delete[] out;
+        return;
+    }
+    delete[] cdata;
+    cdata = out;
+    destLen = ob.pos;
+    compressed = CODEC_SEEKABLE;
+}
+
+int Coffer::readFile(FILE* zipFile, long long fstart){
     // 检查输入参数的有效性
     if(zipFile == NULL) {
         printf("varName: %s 文件指针为空\n", filenames.c_str());
@@ -89,11 +230,11 @@ int Coffer::readFile(FILE* zipFile, int fstart){
         return -1;
     }
     
-    int totOffset = fstart + this->offset;
+    long long totOffset = fstart + this->offset;
     
     // 设置文件位置
-    if(fseek(zipFile, totOffset, SEEK_SET) != 0) {
-        printf("varName: %s 设置文件位置失败: %d\n", filenames.c_str(), totOffset);
+    if(fseeko(zipFile, (off_t)totOffset, SEEK_SET) != 0) {
+        printf("varName: %s 设置文件位置失败: %lld\n", filenames.c_str(), totOffset);
         return -1;
     }
     
@@ -105,6 +246,7 @@ int Coffer::readFile(FILE* zipFile, int fstart){
         return -1;
     }
     
+    memset(cdata + destLen, 0, 5);
     // 读取数据
     size_t res = fread(cdata, sizeof(Byte), destLen, zipFile);
     if(res != (size_t)destLen){
@@ -119,18 +261,79 @@ int Coffer::readFile(FILE* zipFile, int fstart){
 }
 
 
-int Coffer::decompress(){
-    // 如果数据未压缩，直接复制
-    if(compressed == 0){
+int Coffer::readMap(const unsigned char* map, long long mapLen, long long fstart){
+    long long pos = fstart + this->offset;
+    if(map == NULL || destLen <= 0 || pos < 0 || pos + destLen > mapLen) {
+        printf("varName: %s 映射范围无效: %lld + %d > %lld\n", filenames.c_str(), pos, destLen, mapLen);
+        return -1;
+    }
+    //raw capsules are used as the data itself, only fixed width columns do without the zero pad
+    if(compressed == CODEC_RAW && !(eleLen > 0 && pos + destLen + MAP_OVERREAD <= mapLen)) {
+        try {
+            cdata = new unsigned char[destLen + 5];
+        } catch(std::bad_alloc& e) {
+            printf("varName: %s 内存分配失败: %s (大小: %d)\n", filenames.c_str(), e.what(), destLen + 5);
+            return -1;
+        }
+        memcpy(cdata, map + pos, destLen);
+        memset(cdata + destLen, 0, 5);
+        return destLen;
+    }
+    cdata = (unsigned char*)map + pos;
+    mapped = true;
+    return destLen;
+}
+
+//one decompression context per thread, reused by every capsule it decodes
+static ZSTD_DCtx* coffer_dctx(){
+    struct DCtxHolder{
+        ZSTD_DCtx* dctx;
+        DCtxHolder(): dctx(ZSTD_createDCtx()) {}
+        ~DCtxHolder(){ ZSTD_freeDCtx(dctx); }
+    };
+    static thread_local DCtxHolder holder;
+    return holder.dctx;
+}
+
+int Coffer::decompress(ZSTD_DDict* ddict){
+    // 如果数据未压缩，直接接管读入的缓冲区, 映射里的原样使用
+    if(compressed == CODEC_RAW){
         if(srcLen == 0) return 0;
+        if(cdata == NULL || destLen != srcLen) {
+            printf("varName: %s 原始数据无效\n", filenames.c_str());
+            return -1;
+        }
+        data = (char*)cdata;
+        if(mapped) return srcLen;
+        cdata = NULL;
+        return srcLen;
+    }
+    if(compressed == CODEC_RLE || compressed == CODEC_FOR || compressed == CODEC_DELTA){
+        if(cdata == NULL || destLen <= 0 || srcLen > MAX_SAFE_DECOMPRESS_SIZE) {
+            printf("varName: %s 压缩数据无效\n", filenames.c_str());
+            return -1;
+        }
         try {
             data = new char[srcLen + 5];
-            memcpy(data, cdata, sizeof(char)*srcLen);
-            return srcLen;
+            memset(data + srcLen, 0, 5);
         } catch(std::bad_alloc& e) {
             printf("varName: %s 内存分配失败: %s (大小: %d)\n", filenames.c_str(), e.what(), srcLen + 5);
             return -1;
         }
+        int res = srcLen;
+        if(compressed == CODEC_RLE){
+            if(srcLen % destLen != 0) res = -1;
+            else codec_rle_decode(cdata, destLen, data, srcLen);
+        }else{
+            res = codec_int_format(compressed, cdata, destLen, data, srcLen);
+        }
+        if(res != srcLen){
+            printf("varName: %s 解码失败: codec %d\n", filenames.c_str(), compressed);
+            delete[] data;
+            data = NULL;
+            return -1;
+        }
+        return srcLen;
     }
     
     // 检查压缩数据是否有效
@@ -138,6 +341,20 @@ int Coffer::decompress(){
         printf("varName: %s 压缩数据无效\n", filenames.c_str());
         return -1;
     }
+    //seekable: the frames decode back to back, the seek table is a skippable frame
+    if(compressed == CODEC_SEEKABLE){
+        if(srcLen > MAX_SAFE_DECOMPRESS_SIZE) return -1;
+        data = new char[srcLen + 5];
+        memset(data + srcLen, 0, 5);
+        size_t res = ZSTD_decompressDCtx(coffer_dctx(), data, srcLen, cdata, destLen);
+        if(ZSTD_isError(res) || res != (size_t)srcLen){
+            printf("varName: %s 解压缩失败: seekable\n", filenames.c_str());
+            delete[] data;
+            data = NULL;
+            return -1;
+        }
+        return srcLen;
+    }
     
     // 获取解压后的大小
     size_t decom_buf_size = ZSTD_getFrameContentSize(cdata, destLen);
@@ -166,7 +383,18 @@ int Coffer::decompress(){
         memset(data, 0, decom_buf_size + 5);
         
         // 执行解压缩
-        int res = ZSTD_decompress(data, decom_buf_size, cdata, destLen);
+        int res;
+        if(dictId != 0){
+            if(ddict == NULL){
+                printf("varName: %s 缺少字典: %d\n", filenames.c_str(), dictId);
+                delete[] data;
+                data = NULL;
+                return -1;
+            }
+            res = ZSTD_decompress_usingDDict(coffer_dctx(), data, decom_buf_size, cdata, destLen, ddict);
+        }else{
+            res = ZSTD_decompressDCtx(coffer_dctx(), data, decom_buf_size, cdata, destLen);
+        }
         if(res != srcLen){
             printf("varName: %s 解压缩失败，返回值: %d\n", filenames.c_str(), res);
             delete[] data;
@@ -188,8 +416,56 @@ int Coffer::decompress(){
     }
 }
 
+int Coffer::decompressRows(int rowStart, int rowCount, char* out){
+    if(eleLen <= 0 || rowStart < 0 || rowCount <= 0 || rowStart + rowCount > lines) return -1;
+    size_t len = (size_t)rowCount * eleLen;
+    if(data != NULL){
+        memcpy(out, data + (size_t)rowStart * eleLen, len);
+        return len;
+    }
+    if(compressed != CODEC_SEEKABLE || cdata == NULL) return -1;
+    ZSTD_seekable* zs = seekTable();
+    if(zs == NULL) return -1;
+    size_t res = ZSTD_seekable_decompress(zs, out, len, (unsigned long long)rowStart * eleLen);
+    if(ZSTD_isError(res) || res != len){
+        printf("varName: %s 解压缩失败: rows %d+%d\n", filenames.c_str(), rowStart, rowCount);
+        return -1;
+    }
+    return len;
+}
+
+int Coffer::frameRows(){
+    if(compressed != CODEC_SEEKABLE || cdata == NULL || eleLen <= 0) return lines;
+    ZSTD_seekable* zs = seekTable();
+    int rows = lines;
+    if(zs != NULL && ZSTD_seekable_getNumFrames(zs) > 0) rows = ZSTD_seekable_getFrameDecompressedSize(zs, 0) / eleLen;
+    return rows > 0 ? rows : lines;
+}
+
+//the seek table is parsed once per loaded cdata, SeekRow asks for one frame at a time
+ZSTD_seekable* Coffer::seekTable(){
+    if(seekable != NULL) return seekable;
+    if(compressed != CODEC_SEEKABLE || cdata == NULL) return NULL;
+    ZSTD_seekable* zs = ZSTD_seekable_create();
+    if(zs == NULL) return NULL;
+    if(ZSTD_isError(ZSTD_seekable_initBuff(zs, cdata, destLen))){
+        ZSTD_seekable_free(zs);
+        printf("varName: %s 解压缩失败: seek table\n", filenames.c_str());
+        return NULL;
+    }
+    seekable = zs;
+    return seekable;
+}
+
+int Coffer::decodeInts(vector<long long>& values){
+    if((compressed != CODEC_FOR && compressed != CODEC_DELTA) || cdata == NULL || eleLen <= 0) return -1;
+    values.resize(lines);
+    if(lines == 0) return 0;
+    return codec_int_decode(compressed, cdata, destLen, srcLen, &values[0]);
+}
+
 void Coffer::output(FILE* zipFile, int typ){
-    if(cdata == NULL || zipFile == NULL){
+    if((compressed ? (void*)cdata : (void*)data) == NULL || zipFile == NULL){
         cout << "coffer: " + filenames + " output failed" << endl;
         return;
     }
@@ -5,7 +5,28 @@
 #include<cstdio>
 #include<vector>
 #include"constant.h"
+#include"Codec.h"
+#include"CapsuleDir.h"
+#include<zstd.h>
 using namespace std;
+
+//column statistics of a fixed width var/svar capsule, written into its meta line so a predicate can rule
+//the capsule out before reading it; lengths and classes are over the values with the left padding dropped
+typedef struct CofferStats
+{
+    int minLen, maxLen; //over the non blank rows
+    int charMask; //getType bits of every value byte, the same bits as TAG_* on the query side
+    int empty; //blank rows
+    int distinct; //HyperLogLog estimate
+    int numeric; //rows strtol reads as a whole integer, vmin/vmax are over these
+    long long vmin, vmax;
+}CofferStats;
+
+typedef struct ZSTD_seekable_s ZSTD_seekable; //zstd_seekable.h
+
+//bytes a mapped raw column needs after its end, the SIMD scanners load past the last element
+#define MAP_OVERREAD 64
+
 class Coffer{
     public:
         string filenames;
@@ -19,17 +40,31 @@ class Coffer{
         unsigned char* cdata;
         unsigned char dictSize[4];
         
-        int compressed;
-        int offset;
+        int compressed; //codec, CODEC_* in Codec.h
+        int dictId; //capsule name of the zstd dictionary cdata was compressed with, 0 = none
+        long long offset; //64-bit, an archive may exceed 2GB
+        bool hasStats;
+        CofferStats stats;
+        bool mapped; //cdata (and data of a raw capsule) lives in the query side archive mapping
+        ZSTD_seekable* seekable; //seek table over cdata of a CODEC_SEEKABLE capsule, built by seekTable(), freed by release()
         Coffer();
         Coffer(string filename, char* srcData, int srcL, int line, int typ, int _ele);
         Coffer(string filename, string srcData, int srcL, int line, int typ, int _ele); 
         ~Coffer();
         Coffer(string metaFile);
-        int readFile(FILE* zipFile, int fstart); //Read to cdata
+        Coffer(const CapsuleRecord& rec);
+        int readFile(FILE* zipFile, long long fstart); //Read to cdata
+        int readMap(const unsigned char* map, long long mapLen, long long fstart); //point cdata into a mapping of the archive
+        void release(); //free data and cdata, borrowed mapping memory is left alone
 
-        int compress(string cp_mode, int cp_level); //compress data to cdata
-        int decompress(); //decompress cdata to data
+        int compress(string cp_mode, int cp_level, ZSTD_CCtx* cctx = NULL); //compress data to cdata, cctx: reused context with parameters set
+        void selectCodec(); //after compress(): keep zstd or switch to raw/rle/for by the cost model
+        void makeSeekable(int cp_level); //after selectCodec(): rewrite a zstd column as row aligned seekable frames, the caller checks the size
+        int decompress(ZSTD_DDict* ddict = NULL); //decompress cdata to data, ddict required when dictId != 0
+        int decompressRows(int rowStart, int rowCount, char* out); //rows [rowStart, rowStart + rowCount) of a fixed width column to out
+        int frameRows(); //rows per seekable frame, lines for any other codec
+        ZSTD_seekable* seekTable(); //cached seek table of a seekable cdata, NULL for other codecs
+        int decodeInts(vector<long long>& values); //typed read of a FOR/DELTA column from cdata, -1 for other codecs
 
         void output(FILE* zipFile, int typ); //output compressed cdata
         void printFile(string rootPath); //output to root Path
@@ -6,36 +6,218 @@
 #include <algorithm>
 #include "constant.h"
 #include "union.h"
+#include "TimeColumn.h"
+#include "Sketch.h"
+#include "util.h"
+#include <cctype>
 #include <zstd.h>
+#include <zdict.h>
+#include <map>
+#include <thread>
+#include <atomic>
 using namespace std;
 Encoder::Encoder(string cp_mode, string zip_mode, int compression_level){
     data.clear();
     _meta_out = (zip_mode == "O") ? true : false;
     _cp_mode = cp_mode;
     cp_level = compression_level;
+    group = 0;
+    threads = 1;
+}
+
+Encoder* Encoder::fork(){
+    Encoder* e = new Encoder(_cp_mode, "", cp_level);
+    e -> _meta_out = _meta_out;
+    e -> group = group;
+    return e;
+}
+
+void Encoder::absorb(Encoder* other){
+    data.insert(data.end(), other -> data.begin(), other -> data.end());
+    other -> data.clear();
+}
+
+Encoder::~Encoder(){
+    for(auto &temp: data){
+        delete temp;
+    }
+    data.clear();
 }
 
 bool sortCoffer(Coffer* co1, Coffer* co2){
     return co1 -> type < co2 -> type;
 }
 
+void Encoder::runPool(int n, const function<void(ZSTD_CCtx*, int)>& job){
+    int nb = 0; const char* wv = getenv("LOGGREP_ZSTD_WORKERS"); if(wv){ nb = atoi(wv); if(nb<0) nb=0; }
+    std::atomic<int> next(0);
+    auto work = [&](){
+        ZSTD_CCtx* cctx = ZSTD_createCCtx();
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, cp_level);
+        if(nb > 0) ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, nb);
+        for(int i = next++; i < n; i = next++){
+            job(cctx, i);
+        }
+        ZSTD_freeCCtx(cctx);
+    };
+    int workers = min(threads, n);
+    if(workers <= 1){
+        work();
+    }else{
+        vector<std::thread> pool;
+        for(int t = 0; t < workers; t++) pool.push_back(std::thread(work));
+        for(auto &th: pool) th.join();
+    }
+}
+
 string Encoder::compress(){
     string meta = "";
     sort(data.begin(), data.end(), sortCoffer);
-    int nowOffset = 0;
+    //capsules are independent frames: compress them on a pool, one reusable context per thread
+    vector<int> jobs;
+    for(int i = 0; i < (int)data.size(); i++){
+        if(data[i] -> srcLen != 0) jobs.push_back(i);
+    }
+    //only fixed width columns from LOGGREP_SEEKABLE_MIN bytes on are worth the seekable rewrite, LOGGREP_SEEKABLE=0 turns it off
+    const char* ev = getenv("LOGGREP_SEEKABLE");
+    const char* mv = getenv("LOGGREP_SEEKABLE_MIN");
+    long long seekMin = (ev && atoi(ev) == 0) ? -1 : (mv ? atoll(mv) : SEEKABLE_MIN_BYTES);
+    runPool(jobs.size(), [&](ZSTD_CCtx* cctx, int i){
+        Coffer* c = data[jobs[i]];
+        c -> compress(_cp_mode, cp_level, cctx);
+        c -> selectCodec();
+        if(seekMin >= 0 && c -> eleLen > 0 && c -> srcLen >= seekMin) c -> makeSeekable(cp_level);
+    });
+    trainDictionaries();
+    long long nowOffset = 0;
     for(auto &temp: data){
+        temp -> offset = nowOffset;
         if(temp -> srcLen == 0){
             meta += temp -> filenames + " 0 " +  to_string(nowOffset) + " 0 0 0 " + to_string(temp->eleLen) + "\n";
             continue;
         }
-        int destLen = temp -> compress(_cp_mode, cp_level);
-        meta += temp ->filenames + " " + to_string(temp -> compressed) + " " +  to_string(nowOffset) + " " + to_string(destLen) + " " + to_string(temp -> srcLen) + " " + to_string(temp -> lines) + " " + to_string(temp -> eleLen) + "\n";
+        int destLen = temp -> destLen;
+        meta += temp ->filenames + " " + to_string(temp -> compressed) + " " +  to_string(nowOffset) + " " + to_string(destLen) + " " + to_string(temp -> srcLen) + " " + to_string(temp -> lines) + " " + to_string(temp -> eleLen);
+        if(temp -> dictId != 0 || temp -> hasStats) meta += " " + to_string(temp -> dictId);
+        if(temp -> hasStats){
+            CofferStats& st = temp -> stats;
+            meta += " " + to_string(st.minLen) + " " + to_string(st.maxLen) + " " + to_string(st.charMask) + " " + to_string(st.empty) + " " + to_string(st.distinct) + " " + to_string(st.numeric);
+            if(st.numeric > 0) meta += " " + to_string(st.vmin) + " " + to_string(st.vmax);
+        }
+        meta += "\n";
         
         nowOffset += destLen;
     }
    return meta;
 }
 
+string Encoder::directory(){
+    vector<CapsuleRecord> recs(data.size());
+    for(size_t i = 0; i < data.size(); i++){
+        Coffer* c = data[i];
+        CapsuleRecord& r = recs[i];
+        memset(&r, 0, sizeof(r));
+        r.id = atoi(c -> filenames.c_str());
+        r.offset = c -> offset;
+        r.eleLen = c -> eleLen;
+        if(c -> srcLen == 0) continue;
+        r.codec = c -> compressed;
+        r.destLen = c -> destLen;
+        r.srcLen = c -> srcLen;
+        r.lines = c -> lines;
+        r.dictId = c -> dictId;
+        if(c -> hasStats){
+            const CofferStats& st = c -> stats;
+            r.hasStats = 1;
+            r.minLen = st.minLen;
+            r.maxLen = st.maxLen;
+            r.charMask = st.charMask;
+            r.empty = st.empty;
+            r.distinct = st.distinct;
+            r.numeric = st.numeric;
+            r.vmin = st.vmin;
+            r.vmax = st.vmax;
+        }
+    }
+    stable_sort(recs.begin(), recs.end(), [](const CapsuleRecord& a, const CapsuleRecord& b){ return a.id < b.id; });
+    string out;
+    capsule_dir_head(out, recs.size());
+    if(!recs.empty()) out.append((const char*)&recs[0], recs.size() * sizeof(CapsuleRecord));
+    return out;
+}
+
+//Small capsules of one kind (dic, entry, svar...) repeat the same paddings and value shapes,
+//but each frame is too short for zstd to learn them. Train one dictionary per kind over the
+//group, recompress with it and keep it only when it saves more than its own (compressed) size.
+void Encoder::trainDictionaries(){
+    const char* ev = getenv("LOGGREP_ZDICT");
+    if(ev && atoi(ev) == 0) return;
+    const char* mv = getenv("LOGGREP_ZDICT_MIN");
+    long long minTotal = mv ? atoll(mv) : ZDICT_MIN_TOTAL;
+    map<int, vector<int> > kinds;
+    map<int, long long> kindBytes;
+    for(int i = 0; i < (int)data.size(); i++){
+        Coffer* c = data[i];
+        if(c -> compressed == CODEC_ZSTD && c -> srcLen > 0 && c -> srcLen <= ZDICT_MAX_SAMPLE){
+            int kind = atoi(c -> filenames.c_str()) & 0xF;
+            kinds[kind].push_back(i);
+            kindBytes[kind] += c -> srcLen;
+        }
+    }
+    vector<Coffer*> dicts;
+    for(auto &kind: kinds){
+        vector<int>& idx = kind.second;
+        if((int)idx.size() < ZDICT_MIN_SAMPLES || kindBytes[kind.first] < minTotal) continue;
+        string samples;
+        vector<size_t> sizes;
+        for(int i: idx){
+            samples.append(data[i] -> data, data[i] -> srcLen);
+            sizes.push_back(data[i] -> srcLen);
+        }
+        size_t cap = min((size_t)ZDICT_MAX_SIZE, samples.size() / 100);
+        if(cap < ZDICT_MIN_SIZE) continue;
+        string dict(cap, '\0');
+        size_t dictLen = ZDICT_trainFromBuffer(&dict[0], cap, samples.data(), &sizes[0], sizes.size());
+        if(ZDICT_isError(dictLen)) continue;
+        dict.resize(dictLen);
+        ZSTD_CDict* cdict = ZSTD_createCDict(dict.data(), dictLen, cp_level);
+        vector<Byte*> out(idx.size(), NULL);
+        vector<size_t> outLen(idx.size(), 0);
+        runPool(idx.size(), [&](ZSTD_CCtx* cctx, int j){
+            Coffer* c = data[idx[j]];
+            size_t bound = ZSTD_compressBound(c -> srcLen);
+            out[j] = new Byte[bound];
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_dictIDFlag, 0); //the meta names the dictionary
+            ZSTD_CCtx_refCDict(cctx, cdict);
+            outLen[j] = ZSTD_compress2(cctx, out[j], bound, c -> data, c -> srcLen);
+            ZSTD_CCtx_refCDict(cctx, NULL);
+        });
+        long long saving = 0;
+        for(int j = 0; j < (int)idx.size(); j++){
+            if(!ZSTD_isError(outLen[j]) && outLen[j] < (size_t)data[idx[j]] -> destLen) saving += data[idx[j]] -> destLen - outLen[j];
+        }
+        Coffer* dCoffer = new Coffer(to_string(((kind.first + 1) << POS_VAR) | (TYPE_ZDICT << POS_TYPE)), dict, dictLen, 1, 9, -1);
+        dCoffer -> compress(_cp_mode, cp_level);
+        if(saving > (long long)dCoffer -> destLen){
+            for(int j = 0; j < (int)idx.size(); j++){
+                Coffer* c = data[idx[j]];
+                if(ZSTD_isError(outLen[j]) || outLen[j] >= (size_t)c -> destLen) continue;
+                delete[] c -> cdata;
+                c -> cdata = out[j];
+                c -> destLen = outLen[j];
+                c -> dictId = atoi(dCoffer -> filenames.c_str());
+                out[j] = NULL;
+            }
+            dicts.push_back(dCoffer);
+        }else{
+            delete dCoffer;
+        }
+        for(auto &o: out) delete[] o;
+        ZSTD_freeCDict(cdict);
+    }
+    data.insert(data.end(), dicts.begin(), dicts.end());
+}
+
 string Encoder::padding(string filename, int Idx, int maxIdx){
     int totLen = 1 + log10(maxIdx + 1);
     int nowLen = 1 + log10(Idx + 1);
@@ -45,10 +227,7 @@ string Encoder::padding(string filename, int Idx, int maxIdx){
     }
     int padSize = totLen - nowLen;
     if(padSize == 0) return to_string(Idx);
-    char* PADS = new char[padSize];
-    for(int i = 0; i < padSize; i++) PADS[i] = ' ';
-    PADS[padSize] = '\0';
-    return string(PADS) + to_string(Idx);
+    return string(padSize, ' ') + to_string(Idx);
 }
 
 void Encoder::padding(string filename, char* buffer, int startPos, int padSize, int typ){
@@ -68,17 +247,14 @@ string Encoder::padding(string filename, string target, int maxLen, int typ){
     }
     int padSize = maxLen - target.size();
     if(padSize == 0) return target;
-    char* PADS = new char[padSize + 5];
-    for(int i = 0; i < padSize; i ++) PADS[i] = PAD;
-    PADS[padSize] = '\0';
-    return string(PADS) + target;
+    return string(padSize, PAD) + target;
 }
 
 void Encoder::serializeTemplate(string zip_path, LengthParser* parser){
     char* longStr = NULL;
     int ll = parser -> getTemplate(&longStr);
     if(_meta_out){
-        FILE* test = fopen((zip_path + ".templates").c_str(), "w");
+        FILE* test = fopen((zip_path + ".templates").c_str(), (group > 0) ? "a" : "w");
         fprintf(test, "%s", longStr);
         fclose(test);
     }
@@ -87,37 +263,89 @@ void Encoder::serializeTemplate(string zip_path, LengthParser* parser){
     data.push_back(nCoffer);
 }
 
-void Encoder::serializeTemplateOutlier(char** failed_log, int failLine){
-    string longStr = "";
-    int count = 0;
-    for(int i = 0; i < failLine; i++, count++){
-        string temp(failed_log[i]);
-        if(longStr.size() + temp.size() > MAXCOMPRESS){
-            Coffer* nCoffer = new Coffer(to_string(TYPE_OUTLIER << POS_TYPE), longStr, longStr.size(), count, 1, -1);
-            data.push_back(nCoffer);
-            longStr = "";
-            count = 0;
+void Encoder::serializeTemplateOutlier(const FailedLines& failed){
+    //capsules are slices of the failed line buffer, split before MAXCOMPRESS
+    int failLine = failed.count();
+    int start = 0;
+    for(int i = 0; i < failLine; i++){
+        long long size = failed.offsets[i] - failed.offsets[start];
+        long long lineLen = failed.offsets[i + 1] - failed.offsets[i] - 1;
+        if(size + lineLen > MAXCOMPRESS){
+            pushOutlierSlice(failed, start, i);
+            start = i;
         }
-        longStr += temp + "\n";
-        
     }
-    Coffer* nCoffer = new Coffer(to_string(TYPE_OUTLIER << POS_TYPE), longStr, longStr.size(), count, 1, -1);
+    pushOutlierSlice(failed, start, failLine);
+}
+
+void Encoder::pushOutlierSlice(const FailedLines& failed, int from, int to){
+    int srcL = failed.offsets[to] - failed.offsets[from];
+    char* temp = new char[srcL + 5];
+    memcpy(temp, failed.buf.data() + failed.offsets[from], srcL);
+    temp[srcL] = '\0';
+    Coffer* nCoffer = new Coffer(to_string(TYPE_OUTLIER << POS_TYPE), temp, srcL, to - from, 1, -1);
+    data.push_back(nCoffer);
+}
+
+//HyperLogLog of a column as its own capsule next to it, Aggregate_Distinct merges these instead of
+//rescanning the column when the query has no filter. Short columns rescan fast, they get none.
+void Encoder::serializeSketch(string filename, const uint8_t* reg, int rows){
+    const char* ev = getenv("LOGGREP_HLL");
+    if(ev && atoi(ev) == 0) return;
+    static const int minRows = getenv("LOGGREP_HLL_MIN_ROWS") ? atoi(getenv("LOGGREP_HLL_MIN_ROWS")) : HLL_MIN_ROWS;
+    if(rows < minRows) return;
+    string packed;
+    hll_pack(reg, packed);
+    if(packed.empty()) return;
+    int id = atoi(filename.c_str());
+    int sketchId = (id & (~0xF)) | (TYPE_HLL << POS_TYPE);
+    Coffer* nCoffer = new Coffer(to_string(sketchId), packed, packed.size(), 1, 1, -1);
     data.push_back(nCoffer);
 }
 
+//values as the query side reads them back out of a fixed width column: the sketch and the length/class
+//stats skip the left padding and blank rows, the numeric range parses like FilterNumericVar (both sides
+//trimmed, strtol must read the whole value, so a blank row counts as 0)
+static void scanColumn(const char* col, int width, int lines, uint8_t* reg, CofferStats& st){
+    st.minLen = width;
+    st.maxLen = 0;
+    st.charMask = 0;
+    st.empty = 0;
+    st.distinct = 0;
+    st.numeric = 0;
+    st.vmin = st.vmax = 0;
+    string buf;
+    for(int i = 0; i < lines; i++){
+        const char* e = col + (long long)i * width;
+        int k = 0;
+        while(k < width && e[k] == ' ') k++;
+        if(k == width){
+            st.empty++;
+        }else{
+            hll_add(reg, HLL_P, e + k, width - k);
+            st.minLen = min(st.minLen, width - k);
+            st.maxLen = max(st.maxLen, width - k);
+            st.charMask |= getType(e + k, width - k);
+        }
+        int t = width;
+        while(t > k && e[t - 1] == ' ') t--;
+        buf.assign(e + k, t - k);
+        char* end = NULL;
+        long long v = strtol(buf.c_str(), &end, 10);
+        if(!(end && (*end == '\0' || isspace(*end)))) continue;
+        if(st.numeric == 0 || v < st.vmin) st.vmin = v;
+        if(st.numeric == 0 || v > st.vmax) st.vmax = v;
+        st.numeric++;
+    }
+    if(st.empty == lines) st.minLen = 0;
+    st.distinct = (int)llround(hll_estimate(reg, HLL_P));
+}
+
 void Encoder::serializeVar(string filename, char* globuf, VarArray* var, int maxLen){
     int length = var ->nowPos;
     int tot = length * (maxLen+1);
     char* temp = new char[tot + 5];
     int nowPtr = 0;
-    const int KMV_K = 1024;
-    std::vector<unsigned long long> kmv;
-    kmv.reserve(KMV_K);
-    auto hash64 = [](const char* s, int len)->unsigned long long{
-        unsigned long long h = 1469598103934665603ULL;
-        for(int i=0;i<len;i++){ h ^= (unsigned long long)(unsigned char)s[i]; h *= 1099511628211ULL; }
-        return h;
-    };
     for(int i=0; i< length; i++)
     {
         int varLen = var->len[i];
@@ -126,26 +354,21 @@ void Encoder::serializeVar(string filename, char* globuf, VarArray* var, int max
         padding(filename, temp, nowPtr, padSize, 0);
         nowPtr += padSize;
         strncpy(temp + nowPtr, globuf + var->startPos[i], varLen);
-        unsigned long long hv = hash64(globuf + var->startPos[i], varLen);
-        if((int)kmv.size() < KMV_K){ kmv.push_back(hv); }
-        else {
-            int idxMax = 0; unsigned long long vmax = kmv[0];
-            for(int j=1;j<KMV_K;j++){ if(kmv[j] > vmax){ vmax = kmv[j]; idxMax = j; } }
-            if(hv < vmax){ kmv[idxMax] = hv; }
-        }
         nowPtr += varLen;
     }
 
     Coffer* nCoffer = new Coffer(filename, temp, nowPtr, length, 5, maxLen);
     data.push_back(nCoffer);
 
+    uint8_t reg[HLL_M] = {0};
+    if(maxLen > 0 && nowPtr == length * maxLen){
+        scanColumn(temp, maxLen, length, reg, nCoffer -> stats);
+        nCoffer -> hasStats = true;
+    }
+    serializeSketch(filename, reg, length);
+
     if(length >= 10000){
-        if(kmv.empty()) return;
-        unsigned long long vmax = kmv[0];
-        for(size_t j=1;j<kmv.size();j++){ if(kmv[j] > vmax) vmax = kmv[j]; }
-        double Uk = (double)vmax / (double)0xFFFFFFFFFFFFFFFFULL;
-        if(Uk <= 0.) Uk = 1e-12;
-        double Dhat = ((double)kmv.size() - 1.0) / Uk;
+        double Dhat = hll_estimate(reg, HLL_P);
         if(Dhat < 1.0) Dhat = 1.0;
         double r = Dhat / (double)length;
         if(r >= 0.7){
@@ -169,7 +392,7 @@ void Encoder::serializeVar(string filename, char* globuf, VarArray* var, int max
             auto setbit = [&](size_t bit){ size_t byte = bit >> 3; int off = bit & 7; bloom[24 + byte] |= (unsigned char)(1u << off); };
             for(int i=0;i<length;i++){
                 int varLen = var->len[i];
-                unsigned long long h1 = hash64(globuf + var->startPos[i], varLen);
+                unsigned long long h1 = sketch_hash64(globuf + var->startPos[i], varLen);
                 unsigned long long h2 = mix(h1);
                 for(int t=0;t<k;t++){
                     unsigned long long hv = h1 + t * h2;
@@ -180,19 +403,32 @@ void Encoder::serializeVar(string filename, char* globuf, VarArray* var, int max
             int id = atoi(filename.c_str());
             int base = (id & (~0xF));
             int bloomId = base | (TYPE_BLOOM << POS_TYPE);
-            Coffer* bCoffer = new Coffer(to_string(bloomId), (char*)&bloom[0], (int)bloom.size(), 1, 1, -4);
+            char* bloomData = new char[bloom.size()];
+            memcpy(bloomData, &bloom[0], bloom.size());
+            Coffer* bCoffer = new Coffer(to_string(bloomId), bloomData, (int)bloom.size(), 1, 1, -4);
             data.push_back(bCoffer);
         }
     }
 }
 
 void Encoder::serializeEntry(string filename, int* entry, int maxEntry, int total){
-   string longStr = "";
-   int paddingSize = 1 + log10(maxEntry);
+   //minimal width ints, little endian bit stream; tail pad lets readers load 8 bytes at any row
+   //width is rounded to whole bytes: zstd finds far less repetition in unaligned bit streams
+   int bits = 1;
+   while(bits < 32 && ((unsigned int)maxEntry >> bits)) bits++;
+   bits = (bits + 7) / 8 * 8;
+   size_t streamLen = ((size_t)total * bits + 7) / 8;
+   string longStr(sizeof(int) + streamLen + 8, '\0');
+   memcpy(&longStr[0], &bits, sizeof(int));
+   unsigned char* p = (unsigned char*)&longStr[sizeof(int)];
    for(int i = 0; i < total; i++){
-       longStr += padding(filename, to_string(entry[i]), paddingSize, 0);
+       unsigned long long bit = (unsigned long long)i * bits;
+       unsigned long long w;
+       memcpy(&w, p + (bit >> 3), sizeof(w));
+       w |= (unsigned long long)(unsigned int)entry[i] << (bit & 7);
+       memcpy(p + (bit >> 3), &w, sizeof(w));
    }
-   Coffer* nCoffer = new Coffer(filename, longStr, longStr.size(), total, 4, paddingSize);
+   Coffer* nCoffer = new Coffer(filename, longStr, longStr.size(), total, 4, ELE_BITPACKED);
    data.push_back(nCoffer);
 }
 
@@ -201,64 +437,81 @@ bool pairCmp (pair<string, int>&t1, pair<string, int>& t2){
 }
 
 void Encoder::serializeDic(string filename, char* globuf, VarArray* varMapping, Union* root){
-    vector<pair<unsigned int, int> >* container = root -> getContainer();
+    vector<pair<int, int> >* container = root -> getContainer();
     int count = 0;
     int paddingSize = root -> nowPaddingSize[0];
     int patIdx = 0;
     int nowPtr = 0;
     int bufferSize = (root -> dicMax >= 10000) ? MAXBUFFER : MAX_VALUE_LEN * root ->dicMax;
     char* temp = new char[bufferSize];
-    for(vector<pair<unsigned int, int> >::iterator it = container -> begin(); it != container -> end(); it++,count++){
+    uint8_t reg[HLL_M] = {0};
+    for(vector<pair<int, int> >::iterator it = container -> begin(); it != container -> end(); it++,count++){
 
         if(count == root -> nowCounter[patIdx]){
             count = 0;
             patIdx++;
             paddingSize = root -> nowPaddingSize[patIdx]; 
         }
-        int nowPos = root ->posDictionary[it ->first];
+        int nowPos = it ->second;
         int nowLen = varMapping->len[nowPos];
         padding(filename, temp, nowPtr, paddingSize - nowLen, 0);
         nowPtr += paddingSize - nowLen;
         strncpy(temp + nowPtr, globuf + varMapping->startPos[nowPos], nowLen);
         nowPtr += varMapping->len[nowPos];
+        //dictionary values are read back with both sides trimmed, empty ones included
+        const char* v = globuf + varMapping->startPos[nowPos];
+        int b = 0, e = nowLen;
+        while(b < e && v[b] == ' ') b++;
+        while(e > b && v[e - 1] == ' ') e--;
+        hll_add(reg, HLL_P, v + b, e - b);
     } 
+    delete container;
     Coffer* nCoffer = new Coffer(filename, temp, nowPtr, root -> dicMax, 3, -2);
     data.push_back(nCoffer);
+    serializeSketch(filename, reg, varMapping -> nowPos);
 }
 
 void Encoder::serializeSvar(string filename, SubPattern* subPattern){
-    bool debug = false;
-    if(debug) cout << subPattern -> type << endl;
-    
-    if(subPattern -> type == 1){  //fint, fstr
-        string longStr = "";
-        for(int i = 0; i < subPattern -> data_count; i++){
-            string tempStr = subPattern -> data[i];
-            if(tempStr.size() == 0) tempStr = padding(filename, subPattern ->data[i], subPattern -> length, subPattern -> type);
-            longStr += tempStr;
+    //fint, fstr: values are length wide, failed rows are blank; int, str: values right aligned to maxLen
+    if(subPattern -> type != 1 && subPattern -> type != 2) return;
+    int eleLen = (subPattern -> type == 1) ? subPattern -> length : subPattern -> maxLen;
+    int width = max(eleLen, 0);
+    int count = subPattern -> data_count;
+    int tot = count * width;
+    char* temp = new char[tot + 5];
+    int nowPtr = 0;
+    for(int i = 0; i < count; i++){
+        StrView& v = subPattern -> data[i];
+        int padSize = width - v.len;
+        if(padSize < 0){
+            printf("%s String Padding Error: maxLen: %d, target size: %d\n", filename.c_str(), width, v.len);
+            padSize = 0;
         }
-        Coffer* nCoffer = new Coffer(filename, longStr, longStr.size(), subPattern -> data_count, 6, subPattern -> length);
-        data.push_back(nCoffer);
+        padding(filename, temp, nowPtr, padSize, subPattern -> type);
+        nowPtr += padSize;
+        int l = min(v.len, width);
+        if(l > 0) memcpy(temp + nowPtr, v.ptr, l);
+        nowPtr += l;
     }
-    if(subPattern -> type == 2){ //int, str
-        string longStr = "";
-        for(int i = 0; i < subPattern -> data_count; i++){
-            string tempStr = padding(filename, subPattern -> data[i], subPattern -> maxLen, subPattern -> type);
-            int ssize = subPattern ->data[i].size();
-            if(ssize  < subPattern ->maxLen && debug) cout << subPattern -> data[i] << " " << tempStr << endl;
-            longStr += tempStr;
-        } 
-        int paddingSize = subPattern -> maxLen;
-        if(debug) cout << longStr << endl;
-        Coffer* nCoffer = new Coffer(filename, longStr, longStr.size(), subPattern -> data_count, 6, paddingSize);
-        data.push_back(nCoffer);
+    temp[nowPtr] = '\0';
+    Coffer* nCoffer = new Coffer(filename, temp, nowPtr, count, 6, eleLen);
+    data.push_back(nCoffer);
+
+    uint8_t reg[HLL_M] = {0};
+    if(width > 0 && nowPtr == tot){
+        scanColumn(temp, width, count, reg, nCoffer -> stats);
+        nCoffer -> hasStats = true;
     }
+    serializeSketch(filename, reg, count);
 }
 
-void Encoder::serializeOutlier(string filename, vector<pair<int, string> > outliers){
+void Encoder::serializeOutlier(string filename, const vector<pair<int, StrView> >& outliers){
     string longStr = "";
     for(auto &temp: outliers){
-        longStr += to_string(temp.first) + " " + temp.second + "\n";
+        longStr += to_string(temp.first);
+        longStr += ' ';
+        longStr.append(temp.second.ptr, temp.second.len);
+        longStr += '\n';
     }
     Coffer* nCoffer = new Coffer(filename, longStr, longStr.size(), outliers.size(), 7, -3);
     data.push_back(nCoffer);
@@ -266,7 +519,7 @@ void Encoder::serializeOutlier(string filename, vector<pair<int, string> > outli
 
 void Encoder::serializeSubpattern(string zip_path, string SUBPATTERN, int SUBCOUNT){
     if(_meta_out){
-        FILE* test = fopen((zip_path + ".variables").c_str(), "w");
+        FILE* test = fopen((zip_path + ".variables").c_str(), (group > 0) ? "a" : "w");
         fprintf(test, "%s", SUBPATTERN.c_str());
         fclose(test);
     }
@@ -281,7 +534,8 @@ void Encoder::output(string zip_path, int typ){
        }
        return;
     }
-    FILE* zipFile = fopen(zip_path.c_str(), "w");
+    const char* fmode = (group > 0) ? "a" : "w";
+    FILE* zipFile = fopen(zip_path.c_str(), fmode);
     if (zipFile == NULL){
         cout << "open zip file failed" << endl;
         return;
@@ -290,10 +544,13 @@ void Encoder::output(string zip_path, int typ){
     string meta = compress();//Build meta
     
     if(_meta_out){
-        FILE* test = fopen((zip_path + ".meta").c_str(),"w");
+        FILE* test = fopen((zip_path + ".meta").c_str(), fmode);
         fprintf(test, "%s", meta.c_str());
         fclose(test);
     }
+    //LOGGREP_TEXT_META=1 keeps the text meta for readers that predate the binary directory
+    const char* tv = getenv("LOGGREP_TEXT_META");
+    if(!(tv && atoi(tv) != 0)) meta = directory();
 
 	size_t com_space_size = ZSTD_compressBound(meta.size());
 	Byte* pZstd = new Byte[com_space_size];
@@ -319,19 +576,9 @@ void Encoder::serializeTimeColumn(const std::vector<long long>& times){
         data.push_back(nCoffer);
         return;
     }
-    // encode as fixed-width 64-bit decimal strings for simplicity
-    int paddingSize = 13; // enough for epoch ms
-    string longStr;
-    longStr.reserve(times.size() * (paddingSize));
-    for(size_t i=0;i<times.size();i++){
-        string v = to_string(times[i]);
-        if((int)v.size() < paddingSize){
-            longStr += string(paddingSize - v.size(), ' ') + v;
-        } else {
-            longStr += v;
-        }
-    }
-    Coffer* nCoffer = new Coffer(to_string(TYPE_TIME_COL << POS_TYPE), longStr, longStr.size(), times.size(), 8, paddingSize);
+    // delta-of-delta zigzag varints in fixed row blocks, see TimeColumn.h
+    string longStr = encode_time_column(times);
+    Coffer* nCoffer = new Coffer(to_string(TYPE_TIME_COL << POS_TYPE), longStr, longStr.size(), times.size(), 8, TIME_COL_BINARY);
     data.push_back(nCoffer);
 }
 
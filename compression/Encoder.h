@@ -4,6 +4,8 @@
 #include<string>
 #include<cstdlib>
 #include<vector>
+#include<functional>
+#include<stdint.h>
 #include"Coffer.h"
 #include"LengthParser.h"
 #include"SubPattern.h"
@@ -16,6 +18,10 @@ class Encoder{
         vector<Coffer*> data;
         Coffer* merge(int* ids); //TODO: Merge several small coffers
         string compress(); //Build meta string, merge coffers
+        string directory(); //binary capsule directory (CapsuleDir.h) of the coffers placed by compress()
+        void trainDictionaries(); //per capsule kind zstd dictionaries over small capsules
+        void pushOutlierSlice(const FailedLines& failed, int from, int to); //lines [from, to) as one outlier capsule
+        void runPool(int n, const function<void(ZSTD_CCtx*, int)>& job); //job(cctx, i) for i in [0, n) on up to threads workers
         string padding(string filename, int Idx, int maxIdx);
         string padding(string filename, string target, int maxLen, int typ);
         void padding(string filename, char* buffer, int startPos, int padSize, int typ);
@@ -23,17 +29,24 @@ class Encoder{
         bool _meta_out;
         string _cp_mode;
         int cp_level;
+        int group; //capsule group index in a streamed archive, groups > 0 are appended
+        int threads; //capsules compressed concurrently
         Encoder(string cp_mode, string zip_mode, int compression_level);
+        ~Encoder();
+
+        Encoder* fork(); //empty encoder with the same settings, for one worker
+        void absorb(Encoder* other); //take over other's coffers, appended in order
 
         //Compression 
         void serializeTemplate(string zip_out, LengthParser* parser); 
-        void serializeTemplateOutlier(char** failed_log, int failLine);
+        void serializeTemplateOutlier(const FailedLines& failed);
         
         void serializeVar(string filename,char* globuf, VarArray* varMapping, int maxLen);
         void serializeEntry(string filename, int * entry, int maxEntry, int total);
         void serializeDic(string varName, char* globuf, VarArray* varMapping, Union* root); //Compress each dictioanry
         void serializeSvar(string filename, SubPattern* pit); //Compress subvariable
-        void serializeOutlier(string filename, vector<pair<int, string> >outliers);
+        void serializeOutlier(string filename, const vector<pair<int, StrView> >& outliers);
+        void serializeSketch(string filename, const uint8_t* reg, int rows); //HLL_M registers of the column named filename
         
         void serializeSubpattern(string zip_path, string SUBPATTERN, int SUBCOUNT);
 
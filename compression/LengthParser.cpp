@@ -5,6 +5,8 @@
 #include<cstring>
 #include<cstdio>
 #include<map>
+#include<set>
+#include<cstdlib>
 using namespace std;
 static unsigned int stable_id_from_string(const std::string& s){
     unsigned int hash = 2166136261u;
@@ -18,6 +20,7 @@ static unsigned int stable_id_from_string(const std::string& s){
 }
 LengthParser::LengthParser(double _threashold) {
     now_eid = 1;
+    sealed_eid = 0;
     delim = " \t:=,";
     delimCount = 5;
     DELIM = (char**)malloc(sizeof(char*) * 128);
@@ -30,6 +33,14 @@ LengthParser::LengthParser(double _threashold) {
     LengthTemplatePool.clear();
 }
 LengthParser::~LengthParser(){
+    ClearIndex();
+    for(auto &pool: LengthTemplatePool){
+        for(auto &temp: *pool.second){
+            delete temp;
+        }
+        delete pool.second;
+    }
+    LengthTemplatePool.clear();
     for (int i = 0; i < 128; i++){
         free(DELIM[i]);
     }
@@ -59,8 +70,97 @@ int LengthParser::STCTC(double sampleRate){
     return max_time;
 }
 
+static unsigned long long tokenHash(unsigned long long hash, const char* s, int len){
+    for(int i = 0; i < len; i++){
+        hash ^= (unsigned char)s[i];
+        hash *= 1099511628211ull;
+    }
+    hash ^= 0xff;
+    hash *= 1099511628211ull;
+    return hash;
+}
+
+void LengthParser::ClearIndex(){
+    for(auto &idx: TemplateIndex){
+        delete idx.second;
+    }
+    TemplateIndex.clear();
+}
+
+//Templates are frozen after sampling, index every length pool so that a line
+//only runs matchMatch on templates whose leading constant tokens equal its own
+void LengthParser::BuildIndex(){
+    ClearIndex();
+    for(auto &pool: LengthTemplatePool){
+        PoolIndex* index = new PoolIndex();
+        vector<templateNode*>* nowPool = pool.second;
+        for(int t = 0; t < (int)nowPool->size(); t++){
+            templateNode* temp = (*nowPool)[t];
+            index->sids.push_back(stable_id_from_string(temp->output()));
+            int pos[KEY_TOKENS]; int n = 0;
+            for(int i = 0; i < temp->length && n < KEY_TOKENS; i++){
+                if(temp->templatesTags[i] == 0) pos[n++] = i;
+            }
+            if(n == 0){
+                index->wildcard.push_back(t);
+                continue;
+            }
+            KeyGroup* group = NULL;
+            for(auto &g: index->groups){
+                if(g->n == n && equal(pos, pos + n, g->pos)){
+                    group = g;
+                    break;
+                }
+            }
+            if(group == NULL){
+                group = new KeyGroup();
+                group->n = n;
+                for(int i = 0; i < n; i++) group->pos[i] = pos[i];
+                index->groups.push_back(group);
+            }
+            unsigned long long hash = 14695981039346656037ull;
+            for(int i = 0; i < n; i++){
+                hash = tokenHash(hash, temp->templates[pos[i]], temp->templatesLen[pos[i]]);
+            }
+            group->bucket[hash].push_back(t);
+        }
+        TemplateIndex[pool.first] = index;
+    }
+}
+
+//templates that already matched lines keep their shape, a second mining pass only adds new ones
+void LengthParser::Seal(){
+    sealed_eid = now_eid;
+}
+
+//mined templates seen less than minHits times, or sharing a stable id with a sealed one, are dropped
+int LengthParser::DropUnsealed(int minHits, const set<unsigned int>& usedSids){
+    int dropped = 0;
+    for(auto &pool: LengthTemplatePool){
+        vector<templateNode*>* nowPool = pool.second;
+        vector<templateNode*> kept;
+        for(auto &temp: *nowPool){
+            if(temp->Eid >= sealed_eid){
+                map<int, int>::iterator sit = STC.find(temp->Eid);
+                int hits = (sit == STC.end()) ? 0 : sit->second;
+                if(hits < minHits || usedSids.count(stable_id_from_string(temp->output()))){
+                    STC.erase(temp->Eid);
+                    delete temp;
+                    dropped++;
+                    continue;
+                }
+            }
+            kept.push_back(temp);
+        }
+        nowPool->swap(kept);
+    }
+    if(dropped > 0) ClearIndex();
+    return dropped;
+}
+
 int LengthParser::parseTemplate(char * logs, SegTag segArray[MAXTOCKEN], int token_size){
     //cout << sample << endl;
+    if(!TemplateIndex.empty()) ClearIndex();
     bool merged = false;
     int hitEid = -1;
     if (LengthTemplatePool.find(token_size) == LengthTemplatePool.end()){ //Without this length
@@ -76,6 +176,15 @@ int LengthParser::parseTemplate(char * logs, SegTag segArray[MAXTOCKEN], int tok
     }
     vector<templateNode*>* nowPool = LengthTemplatePool[token_size];
     for(auto &temp:*nowPool){
+        if(temp ->frozen || temp ->Eid < sealed_eid){ //merging would change the stable id of a library or already matched template
+            if(temp ->matchMatch(logs, segArray, token_size, headLength) != -1){
+                merged = true;
+                hitEid = temp->Eid;
+                STC[hitEid]++;
+                break;
+            }
+            continue;
+        }
         double similarity = temp ->parseMatch(logs, segArray, token_size);
         
         //SysDebug("Similarity %f on template %d\n", similarity, temp ->Eid);
@@ -100,39 +209,95 @@ int LengthParser::parseTemplate(char * logs, SegTag segArray[MAXTOCKEN], int tok
 
 
 int LengthParser::SearchTemplate(char* logs, SegTag segArray[MAXTOCKEN], int tocken_size, map<int, VarArray*>& varMapping, bool extract){
-    if (LengthTemplatePool.find(tocken_size) == LengthTemplatePool.end()){ //Without this length match failed
+    return SearchTemplate(logs, segArray, tocken_size, varMapping, extract, TC);
+}
+
+int LengthParser::SearchTemplate(char* logs, SegTag segArray[MAXTOCKEN], int tocken_size, map<int, VarArray*>& varMapping, bool extract, map<int, int>& counter){
+    map<int, std::vector<templateNode*>* >::iterator pit = LengthTemplatePool.find(tocken_size);
+    if (pit == LengthTemplatePool.end()){ //Without this length match failed
         //SysDebug("No length\n");
         return -1;
     }
-    vector<templateNode*>* nowPool = LengthTemplatePool[tocken_size];
-    for(auto &temp:*nowPool){
-        if (temp ->matchMatch(logs, segArray, tocken_size, headLength) != -1)
-        { //matched
-            if (TC.find(temp ->Eid) != TC.end()){
-                TC[temp->Eid]++;
-            }else{
-                TC.insert(pair<int, int>(temp->Eid, 1));
+    vector<templateNode*>* nowPool = pit->second;
+    map<int, PoolIndex*>::iterator iit = TemplateIndex.find(tocken_size);
+    PoolIndex* index = (iit == TemplateIndex.end()) ? NULL : iit->second;
+    if(index == NULL || index->groups.size() >= MAXTEMPLATE){
+        for(auto &temp:*nowPool){
+            if (temp ->matchMatch(logs, segArray, tocken_size, headLength) != -1){
+                return hitTemplate(temp, stable_id_from_string(temp->output()), segArray, varMapping, extract, counter);
             }
-            if (!extract){
-                return temp ->Eid;
-            }else{
-                int totVar = temp -> varLength;
-                int now_eid = temp -> Eid;
-                unsigned int sid = stable_id_from_string(temp->output());
-                for (int i = 0; i < totVar; i++){
-                    int nowName = (sid<<POS_TEMPLATE) | (i<<POS_VAR);
-                    if(varMapping.find(nowName) == varMapping.end() || varMapping[nowName] == NULL){
-                        varMapping[nowName] = new VarArray(nowName, 64);
-                    }
-                    varMapping[nowName]->Add(segArray[temp->varIndex[i]].startPos, segArray[temp->varIndex[i]].segLen);
-                }
-                return temp->Eid;
-            }  
+        }
+        return -1;
+    }
+    //collect the candidate lists, each one is ascending in pool order
+    const vector<int>* lists[MAXTEMPLATE];
+    int cursor[MAXTEMPLATE];
+    int listCnt = 0;
+    if(!index->wildcard.empty()){
+        lists[listCnt++] = &index->wildcard;
+    }
+    for(auto &g: index->groups){
+        unsigned long long hash = 14695981039346656037ull;
+        bool valid = true;
+        for(int i = 0; i < g->n; i++){
+            SegTag& seg = segArray[g->pos[i]];
+            if(seg.tag != 0){
+                valid = false;
+                break;
+            }
+            hash = tokenHash(hash, logs + seg.startPos, seg.segLen);
+        }
+        if(!valid) continue;
+        unordered_map<unsigned long long, vector<int> >::iterator bit = g->bucket.find(hash);
+        if(bit != g->bucket.end()){
+            lists[listCnt++] = &bit->second;
+        }
+    }
+    for(int i = 0; i < listCnt; i++) cursor[i] = 0;
+    //try the candidates in pool order, so the first hit is the same as the full scan
+    while(true){
+        int minT = -1;
+        for(int i = 0; i < listCnt; i++){
+            if(cursor[i] < (int)lists[i]->size()){
+                int t = (*lists[i])[cursor[i]];
+                if(minT == -1 || t < minT) minT = t;
+            }
+        }
+        if(minT == -1) break;
+        for(int i = 0; i < listCnt; i++){
+            if(cursor[i] < (int)lists[i]->size() && (*lists[i])[cursor[i]] == minT) cursor[i]++;
+        }
+        templateNode* temp = (*nowPool)[minT];
+        if (temp ->matchMatch(logs, segArray, tocken_size, headLength) != -1){
+            return hitTemplate(temp, index->sids[minT], segArray, varMapping, extract, counter);
         }
     }
     return -1;
 }
 
+//count the hit and record the variables of the matched line
+int LengthParser::hitTemplate(templateNode* temp, unsigned int sid, SegTag segArray[MAXTOCKEN], map<int, VarArray*>& varMapping, bool extract, map<int, int>& counter){
+    if (counter.find(temp ->Eid) != counter.end()){
+        counter[temp->Eid]++;
+    }else{
+        counter.insert(pair<int, int>(temp->Eid, 1));
+    }
+    if (!extract){
+        return temp ->Eid;
+    }
+    int totVar = temp -> varLength;
+    for (int i = 0; i < totVar; i++){
+        int nowName = (sid<<POS_TEMPLATE) | (i<<POS_VAR);
+        map<int, VarArray*>::iterator vit = varMapping.find(nowName);
+        if(vit == varMapping.end() || vit->second == NULL){
+            varMapping[nowName] = new VarArray(nowName, 64);
+            vit = varMapping.find(nowName);
+        }
+        vit->second->Add(segArray[temp->varIndex[i]].startPos, segArray[temp->varIndex[i]].segLen);
+    }
+    return temp->Eid;
+}
+
 void LengthParser::TemplatePrint(){
     for(std::map<int, vector<templateNode*>* >::iterator it = LengthTemplatePool.begin(); it != LengthTemplatePool.end(); it++){
         cout << "Template with length: " << it ->first << endl;
@@ -195,3 +360,115 @@ void LengthParser::TemplateOutput(string input_path){
     }
     fclose(fo);
 }
+
+//one template per line: length varLength varIndex... then tag:len:token for every token
+static templateNode* readLibraryTemplate(const char* p, const char* end, int eid){
+    char* q;
+    int length = strtol(p, &q, 10);
+    int varLength = strtol(q, &q, 10);
+    if(length <= 0 || length > MAXTOCKEN * 100 || varLength < 0 || varLength > length) return NULL;
+    vector<int> varIndex(varLength);
+    for(int i = 0; i < varLength; i++){
+        varIndex[i] = strtol(q, &q, 10);
+        if(varIndex[i] < 0 || varIndex[i] >= length) return NULL;
+    }
+    string text;
+    vector<SegTag> segs(length);
+    p = q;
+    for(int i = 0; i < length; i++){
+        if(p >= end || *p != ' ') return NULL;
+        segs[i].tag = strtol(p + 1, &q, 10);
+        if(*q != ':') return NULL;
+        segs[i].segLen = strtol(q + 1, &q, 10);
+        if(*q != ':' || segs[i].segLen < 0 || q + 1 + segs[i].segLen > end) return NULL;
+        segs[i].startPos = text.size();
+        text.append(q + 1, segs[i].segLen);
+        p = q + 1 + segs[i].segLen;
+    }
+    if(p != end) return NULL;
+    text.push_back('\0');
+    templateNode* temp = new templateNode(eid, &text[0], &segs[0], length);
+    temp->varLength = varLength;
+    temp->varIndex = varIndex;
+    temp->frozen = true;
+    return temp;
+}
+
+//seed the pools with the library, its templates come first in every pool in file order
+int LengthParser::LoadTemplateLibrary(string lib_path){
+    FILE* fl = fopen(lib_path.c_str(), "rb");
+    if(fl == NULL) return 0;//first flush of this index
+    string content;
+    char buf[8192];
+    size_t r;
+    while((r = fread(buf, 1, sizeof(buf), fl)) > 0) content.append(buf, r);
+    fclose(fl);
+    size_t pos = content.find('\n');
+    if(pos == string::npos || content.compare(0, pos, TEMPLATE_LIB_HEAD) != 0){
+        SysWarning("template library %s has no valid header, ignored\n", lib_path.c_str());
+        return 0;
+    }
+    int count = 0;
+    for(pos++; pos < content.size(); ){
+        size_t end = content.find('\n', pos);
+        if(end == string::npos) end = content.size();
+        templateNode* temp = readLibraryTemplate(content.c_str() + pos, content.c_str() + end, now_eid);
+        if(temp == NULL){
+            SysWarning("template library %s: bad line at offset %zu, stop loading\n", lib_path.c_str(), pos);
+            break;
+        }
+        now_eid++;
+        if(LengthTemplatePool.find(temp->length) == LengthTemplatePool.end()){
+            LengthTemplatePool[temp->length] = new vector<templateNode*>;
+        }
+        LengthTemplatePool[temp->length]->push_back(temp);
+        count++;
+        pos = end + 1;
+    }
+    return count;
+}
+
+//library templates keep their order, templates matched in this flush are appended
+//up to LOGGREP_TEMPLATE_LIB_MAX, written to a temp file and renamed over the old library
+int LengthParser::SaveTemplateLibrary(string lib_path){
+    int maxTemplates = TEMPLATE_LIB_MAX;
+    const char* mv = getenv("LOGGREP_TEMPLATE_LIB_MAX");
+    if(mv){ int x = atoi(mv); if(x > 0) maxTemplates = x; }
+    string output = string(TEMPLATE_LIB_HEAD) + "\n";
+    set<string> seen;
+    int count = 0;
+    for(int pass = 0; pass < 2; pass++){
+        for(auto &pool: LengthTemplatePool){
+            for(auto &temp: *pool.second){
+                if(temp->frozen != (pass == 0)) continue;
+                if(!temp->frozen){
+                    map<int, int>::iterator tit = TC.find(temp->Eid);
+                    if(tit == TC.end() || tit->second == 0 || count >= maxTemplates) continue;
+                }
+                if(!seen.insert(temp->output()).second) continue;
+                output += to_string(temp->length) + " " + to_string(temp->varLength);
+                for(int i = 0; i < temp->varLength; i++) output += " " + to_string(temp->varIndex[i]);
+                for(int i = 0; i < temp->length; i++){
+                    output += " " + to_string(temp->templatesTags[i]) + ":" + to_string(temp->templatesLen[i]) + ":";
+                    output.append(temp->templates[i], temp->templatesLen[i]);
+                }
+                output += "\n";
+                count++;
+            }
+        }
+    }
+    string tmp_path = lib_path + ".tmp";
+    FILE* fo = fopen(tmp_path.c_str(), "wb");
+    if(fo == NULL){
+        SysWarning("template library %s: open failed\n", tmp_path.c_str());
+        return -1;
+    }
+    size_t w = fwrite(output.c_str(), 1, output.size(), fo);
+    fclose(fo);
+    if(w != output.size() || rename(tmp_path.c_str(), lib_path.c_str()) != 0){
+        SysWarning("template library %s: write failed\n", lib_path.c_str());
+        remove(tmp_path.c_str());
+        return -1;
+    }
+    return count;
+}
@@ -3,6 +3,7 @@
 #include <string>
 #include <unordered_map>
 #include <map>
+#include <set>
 #include <vector>
 #include <bitset>
 #include <iostream>
@@ -10,27 +11,63 @@
 #include "template.h"
 using namespace std;
 
+//candidate index of one length pool, templates are grouped by the positions
+//of their first KEY_TOKENS constant tokens and bucketed by the hash of those tokens
+#define KEY_TOKENS 2
+
+//per-index template library, reloaded before every flush so template ids stay stable across segments
+#define TEMPLATE_LIB_HEAD "#LogGrep template library v1"
+#define TEMPLATE_LIB_MAX 4096
+typedef struct KeyGroup
+{
+    int pos[KEY_TOKENS];
+    int n;
+    unordered_map<unsigned long long, vector<int> > bucket;//template idx in pool order
+}KeyGroup;
+
+typedef struct PoolIndex
+{
+    vector<KeyGroup*> groups;
+    vector<int> wildcard;//templates without constant token
+    vector<unsigned int> sids;//stable id of each template output
+    ~PoolIndex()
+    {
+        for(auto &g: groups) delete g;
+    }
+}PoolIndex;
+
 class LengthParser {
 private:
     const char* delim; //Fix delimer
     int delimCount;
     char** DELIM; //Used for different delimer
     int now_eid;
+    int sealed_eid; //templates below this eid only take exact hits in parseTemplate
     double threashold;
     int headLength;
+    int hitTemplate(templateNode* temp, unsigned int sid, SegTag segArray[MAXTOCKEN], map<int, VarArray*>& variables, bool extract, map<int, int>& counter);
 public:
     map<int, std::vector<templateNode*>* > LengthTemplatePool;
     map<int, int> TC; //template counter
     map<int, int> STC; //sample tempalte counter
+    map<int, PoolIndex*> TemplateIndex; //built by BuildIndex after sampling
 
     LengthParser(double _threashold);
     ~LengthParser();
     int addTemplate(vector<string> tokens, int length);                 // the function of adding a template
     int parseTemplate(char* log, SegTag segArray[MAXTOCKEN], int token_size);
+    void BuildIndex();
+    void ClearIndex();
+    void Seal();
+    int DropUnsealed(int minHits, const set<unsigned int>& usedSids);
     int SearchTemplate(char* logs, SegTag segArray[MAXTOCKEN], int segSize, map<int, VarArray*>& variables, bool extract);
+    //thread-safe version: only reads the template pool, counts hits into counter
+    int SearchTemplate(char* logs, SegTag segArray[MAXTOCKEN], int segSize, map<int, VarArray*>& variables, bool extract, map<int, int>& counter);
     
     void TemplateOutput(string intpu_path);
     int getTemplate(char** longStr);
+    int LoadTemplateLibrary(string lib_path);
+    int SaveTemplateLibrary(string lib_path);
     void counterReset();
     void TemplatePrint();
     int STCTC(double sampleRate);
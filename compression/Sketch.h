@@ -0,0 +1,94 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <string>
+#include <cstring>
+#include <cmath>
+#include <stdint.h>
+
+// HyperLogLog registers shared by the compressor (per column sketch capsules) and the query side (HLL.h),
+// both hash the unpadded value with FNV-1a 64 (finalized by sketch_mix64) so a stored sketch merges with one
+// built at query time.
+// Capsule layout: 1 << HLL_P rank bytes when dense, else sorted (uint16 index, uint8 rank) triples;
+// 4096 is no multiple of 3, so the length tells the two apart.
+#define HLL_P 12
+#define HLL_M (1 << HLL_P)
+#define HLL_MIN_ROWS 10000 //columns shorter than this are cheap to rescan and get no sketch capsule
+
+static inline uint64_t sketch_hash64(const char* data, size_t len){
+    uint64_t h = 1469598103934665603ULL;
+    for(size_t i = 0; i < len; i++){ h ^= (uint8_t)data[i]; h *= 1099511628211ULL; }
+    return h;
+}
+
+//FNV-1a barely moves its top bits when only the last bytes differ (user1, user2...), and the register
+//index comes from the top bits: finalize it first (splitmix64)
+static inline uint64_t sketch_mix64(uint64_t x){
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static inline void hll_add(uint8_t* reg, int p, const char* data, size_t len){
+    uint64_t h = sketch_mix64(sketch_hash64(data, len));
+    uint32_t idx = (uint32_t)(h >> (64 - p));
+    uint64_t w = (h << p) | (1ULL << (p - 1));
+    int r = __builtin_clzll(w) + 1;
+    if(reg[idx] < (uint8_t)r) reg[idx] = (uint8_t)r;
+}
+
+static inline double hll_estimate(const uint8_t* reg, int p){
+    uint32_t m = 1u << p;
+    double invSum = 0.0;
+    int V = 0;
+    for(uint32_t i = 0; i < m; i++){
+        invSum += std::ldexp(1.0, -(int)reg[i]);
+        if(reg[i] == 0) V++;
+    }
+    double alpha;
+    if(m == 16) alpha = 0.673;
+    else if(m == 32) alpha = 0.697;
+    else if(m == 64) alpha = 0.709;
+    else alpha = 0.7213 / (1.0 + 1.079 / m);
+    double E = alpha * m * m / invSum;
+    if(V > 0){
+        double EC = m * std::log((double)m / V);
+        if(EC <= 2.5 * m) return EC;
+    }
+    return E;
+}
+
+static inline void hll_pack(const uint8_t* reg, std::string& out){
+    int nnz = 0;
+    for(int i = 0; i < HLL_M; i++) if(reg[i]) nnz++;
+    if(nnz * 3 >= HLL_M){
+        out.assign((const char*)reg, HLL_M);
+        return;
+    }
+    out.clear();
+    out.reserve(nnz * 3);
+    for(int i = 0; i < HLL_M; i++){
+        if(!reg[i]) continue;
+        out += (char)(i & 0xFF);
+        out += (char)(i >> 8);
+        out += (char)reg[i];
+    }
+}
+
+//max-merges a packed sketch into reg, false on a malformed capsule
+static inline bool hll_unpack_merge(const char* in, int len, uint8_t* reg){
+    const uint8_t* p = (const uint8_t*)in;
+    if(len == HLL_M){
+        for(int i = 0; i < HLL_M; i++) if(reg[i] < p[i]) reg[i] = p[i];
+        return true;
+    }
+    if(len < 0 || len % 3 != 0) return false;
+    for(int k = 0; k < len; k += 3){
+        int idx = p[k] | (p[k + 1] << 8);
+        if(idx >= HLL_M) return false;
+        if(reg[idx] < p[k + 2]) reg[idx] = p[k + 2];
+    }
+    return true;
+}
+
+#endif
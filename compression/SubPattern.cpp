@@ -5,11 +5,11 @@
 #include "union.h"
 #include "util.h"
 using namespace std;
-SubPattern::SubPattern(Union* now, string _nextConstant, int maxData){
+SubPattern::SubPattern(Union* now, string _nextConstant, int maxData, Arena* arena){
         type = now ->type;
         dataType = 0;
         data_count = 0;
-        data = new string[maxData];
+        data = arena -> allocArray<StrView>(maxData);
         maxLen = -1;
         length = (type == 2) ? -1 : now ->length;
         hex = now ->hex;
@@ -20,17 +20,18 @@ SubPattern::SubPattern(Union* now, string _nextConstant, int maxData){
             nextConstant = _nextConstant;
         }
 }
+SubPattern::~SubPattern(){
+}
 void SubPattern::add(bool success){
     if(type == 0) return;
     if(success){
         data[data_count++] = readyAdd;
     }else{
-        data[data_count++] = "";
+        data[data_count].ptr = NULL;
+        data[data_count++].len = 0;
     }
 }
-bool SubPattern::extract(string log, int & strIdx, bool & jump){
-        set<int> now_outlier;
-        int lSize = log.size();
+bool SubPattern::extract(const char* log, int lSize, int & strIdx, bool & jump){
         if (type == 0){ //Constant check
             for(int w = 0; w < length; w++){
                 if (strIdx + w >= lSize || const_pattern[w] != log[strIdx + w]){
@@ -46,9 +47,9 @@ bool SubPattern::extract(string log, int & strIdx, bool & jump){
 //                cout << "strIdx: " << strIdx << " length: " << length << " type: " << Union::getType(log[strIdx]) << endl; 
                 return false;
             }
-            string temp = log.substr(strIdx, length);
-            dataType |= getType(temp.c_str(), temp.size());
-            readyAdd = temp;
+            dataType |= getType(log + strIdx, length);
+            readyAdd.ptr = log + strIdx;
+            readyAdd.len = length;
             //data[data_count++] = temp;
             strIdx += length;
         }
@@ -56,26 +57,23 @@ bool SubPattern::extract(string log, int & strIdx, bool & jump){
             if(strIdx >= lSize) return false;
             int L = 0;
             
-            while(strIdx + L + nextConstant.size() < log.size()){
+            int nSize = nextConstant.size();
+            while(strIdx + L + nSize < lSize){
                 bool match = true;     
-                int nSize = nextConstant.size();
                 for(int i = 0; i < nSize; i++){
                     if(log[strIdx + L + i] != nextConstant[i]){
                         match = false;
                         break;
                     }
                 }
-                if(nextConstant.size() > 0 && match) break;
+                if(nSize > 0 && match) break;
                 L++;
             }
             if (strIdx + L > lSize) return false;
             if(L > maxLen) maxLen = L;
-            string temp = log.substr(strIdx, L);
-            //cout << "nextConst: " << nextConstant << " temp: " << temp << " strIdx: " << strIdx << " L: " << L << endl;
-
-            dataType |= getType(temp.c_str(), temp.size());
-            //data[data_count++] = temp;
-            readyAdd = temp;
+            dataType |= getType(log + strIdx, L);
+            readyAdd.ptr = log + strIdx;
+            readyAdd.len = L;
             strIdx += L;
         }
         return true;
@@ -105,7 +103,7 @@ bool SubPattern::output_var(string path){
         FILE* fow = fopen(path.c_str(), "w");
         if(fow == NULL) return false;
         for(int i = 0; i < data_count; i++){
-            fprintf(fow, "%s\n", data[i].c_str());
+            fprintf(fow, "%.*s\n", data[i].len, data[i].ptr ? data[i].ptr : "");
         }
         fclose(fow);
         return true;
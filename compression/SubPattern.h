@@ -3,17 +3,18 @@
 
 #include "constant.h"
 #include "union.h"
+#include "Arena.h"
 
 using namespace std;
 
 class SubPattern{
 public:
-    string * data;
+    StrView * data; //values stay in the segment buffer, the array lives in the arena
     int data_count;
 
     string const_pattern;
     string nextConstant;
-    string readyAdd;
+    StrView readyAdd;
 
     int type; //0 for constant, 1 for fixed length, 2 for others
     int dataType;
@@ -23,9 +24,10 @@ public:
     int hex;
     int maxLen;
 
-    SubPattern(Union* now, string nextConstant, int maxData);
+    SubPattern(Union* now, string nextConstant, int maxData, Arena* arena);
+    ~SubPattern();
     
-    bool extract(string log, int & strIdx, bool & jump);
+    bool extract(const char* log, int lSize, int & strIdx, bool & jump);
     void add(bool success);
 
     void output();
@@ -0,0 +1,122 @@
+#ifndef TIMECOLUMN_H
+#define TIMECOLUMN_H
+
+#include <vector>
+#include <string>
+#include <cstring>
+
+// Binary time column (coffer eleLen == TIME_COL_BINARY):
+//   int rowCount, int blockRows, int blockCount
+//   TimeBlock[blockCount]            per-block min/max, byte offset of its data, rows
+//   per block: zigzag varint of the first value, of the first delta, then of every delta-of-delta
+// Blocks are independent so a reader can skip the ones outside a time range.
+#define TIME_COL_BINARY     -5
+#define TIME_COL_BLOCK_ROWS 4096
+
+typedef struct TimeBlock
+{
+    long long tmin;
+    long long tmax;
+    int offset; //from the start of the varint area
+    int rows;
+}TimeBlock;
+
+static inline void time_put_varint(std::string& out, long long v){
+    unsigned long long z = ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+    while(z >= 0x80){
+        out.push_back((char)((z & 0x7F) | 0x80));
+        z >>= 7;
+    }
+    out.push_back((char)z);
+}
+
+static inline bool time_get_varint(const unsigned char*& p, const unsigned char* end, long long& v){
+    unsigned long long z = 0;
+    int shift = 0;
+    while(p < end && shift < 64){
+        unsigned char b = *p++;
+        z |= (unsigned long long)(b & 0x7F) << shift;
+        if(!(b & 0x80)){
+            v = (long long)(z >> 1) ^ -(long long)(z & 1);
+            return true;
+        }
+        shift += 7;
+    }
+    return false;
+}
+
+static inline std::string encode_time_column(const std::vector<long long>& times){
+    int rows = (int)times.size();
+    int blockRows = TIME_COL_BLOCK_ROWS;
+    int blockCount = (rows + blockRows - 1) / blockRows;
+    std::vector<TimeBlock> blocks(blockCount);
+    std::string body;
+    body.reserve(rows * 2);
+    for(int b = 0; b < blockCount; b++){
+        int s = b * blockRows;
+        int e = (s + blockRows < rows) ? s + blockRows : rows;
+        TimeBlock& blk = blocks[b];
+        blk.offset = (int)body.size();
+        blk.rows = e - s;
+        blk.tmin = times[s];
+        blk.tmax = times[s];
+        long long prev = 0, prevDelta = 0;
+        for(int i = s; i < e; i++){
+            long long v = times[i];
+            if(v < blk.tmin) blk.tmin = v;
+            if(v > blk.tmax) blk.tmax = v;
+            if(i == s){
+                time_put_varint(body, v);
+            }else{
+                long long delta = v - prev;
+                time_put_varint(body, (i == s + 1) ? delta : delta - prevDelta);
+                prevDelta = delta;
+            }
+            prev = v;
+        }
+    }
+    std::string out;
+    out.reserve(3 * sizeof(int) + blockCount * sizeof(TimeBlock) + body.size());
+    out.append((const char*)&rows, sizeof(int));
+    out.append((const char*)&blockRows, sizeof(int));
+    out.append((const char*)&blockCount, sizeof(int));
+    if(blockCount > 0) out.append((const char*)&blocks[0], blockCount * sizeof(TimeBlock));
+    out.append(body);
+    return out;
+}
+
+// Decode into values (appended in row order), block ranges go to blocks if not NULL.
+// Returns the number of rows, -1 on a corrupt column.
+static inline int decode_time_column(const char* data, int len, std::vector<long long>& values, std::vector<TimeBlock>* blocks){
+    int rows, blockRows, blockCount;
+    int head = 3 * sizeof(int);
+    if(data == NULL || len < head) return -1;
+    memcpy(&rows, data, sizeof(int));
+    memcpy(&blockRows, data + sizeof(int), sizeof(int));
+    memcpy(&blockCount, data + 2 * sizeof(int), sizeof(int));
+    if(rows < 0 || blockCount < 0 || head + (long long)blockCount * (long long)sizeof(TimeBlock) > (long long)len) return -1;
+    std::vector<TimeBlock> dir(blockCount);
+    if(blockCount > 0) memcpy(&dir[0], data + head, blockCount * sizeof(TimeBlock));
+    const unsigned char* body = (const unsigned char*)data + head + blockCount * sizeof(TimeBlock);
+    const unsigned char* end = (const unsigned char*)data + len;
+    values.reserve(values.size() + rows);
+    for(int b = 0; b < blockCount; b++){
+        if(dir[b].offset < 0 || dir[b].offset > end - body) return -1;
+        const unsigned char* p = body + dir[b].offset;
+        long long prev = 0, prevDelta = 0, x = 0;
+        for(int i = 0; i < dir[b].rows; i++){
+            if(!time_get_varint(p, end, x)) return -1;
+            if(i == 0){
+                prev = x;
+            }else{
+                prevDelta = (i == 1) ? x : prevDelta + x;
+                prev += prevDelta;
+            }
+            values.push_back(prev);
+        }
+    }
+    if(blocks) blocks->swap(dir);
+    return rows;
+}
+
+#endif
@@ -1,7 +1,9 @@
 #include "TimeParser.h"
 #include <cstring>
 #include <cstdio>
+#include <cctype>
 #include <ctime>
+#include <strings.h>
 
 static inline long long to_epoch_ms(struct tm& tmv, int millis, bool has_tz, int tz_offset_minutes)
 {
@@ -34,12 +36,13 @@ static inline long long to_epoch_ms(struct tm& tmv, int millis, bool has_tz, int
 }
 
 // minimal strptime wrapper: returns true if parsed, and sets tz offset minutes if present in %z
-static bool strptime_parse(const char* s, const char* fmt, struct tm& tmv, int& millis, bool& has_tz, int& tz_offset_minutes)
+static bool strptime_parse(const char* s, const char* fmt, struct tm& tmv, int& millis, bool& has_tz, int& tz_offset_minutes, int& consumed)
 {
     millis = 0; has_tz = false; tz_offset_minutes = 0;
     memset(&tmv, 0, sizeof(tmv));
     const char* end = strptime(s, fmt, &tmv);
     if(!end) return false;
+    consumed = (int)(end - s);
     // fractional milliseconds: detect ",SSS" or ".SSS" immediately after seconds
     if(*end == ',' || *end == '.') {
         int m = 0, count = 0; end++;
@@ -65,44 +68,53 @@ static bool strptime_parse(const char* s, const char* fmt, struct tm& tmv, int&
     return true;
 }
 
-bool parse_timestamp_ms(const char* s, int len, long long& out_ms)
+// Try formats (order roughly common-first)
+static const char* fmts[] = {
+    "%Y-%m-%d %H:%M:%S", // baseline
+    "%Y-%m-%d %H:%M:%S %z",
+    "%Y-%m-%d %H:%M:%S%z",
+    "%Y-%m-%d %H:%M:%S", // with fractional handled
+    "%Y-%m-%d %H:%M:%S",
+    "%Y/%m/%d %H:%M:%S",
+    "%y-%m-%d %H:%M:%S",
+    "%y-%m-%d %H:%M:%S",
+    "%y/%m/%d %H:%M:%S",
+    "%b %d %Y %H:%M:%S",
+    "%b %d %H:%M:%S %Y",
+    "%b %d, %Y %I:%M:%S %p",
+    "%m/%d/%Y %I:%M:%S %p",
+    "%m/%d/%Y %I:%M:%S %p",
+    "%d/%b/%Y:%H:%M:%S %z",
+    "%d/%b/%Y %H:%M:%S",
+};
+
+// buf is NUL terminated, fmt/consumed tell which format accepted it and how far strptime read
+static bool parse_generic(const char* buf, long long& out_ms, int& fmt, int& consumed)
 {
-    // Copy into buffer for strptime
-    char buf[1024];
-    int n = len > 1023 ? 1023 : len;
-    memcpy(buf, s, n); buf[n] = '\0';
     struct tm tmv; int millis=0; bool has_tz=false; int tz_offset=0;
-    // Try formats (order roughly common-first)
-    const char* fmts[] = {
-        "%Y-%m-%d %H:%M:%S", // baseline
-        "%Y-%m-%d %H:%M:%S %z",
-        "%Y-%m-%d %H:%M:%S%z",
-        "%Y-%m-%d %H:%M:%S", // with fractional handled
-        "%Y-%m-%d %H:%M:%S",
-        "%Y/%m/%d %H:%M:%S",
-        "%y-%m-%d %H:%M:%S",
-        "%y-%m-%d %H:%M:%S",
-        "%y/%m/%d %H:%M:%S",
-        "%b %d %Y %H:%M:%S",
-        "%b %d %H:%M:%S %Y",
-        "%b %d, %Y %I:%M:%S %p",
-        "%m/%d/%Y %I:%M:%S %p",
-        "%m/%d/%Y %I:%M:%S %p",
-        "%d/%b/%Y:%H:%M:%S %z",
-        "%d/%b/%Y %H:%M:%S",
-    };
     size_t fmt_count = sizeof(fmts)/sizeof(fmts[0]);
     for(size_t i=0;i<fmt_count;i++){
-        if(strptime_parse(buf, fmts[i], tmv, millis, has_tz, tz_offset)){
+        if(strptime_parse(buf, fmts[i], tmv, millis, has_tz, tz_offset, consumed)){
             long long v = to_epoch_ms(tmv, millis, has_tz, tz_offset);
             if(v < 0) continue; // try next format
             out_ms = v;
+            fmt = (int)i;
             return true;
         }
     }
     return false;
 }
 
+bool parse_timestamp_ms(const char* s, int len, long long& out_ms)
+{
+    // Copy into buffer for strptime
+    char buf[1024];
+    int n = len > 1023 ? 1023 : len;
+    memcpy(buf, s, n); buf[n] = '\0';
+    int fmt, consumed;
+    return parse_generic(buf, out_ms, fmt, consumed);
+}
+
 std::pair<int,int> detect_timestamp_span(const char* s, int len)
 {
     // Heuristics: search for digit-heavy span containing ':' and space or '/' or '-'
@@ -122,4 +134,219 @@ std::pair<int,int> detect_timestamp_span(const char* s, int len)
         }
     }
     return {best_start, best_len};
-}
\ No newline at end of file
+}
+
+// ---- per segment layout cache ----
+
+static const char* month_full[12] = {"January", "February", "March", "April", "May", "June",
+    "July", "August", "September", "October", "November", "December"};
+static const char* month_abbr[12] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+// field ranges checked by strptime, a value outside makes the format fail
+static const int field_lo[6] = {0, 1, 1, 0, 0, 0};
+static const int field_hi[6] = {9999, 12, 31, 23, 59, 61};
+
+static inline bool is_digit(char c){ return c >= '0' && c <= '9'; }
+
+// days since 1970-01-01 of a proleptic gregorian date, month 1..12, day may overflow like timegm
+static long long days_from_civil(long long y, int m, int d)
+{
+    y -= m <= 2;
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    long long yoe = y - era * 400;
+    long long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+TimestampCache::TimestampCache()
+{
+    last = 0;
+    attempts = 0;
+    keyYear = keyMon = keyMday = keyHour = keyMin = -1;
+    keyBase = 0;
+}
+
+// walk the format like strptime does and record where every field sits in buf,
+// kept only if the layout decodes buf to the same fields and end strptime gave
+void TimestampCache::learn(const char* buf, int fmt, int consumed)
+{
+    if(consumed <= 0 || consumed > TIME_SHAPE_MAX || (int)layouts.size() >= TIME_LAYOUT_MAX) return;
+    TimeLayout lay;
+    memset(&lay, 0, sizeof(lay));
+    lay.fmt = fmt;
+    lay.shapeLen = consumed;
+    memcpy(lay.shape, buf, consumed);
+    int p = 0;
+    int lastEnd = -1; bool lastShort = false;
+    for(const char* f = fmts[fmt]; *f; f++){
+        if(isspace((unsigned char)*f)){
+            while(isspace((unsigned char)buf[p])) p++;
+            continue;
+        }
+        if(*f != '%'){
+            if(buf[p] != *f) return;
+            p++;
+            continue;
+        }
+        f++;
+        int field = -1, width = 2;
+        switch(*f){
+        case 'Y': field = 0; width = 4; break;
+        case 'y': field = 0; lay.shortYear = true; break;
+        case 'm': field = 1; break;
+        case 'd': field = 2; break;
+        case 'H': field = 3; break;
+        case 'I': field = 3; lay.hour12 = true; break;
+        case 'M': field = 4; break;
+        case 'S': field = 5; break;
+        case 'b':{
+            int m = 0, l = 0;
+            for(; m < 12; m++){
+                l = strlen(month_full[m]);
+                if(strncasecmp(buf + p, month_full[m], l) == 0) break;
+                l = strlen(month_abbr[m]);
+                if(strncasecmp(buf + p, month_abbr[m], l) == 0) break;
+            }
+            if(m == 12) return;
+            lay.val[1] = m + 1;
+            p += l;
+            continue;
+        }
+        case 'p':
+            if(strncasecmp(buf + p, "PM", 2) == 0) lay.pm = true;
+            else if(strncasecmp(buf + p, "AM", 2) != 0) return;
+            p += 2;
+            continue;
+        case 'z':
+            //kept as literal bytes, only the same zone text takes the fast path
+            while(isspace((unsigned char)buf[p])) p++;
+            if(buf[p] == 'Z'){ p++; continue; }
+            if(buf[p] != '+' && buf[p] != '-') return;
+            p++;
+            while(is_digit(buf[p]) || buf[p] == ':') p++;
+            continue;
+        default:
+            return;
+        }
+        while(isspace((unsigned char)buf[p])) p++;
+        int start = p;
+        while(p - start < width && is_digit(buf[p])) p++;
+        if(p == start) return;
+        lay.pos[field] = start;
+        lay.len[field] = p - start;
+        for(int i = start; i < p; i++) lay.shape[i] = 0;
+        lastEnd = p;
+        lastShort = p - start < width;
+    }
+    if(p != consumed) return;
+    lay.tailNonDigit = (lastEnd == consumed && lastShort);
+    for(auto &l: layouts){
+        if(l.shapeLen == lay.shapeLen && memcmp(l.shape, lay.shape, lay.shapeLen) == 0) return;
+    }
+    //the layout must give back exactly what strptime read
+    struct tm tmv; int millis; bool has_tz; int tz_offset; int end;
+    if(!strptime_parse(buf, fmts[fmt], tmv, millis, has_tz, tz_offset, end) || end != consumed) return;
+    int v[6];
+    for(int k = 0; k < 6; k++){
+        v[k] = lay.val[k];
+        for(int i = 0; i < lay.len[k]; i++) v[k] = v[k] * 10 + (buf[lay.pos[k] + i] - '0');
+    }
+    int year = lay.shortYear ? (v[0] >= 69 ? v[0] : v[0] + 100) : v[0] - 1900;
+    int hour = lay.hour12 ? v[3] % 12 + (lay.pm ? 12 : 0) : v[3];
+    if(tmv.tm_year != year || tmv.tm_mon != v[1] - 1 || tmv.tm_mday != v[2] || tmv.tm_hour != hour ||
+       tmv.tm_min != v[4] || tmv.tm_sec != v[5]) return;
+    layouts.push_back(lay);
+}
+
+bool TimestampCache::decode(const TimeLayout& lay, const char* s, int n, long long& out_ms)
+{
+    if(n < lay.shapeLen) return false;
+    for(int i = 0; i < lay.shapeLen; i++){
+        if(lay.shape[i] == 0){
+            if(!is_digit(s[i])) return false;
+        }else if(s[i] != lay.shape[i]) return false;
+    }
+    if(lay.tailNonDigit && lay.shapeLen < n && is_digit(s[lay.shapeLen])) return false;
+    int v[6];
+    for(int k = 0; k < 6; k++){
+        if(lay.len[k] == 0){
+            v[k] = lay.val[k];
+            continue;
+        }
+        v[k] = 0;
+        for(int i = 0; i < lay.len[k]; i++) v[k] = v[k] * 10 + (s[lay.pos[k] + i] - '0');
+        int hi = (k == 0 && lay.shortYear) ? 99 : (k == 3 && lay.hour12) ? 12 : field_hi[k];
+        int lo = (k == 3 && lay.hour12) ? 1 : field_lo[k];
+        if(v[k] < lo || v[k] > hi) return false;
+    }
+    int year = lay.shortYear ? (v[0] >= 69 ? v[0] : v[0] + 100) : v[0] - 1900;
+    int hour = lay.hour12 ? v[3] % 12 + (lay.pm ? 12 : 0) : v[3];
+    // same tail handling as strptime_parse
+    int millis = 0;
+    int e = lay.shapeLen;
+    if(e < n && (s[e] == ',' || s[e] == '.')){
+        int count = 0; e++;
+        while(e < n && is_digit(s[e]) && count < 3){ millis = millis*10 + (s[e] - '0'); e++; count++; }
+        while(count++ < 3) millis *= 10;
+    }
+    bool has_tz = false; int tz_offset = 0;
+    for(int k = n-1; k >= 0; --k){
+        if(s[k] == '+' || s[k] == '-'){
+            if(k+4 < n && is_digit(s[k+1]) && is_digit(s[k+2]) && is_digit(s[k+3]) && is_digit(s[k+4])){
+                int sign = (s[k] == '-') ? -1 : 1;
+                tz_offset = sign * (((s[k+1]-'0')*10 + (s[k+2]-'0'))*60 + (s[k+3]-'0')*10 + (s[k+4]-'0'));
+                has_tz = true;
+            }
+            break;
+        }
+    }
+    long long sec;
+    if(has_tz){
+        sec = (days_from_civil(year + 1900LL, v[1], v[2]) * 24 + hour) * 3600LL + v[4] * 60LL + v[5];
+        sec -= tz_offset * 60;
+    }else{
+        if(year != keyYear || v[1] != keyMon || v[2] != keyMday || hour != keyHour || v[4] != keyMin){
+            struct tm tmv;
+            memset(&tmv, 0, sizeof(tmv));
+            tmv.tm_year = year; tmv.tm_mon = v[1] - 1; tmv.tm_mday = v[2];
+            tmv.tm_hour = hour; tmv.tm_min = v[4];
+            time_t base = mktime(&tmv);
+            if(base == (time_t)-1) return false;
+            keyYear = year; keyMon = v[1]; keyMday = v[2]; keyHour = hour; keyMin = v[4];
+            keyBase = (long long)base;
+        }
+        sec = keyBase + v[5];
+    }
+    //failure and negative results take the generic path, which then tries the next formats
+    if(sec == -1) return false;
+    long long ms = sec * 1000LL + millis;
+    if(ms < 0) return false;
+    out_ms = ms;
+    return true;
+}
+
+bool TimestampCache::parse(const char* s, int len, long long& out_ms)
+{
+    int n = len > 1023 ? 1023 : len;
+    const char* nul = (const char*)memchr(s, '\0', n);
+    if(nul != NULL) n = nul - s;//the generic path sees a C string
+    int cnt = (int)layouts.size();
+    for(int i = 0; i < cnt; i++){
+        int k = (last + i) % cnt;
+        if(decode(layouts[k], s, n, out_ms)){
+            last = k;
+            return true;
+        }
+    }
+    char buf[1024];
+    memcpy(buf, s, n); buf[n] = '\0';
+    int fmt, consumed;
+    if(!parse_generic(buf, out_ms, fmt, consumed)) return false;
+    if(attempts < TIME_LAYOUT_MAX * 4){
+        attempts++;
+        learn(buf, fmt, consumed);
+    }
+    return true;
+}
@@ -13,4 +13,38 @@ bool parse_timestamp_ms(const char* s, int len, long long& out_ms);
 // Returns offset and length of detected timestamp substring, or {-1,0} if not found.
 std::pair<int,int> detect_timestamp_span(const char* s, int len);
 
-#endif
\ No newline at end of file
+#define TIME_LAYOUT_MAX 8
+#define TIME_SHAPE_MAX 64
+
+// Fixed position layout of one format, learned from a span the generic parser accepted.
+// shape[i] is the literal byte at i, or 0 where a field digit must be.
+struct TimeLayout {
+    int fmt;                    // index in the generic format list
+    int shapeLen;               // bytes consumed by strptime
+    char shape[TIME_SHAPE_MAX];
+    int pos[6], len[6];         // year mon mday hour min sec, len 0: value fixed in val
+    int val[6];
+    bool shortYear;             // %y
+    bool hour12, pm;            // %I with %p
+    bool tailNonDigit;          // last field shorter than its width, a digit after it changes the parse
+};
+
+// Per segment timestamp parser: the first span of each format goes through parse_timestamp_ms and
+// is compiled into a TimeLayout, later spans with the same shape are decoded with integer ops only.
+// The epoch of the last seen minute is cached, so mktime runs once per minute of log.
+// Results are exactly those of parse_timestamp_ms.
+class TimestampCache {
+public:
+    TimestampCache();
+    bool parse(const char* s, int len, long long& out_ms);
+private:
+    std::vector<TimeLayout> layouts;
+    int last;
+    int attempts;               //learn() calls, bounded so odd spans do not pay for it on every line
+    int keyYear, keyMon, keyMday, keyHour, keyMin;
+    long long keyBase;
+    bool decode(const TimeLayout& lay, const char* s, int n, long long& out_ms);
+    void learn(const char* buf, int fmt, int consumed);
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "Tokenizer.h"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TOKENIZER_X86 1
+#endif
+
+typedef int (*TokenizeFunc)(const char*, int, int, SegTag*, int);
+
+static inline bool is_delim(unsigned char c){
+    return c == ' ' || c == '\t' || c == ':' || c == '=' || c == ',' || c == '\0';
+}
+
+//emit the text before delimiter at pos, then the delimiter itself
+static inline int emit_delim(const char* buf, int pos, int& segStart, SegTag* segArray, int segSize, int maxSeg){
+    if(pos > segStart && segSize < maxSeg){
+        segArray[segSize].tag = 0;
+        segArray[segSize].startPos = segStart;
+        segArray[segSize].segLen = pos - segStart;
+        segSize++;
+    }
+    if(segSize < maxSeg){
+        segArray[segSize].tag = buf[pos];
+        segArray[segSize].segLen = 1;
+        segArray[segSize].startPos = pos;
+        segSize++;
+    }
+    segStart = pos + 1;
+    return segSize;
+}
+
+static inline int emit_tail(int end, int segStart, SegTag* segArray, int segSize, int maxSeg){
+    if(end > segStart && segSize < maxSeg){
+        segArray[segSize].tag = 0;
+        segArray[segSize].startPos = segStart;
+        segArray[segSize].segLen = end - segStart;
+        segSize++;
+    }
+    return segSize;
+}
+
+static int tokenize_scalar(const char* buf, int start, int end, SegTag* segArray, int maxSeg){
+    int segSize = 0;
+    int segStart = start;
+    for(int i = start; i < end; i++){
+        if(is_delim(buf[i])) segSize = emit_delim(buf, i, segStart, segArray, segSize, maxSeg);
+    }
+    return emit_tail(end, segStart, segArray, segSize, maxSeg);
+}
+
+#ifdef TOKENIZER_X86
+static int tokenize_sse2(const char* buf, int start, int end, SegTag* segArray, int maxSeg){
+    int segSize = 0;
+    int segStart = start;
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tb = _mm_set1_epi8('\t');
+    const __m128i co = _mm_set1_epi8(':');
+    const __m128i eq = _mm_set1_epi8('=');
+    const __m128i cm = _mm_set1_epi8(',');
+    const __m128i nul = _mm_setzero_si128();
+    int i = start;
+    for(; i + 16 <= end; i += 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)(buf + i));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tb)),
+                    _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, co), _mm_cmpeq_epi8(v, eq)),
+                    _mm_or_si128(_mm_cmpeq_epi8(v, cm), _mm_cmpeq_epi8(v, nul))));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(m);
+        while(mask){
+            segSize = emit_delim(buf, i + __builtin_ctz(mask), segStart, segArray, segSize, maxSeg);
+            mask &= mask - 1;
+        }
+    }
+    for(; i < end; i++){
+        if(is_delim(buf[i])) segSize = emit_delim(buf, i, segStart, segArray, segSize, maxSeg);
+    }
+    return emit_tail(end, segStart, segArray, segSize, maxSeg);
+}
+
+__attribute__((target("avx2")))
+static int tokenize_avx2(const char* buf, int start, int end, SegTag* segArray, int maxSeg){
+    int segSize = 0;
+    int segStart = start;
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i tb = _mm256_set1_epi8('\t');
+    const __m256i co = _mm256_set1_epi8(':');
+    const __m256i eq = _mm256_set1_epi8('=');
+    const __m256i cm = _mm256_set1_epi8(',');
+    const __m256i nul = _mm256_setzero_si256();
+    int i = start;
+    for(; i + 32 <= end; i += 32){
+        __m256i v = _mm256_loadu_si256((const __m256i*)(buf + i));
+        __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tb)),
+                    _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, co), _mm256_cmpeq_epi8(v, eq)),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, cm), _mm256_cmpeq_epi8(v, nul))));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(m);
+        while(mask){
+            segSize = emit_delim(buf, i + __builtin_ctz(mask), segStart, segArray, segSize, maxSeg);
+            mask &= mask - 1;
+        }
+    }
+    for(; i < end; i++){
+        if(is_delim(buf[i])) segSize = emit_delim(buf, i, segStart, segArray, segSize, maxSeg);
+    }
+    return emit_tail(end, segStart, segArray, segSize, maxSeg);
+}
+#endif
+
+static const char* g_impl_name = "scalar";
+
+static TokenizeFunc select_tokenizer(){
+    const char* sv = getenv("LOGGREP_SIMD");
+    if(sv && atoi(sv) == 0) return tokenize_scalar;
+#ifdef TOKENIZER_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        g_impl_name = "avx2";
+        return tokenize_avx2;
+    }
+    if(__builtin_cpu_supports("sse2")){
+        g_impl_name = "sse2";
+        return tokenize_sse2;
+    }
+#endif
+    return tokenize_scalar;
+}
+
+static TokenizeFunc get_tokenizer(){
+    static TokenizeFunc impl = select_tokenizer();
+    return impl;
+}
+
+int tokenize_line(const char* buf, int start, int end, SegTag* segArray, int maxSeg){
+    return get_tokenizer()(buf, start, end, segArray, maxSeg);
+}
+
+const char* tokenizer_impl(){
+    get_tokenizer();
+    return g_impl_name;
+}
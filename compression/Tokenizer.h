@@ -0,0 +1,16 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include "constant.h"
+
+// Split buf[start, end) into SegTags the same way the byte loop in main.cpp does:
+// every delimiter of " \t:=," (and NUL, which strchr also matches) becomes its own
+// segment tagged with the char, the text between delimiters gets tag 0.
+// Returns the number of segments written, at most maxSeg.
+int tokenize_line(const char* buf, int start, int end, SegTag* segArray, int maxSeg);
+
+// Name of the implementation picked at startup: "avx2", "sse2" or "scalar".
+// LOGGREP_SIMD=0 forces the scalar path.
+const char* tokenizer_impl();
+
+#endif
@@ -0,0 +1,304 @@
+// Compression benchmark: proc_buffer over every <dir>/<name>/0.log and copies of it scaled up by
+// concatenation, each run in a forked child so peak RSS is per run. One JSON record per run, and a
+// compare mode that fails on throughput or ratio regressions against a saved baseline.
+//   ./bench_compress [-d ../example] [-s 1,8] [-r 3] [-o bench_compress.json] [-c baseline.json] [-t 10]
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "constant.h"
+
+using namespace std;
+
+void proc_buffer(char* buffer, int buffer_len, string output_path, string cp_mode, string zip_mode, int compression_level, double threashold, int group, string template_lib, ProcStats* pstats);
+
+#define BENCH_RATIO_TOLERANCE 1.0 //ratio is deterministic, anything past rounding is a regression
+
+typedef struct BenchRun
+{
+    ProcStats ps;
+    long long outBytes;
+    long long peakRssKB;
+    int ok;
+}BenchRun;
+
+typedef struct BenchRecord
+{
+    string name;
+    int scale;
+    long long bytes;
+    map<string, double> v; //stime_mbs ... peak_rss_kb
+}BenchRecord;
+
+static const char* STAGES[] = {"stime_mbs", "mtime_mbs", "vtime_mbs", "ctime_mbs", "total_mbs"};
+
+static double mbs(long long bytes, double sec){
+    return (sec > 1e-9) ? bytes / 1e6 / sec : 0.0;
+}
+
+static bool readFile(const string& path, string& out){
+    FILE* f = fopen(path.c_str(), "rb");
+    if(f == NULL) return false;
+    char buf[1 << 16];
+    size_t n;
+    out.clear();
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0) out.append(buf, n);
+    fclose(f);
+    return !out.empty();
+}
+
+static vector<string> listDatasets(const string& dir){
+    vector<string> names;
+    DIR* d = opendir(dir.c_str());
+    if(d == NULL) return names;
+    struct dirent* e;
+    while((e = readdir(d)) != NULL){
+        if(e -> d_name[0] == '.') continue;
+        struct stat st;
+        if(stat((dir + "/" + e -> d_name + "/0.log").c_str(), &st) == 0 && S_ISREG(st.st_mode)) names.push_back(e -> d_name);
+    }
+    closedir(d);
+    sort(names.begin(), names.end());
+    return names;
+}
+
+//one compression in a child process: the parent keeps a clean heap and the child's ru_maxrss is this run only
+static BenchRun runOnce(const string& input, const string& outPath){
+    BenchRun r;
+    memset(&r, 0, sizeof(r));
+    int fds[2];
+    if(pipe(fds) != 0) return r;
+    pid_t pid = fork();
+    if(pid < 0){
+        close(fds[0]);
+        close(fds[1]);
+        return r;
+    }
+    if(pid == 0){
+        close(fds[0]);
+        int devnull = open("/dev/null", O_WRONLY);
+        if(devnull >= 0) dup2(devnull, STDOUT_FILENO); //proc_buffer progress lines
+        srand(4);
+        BenchRun c;
+        memset(&c, 0, sizeof(c));
+        proc_buffer((char*)input.data(), (int)input.size(), outPath, "Zstd", "Z", 1, 0.5, 0, "", &c.ps);
+        struct stat st;
+        c.outBytes = (stat(outPath.c_str(), &st) == 0) ? st.st_size : 0;
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        c.peakRssKB = ru.ru_maxrss;
+        c.ok = 1;
+        if(write(fds[1], &c, sizeof(c)) != (ssize_t)sizeof(c)) _exit(1);
+        _exit(0);
+    }
+    close(fds[1]);
+    ssize_t n = read(fds[0], &r, sizeof(r));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if(n != (ssize_t)sizeof(r) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) r.ok = 0;
+    unlink(outPath.c_str());
+    return r;
+}
+
+static string formatRecord(const BenchRecord& rec){
+    char buf[128];
+    string s = "{\"name\": \"" + rec.name + "\", \"scale\": " + to_string(rec.scale) + ", \"bytes\": " + to_string(rec.bytes);
+    const char* keys[] = {"lines", "stime_mbs", "mtime_mbs", "vtime_mbs", "ctime_mbs", "total_mbs", "ratio", "outlier_rate", "peak_rss_kb"};
+    for(const char* k: keys){
+        map<string, double>::const_iterator it = rec.v.find(k);
+        if(it == rec.v.end()) continue;
+        snprintf(buf, sizeof(buf), ", \"%s\": %.4f", k, it -> second);
+        s += buf;
+    }
+    return s + "}";
+}
+
+//reads back what formatRecord wrote, one record per line
+static map<string, BenchRecord> loadBaseline(const string& path){
+    map<string, BenchRecord> out;
+    string text;
+    if(!readFile(path, text)) return out;
+    size_t pos = 0;
+    while(pos < text.size()){
+        size_t end = text.find('\n', pos);
+        if(end == string::npos) end = text.size();
+        string line = text.substr(pos, end - pos);
+        pos = end + 1;
+        size_t n = line.find("\"name\": \"");
+        if(n == string::npos) continue;
+        BenchRecord rec;
+        size_t q = line.find('"', n + 9);
+        rec.name = line.substr(n + 9, q - n - 9);
+        size_t k = q;
+        while((k = line.find('"', k + 1)) != string::npos){
+            size_t ke = line.find('"', k + 1);
+            if(ke == string::npos) break;
+            string key = line.substr(k + 1, ke - k - 1);
+            k = ke;
+            if(line.compare(ke + 1, 2, ": ") != 0 || line[ke + 3] == '"') continue;
+            double val = atof(line.c_str() + ke + 3);
+            if(key == "scale") rec.scale = (int)val;
+            else if(key == "bytes") rec.bytes = (long long)val;
+            else rec.v[key] = val;
+        }
+        out[rec.name + "@" + to_string(rec.scale)] = rec;
+    }
+    return out;
+}
+
+//percent change of cur against base, positive is better for both throughput and ratio
+static double change(double cur, double base){
+    return (base > 0) ? (cur - base) * 100.0 / base : 0.0;
+}
+
+int main(int argc, char* argv[]){
+    string dir = "../example", outJson = "bench_compress.json", baseline = "";
+    vector<int> scales;
+    int repeats = 3;
+    double tolerance = 10.0;
+    int o;
+    while((o = getopt(argc, argv, "hd:s:r:o:c:t:")) != -1){
+        switch(o){
+        case 'd': dir = optarg; break;
+        case 's':{
+            string s = optarg;
+            size_t p = 0;
+            while(p < s.size()){
+                size_t e = s.find(',', p);
+                if(e == string::npos) e = s.size();
+                int v = atoi(s.substr(p, e - p).c_str());
+                if(v > 0) scales.push_back(v);
+                p = e + 1;
+            }
+            break;
+        }
+        case 'r': repeats = max(1, atoi(optarg)); break;
+        case 'o': outJson = optarg; break;
+        case 'c': baseline = optarg; break;
+        case 't': tolerance = atof(optarg); break;
+        default:
+            printf("-d dataset directory, every <dir>/<name>/0.log is a dataset (../example)\n");
+            printf("-s comma separated scale factors, the log concatenated that many times (1,8)\n");
+            printf("-r runs per dataset, the fastest is kept (3)\n");
+            printf("-o JSON output (bench_compress.json)\n");
+            printf("-c baseline JSON to compare against, exit 1 on regression\n");
+            printf("-t throughput tolerance in percent for -c (10)\n");
+            return (o == 'h') ? 0 : 1;
+        }
+    }
+    if(scales.empty()){
+        scales.push_back(1);
+        scales.push_back(8);
+    }
+    vector<string> names = listDatasets(dir);
+    if(names.empty()){
+        fprintf(stderr, "no <name>/0.log under %s\n", dir.c_str());
+        return 1;
+    }
+    string outPath = "/tmp/bench_compress_" + to_string(getpid()) + ".zip";
+
+    vector<BenchRecord> records;
+    for(const string& name: names){
+        string log;
+        if(!readFile(dir + "/" + name + "/0.log", log)) continue;
+        if(log[log.size() - 1] != '\n') log += '\n';
+        for(int scale: scales){
+            if((long long)log.size() * scale > MAX_WINDOW_BYTES){
+                fprintf(stderr, "%s x%d: larger than one window, skipped\n", name.c_str(), scale);
+                continue;
+            }
+            string input;
+            input.reserve(log.size() * scale);
+            for(int i = 0; i < scale; i++) input += log;
+            BenchRun best;
+            memset(&best, 0, sizeof(best));
+            double bestTime = -1;
+            long long peak = 0;
+            for(int i = 0; i < repeats; i++){
+                BenchRun r = runOnce(input, outPath);
+                if(!r.ok) continue;
+                double t = r.ps.stime + r.ps.mtime + r.ps.vtime + r.ps.ctime;
+                if(bestTime < 0 || t < bestTime){
+                    bestTime = t;
+                    best = r;
+                }
+                peak = max(peak, r.peakRssKB);
+            }
+            if(bestTime < 0){
+                fprintf(stderr, "%s x%d: compression failed\n", name.c_str(), scale);
+                continue;
+            }
+            BenchRecord rec;
+            rec.name = name;
+            rec.scale = scale;
+            rec.bytes = input.size();
+            rec.v["lines"] = best.ps.lines;
+            rec.v["stime_mbs"] = mbs(rec.bytes, best.ps.stime);
+            rec.v["mtime_mbs"] = mbs(rec.bytes, best.ps.mtime);
+            rec.v["vtime_mbs"] = mbs(rec.bytes, best.ps.vtime);
+            rec.v["ctime_mbs"] = mbs(rec.bytes, best.ps.ctime);
+            rec.v["total_mbs"] = mbs(rec.bytes, bestTime);
+            rec.v["ratio"] = best.outBytes > 0 ? (double)rec.bytes / best.outBytes : 0.0;
+            rec.v["outlier_rate"] = best.ps.lines > 0 ? (double)best.ps.failed / best.ps.lines : 0.0;
+            rec.v["peak_rss_kb"] = peak;
+            records.push_back(rec);
+            fprintf(stderr, "%-12s x%-3d %10lld B  %8.2f MB/s  ratio %7.2f  outliers %.4f  rss %lld KB\n", name.c_str(), scale, rec.bytes, rec.v["total_mbs"], rec.v["ratio"], rec.v["outlier_rate"], peak);
+        }
+    }
+
+    FILE* f = fopen(outJson.c_str(), "w");
+    if(f == NULL){
+        fprintf(stderr, "open %s failed\n", outJson.c_str());
+        return 1;
+    }
+    fprintf(f, "{\"repeats\": %d, \"runs\": [\n", repeats);
+    for(size_t i = 0; i < records.size(); i++){
+        fprintf(f, "  %s%s\n", formatRecord(records[i]).c_str(), (i + 1 < records.size()) ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    fclose(f);
+
+    if(baseline == "") return 0;
+    map<string, BenchRecord> base = loadBaseline(baseline);
+    if(base.empty()){
+        fprintf(stderr, "baseline %s has no runs\n", baseline.c_str());
+        return 1;
+    }
+    int regressions = 0;
+    for(BenchRecord& rec: records){
+        map<string, BenchRecord>::iterator it = base.find(rec.name + "@" + to_string(rec.scale));
+        if(it == base.end()) continue;
+        BenchRecord& b = it -> second;
+        string line = rec.name + " x" + to_string(rec.scale) + ":";
+        bool bad = false;
+        for(const char* k: STAGES){
+            double c = change(rec.v[k], b.v[k]);
+            char buf[64];
+            snprintf(buf, sizeof(buf), " %s %+.1f%%", k, c);
+            line += buf;
+            if(strcmp(k, "total_mbs") == 0 && c < -tolerance) bad = true;
+        }
+        double rc = change(rec.v["ratio"], b.v["ratio"]);
+        char buf[64];
+        snprintf(buf, sizeof(buf), " ratio %+.2f%%", rc);
+        line += buf;
+        if(rc < -BENCH_RATIO_TOLERANCE) bad = true;
+        if(bad){
+            line += "  REGRESSION";
+            regressions++;
+        }
+        fprintf(stderr, "%s\n", line.c_str());
+    }
+    return regressions > 0 ? 1 : 0;
+}
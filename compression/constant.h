@@ -5,6 +5,8 @@
 #include <cstdlib>
 #include <string>
 #include <map>
+#include <vector>
+#include <cstring>
 
 #define POS_TEMPLATE 16
 #define POS_VAR 8
@@ -23,6 +25,10 @@
 #define TYPE_TIME_COL 8
 #define TYPE_TIME_INDEX 9
 #define TYPE_BLOOM 10
+#define TYPE_ZDICT 11 //trained zstd dictionary, referenced by capsules through their meta dictId
+#define TYPE_HLL 12 //HyperLogLog registers of a var/svar/dic column, see Sketch.h
+
+#define ELE_BITPACKED -6 //eleLen of bit-packed entry: [int bits][bit stream][8 bytes pad]
 
 #define MAXLOG 100000 //The max number of log entry
 #define MAX_VALUE_LEN  10000
@@ -37,6 +43,14 @@
 #define MAXCOL 256 //The number of variable(int, string)
 #define MAXUNION 1024
 #define MAXCOMPRESS 16*1024*1024
+#define ZDICT_MAX_SAMPLE 64*1024 //only capsules up to this size are dictionary compressed
+#define ZDICT_MIN_SAMPLES 8
+#define ZDICT_MIN_SIZE 256 //dictionaries are ~1% of their samples
+#define ZDICT_MAX_SIZE 32*1024
+#define ZDICT_MIN_TOTAL 1024*1024 //kinds with fewer sample bytes are left alone, training and the trial recompression cost more than they save
+#define SEEKABLE_MIN_BYTES 1024*1024 //fixed width columns from this size on are written as seekable frames
+#define SEEKABLE_FRAME_BYTES 64*1024 //frame size target, rounded down to whole rows
+#define SEEKABLE_MAX_GROWTH 3 //percent over a single frame a seekable capsule may cost
 #define MAX_SAFE_DECOMPRESS_SIZE 100*1024*1024 // 最大安全解压缩大小限制(100MB)
 
 #define LINE_LENGTH 10000000 //The length of log read buffer
@@ -47,6 +61,9 @@
 
 // default fixed-size segment bytes for initial implementation (align to newline)
 #define DEFAULT_SEGMENT_BYTES (64*1024*1024)
+// streaming mode: each window of lines becomes one capsule group of the archive
+#define DEFAULT_WINDOW_BYTES (256LL*1024*1024)
+#define MAX_WINDOW_BYTES (1024LL*1024*1024)
 
 #define SysDebug //printf
 #define SysWarning printf
@@ -67,8 +84,8 @@ typedef struct VarArray
         nowPos = 0;
     }
     ~VarArray(){
-        free(startPos);
-        free(len);
+        delete [] startPos;
+        delete [] len;
     }
     void Add(int startpos, int length)
     {
@@ -79,8 +96,8 @@ typedef struct VarArray
                 nstartPos[i] = startPos[i];
                 nlen[i] = len[i];
             }       
-            free(startPos);
-            free(len);
+            delete [] startPos;
+            delete [] len;
             startPos = nstartPos;
             len = nlen;    
             totsize = totsize * 2;
@@ -89,8 +106,62 @@ typedef struct VarArray
         len[nowPos] = length;
         nowPos++;
     }
+    //append all entries of another array, keep the order
+    void Append(VarArray* other)
+    {
+        for(int i = 0; i < other->nowPos; i++){
+            Add(other->startPos[i], other->len[i]);
+        }
+    }
 }VarArray;
 
+//figures of one proc_buffer run, filled for callers that measure it (bench_compress)
+typedef struct ProcStats
+{
+    double stime; //sampling and template parsing
+    double mtime; //matching
+    double vtime; //variable encoding
+    double ctime; //capsule compression and output
+    int lines;
+    int samples;
+    int failed; //lines left to the outlier capsules
+}ProcStats;
+
+//lines matching no template, back to back in one growable buffer, each followed by '\n'
+//offsets[i] is where line i starts, offsets[count()] the end of the buffer
+typedef struct FailedLines
+{
+    string buf;
+    vector<long long> offsets;
+    vector<int> lineNo;
+    FailedLines()
+    {
+        offsets.push_back(0);
+    }
+    int count() const
+    {
+        return (int)lineNo.size();
+    }
+    void Add(int line, const char* start, int length)
+    {
+        length = strnlen(start, length);//stops at a NUL like the old C string copies did
+        buf.append(start, length);
+        buf.push_back('\n');
+        offsets.push_back(buf.size());
+        lineNo.push_back(line);
+    }
+    //append all lines of another set, line numbers shifted by lineBase
+    void Append(const FailedLines& other, int lineBase)
+    {
+        long long base = buf.size();
+        buf.append(other.buf);
+        for(int i = 0; i < other.count(); i++){
+            offsets.push_back(base + other.offsets[i + 1]);
+            lineNo.push_back(lineBase + other.lineNo[i]);
+        }
+    }
+}FailedLines;
+
 
 //record read segment attribute
 typedef struct SegTag
@@ -102,7 +102,17 @@ int main(int argc, char *argv[]){
     map<string, Coffer*> coffer_map;
     char* meta_buffer = new char[128];
     int meta_end = 0;
-    int metaLen = strlen(meta);
+    uint32_t recSize;
+    int dirCount = capsule_dir_count(meta, srcLen, recSize);
+    for(int i = 0; i < dirCount; i++){ //binary capsule directory
+        const CapsuleRecord* r = capsule_dir_at(meta, recSize, i);
+        if(r -> srcLen <= 0) continue;
+        Coffer* newCoffer = new Coffer(*r);
+        cout << "Build new coffer: " << newCoffer -> print() << endl;
+        coffer_buffer.push_back(newCoffer);
+        coffer_map[newCoffer -> filenames] = newCoffer;
+    }
+    int metaLen = (dirCount >= 0) ? 0 : strlen(meta);
     for(int i = 0; i < metaLen; i++){
         if(meta[i] == '\n'){ //New coffer
             meta_buffer[meta_end] = '\0';
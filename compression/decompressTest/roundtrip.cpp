@@ -0,0 +1,298 @@
+//encode -> decode round trips of the capsule formats: RLE/FOR/DELTA, seekable frames, zstd dictionaries,
+//the time column, HLL sketches and the binary capsule directory. Every capsule goes through an archive
+//buffer and is read back via its directory record, the way the query side loads it.
+//make roundtrip && ./RoundTrip, exit code is the number of failed checks
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <zstd.h>
+#include <zdict.h>
+#include "../constant.h"
+#include "../Coffer.h"
+#include "../Codec.h"
+#include "../CapsuleDir.h"
+#include "../TimeColumn.h"
+#include "../Sketch.h"
+using namespace std;
+
+static int failures = 0;
+#define CHECK(cond) do{ if(!(cond)){ printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } }while(0)
+
+static unsigned long long rng = 88172645463325252ULL;
+static unsigned long long nextRand(){
+    rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+    return rng;
+}
+
+//fixed width column of right aligned decimals
+static string intColumn(const vector<long long>& v, int width){
+    string s;
+    char buf[32];
+    for(long long x: v){
+        int n = snprintf(buf, sizeof(buf), "%lld", x);
+        s.append(width - n, ' ');
+        s.append(buf, n);
+    }
+    return s;
+}
+
+static Coffer* makeCoffer(int id, const string& text, int lines, int eleLen){
+    char* data = new char[text.size() + 5];
+    memcpy(data, text.data(), text.size());
+    data[text.size()] = '\0';
+    return new Coffer(to_string(id), data, text.size(), lines, 0, eleLen);
+}
+
+//capsules written back to back, as Encoder::output does
+struct Archive{
+    string body;
+    vector<CapsuleRecord> recs;
+    vector<string> texts;
+
+    void add(Coffer* c, const string& text){
+        CapsuleRecord r;
+        memset(&r, 0, sizeof(r));
+        r.id = atoi(c -> filenames.c_str());
+        r.offset = body.size();
+        r.codec = c -> compressed;
+        r.destLen = c -> destLen;
+        r.srcLen = c -> srcLen;
+        r.lines = c -> lines;
+        r.eleLen = c -> eleLen;
+        r.dictId = c -> dictId;
+        const unsigned char* p = (c -> compressed == CODEC_RAW) ? (const unsigned char*)c -> data : c -> cdata;
+        body.append((const char*)p, c -> destLen);
+        recs.push_back(r);
+        texts.push_back(text);
+    }
+    string directory(){
+        vector<CapsuleRecord> sorted = recs;
+        for(size_t i = 1; i < sorted.size(); i++){
+            for(size_t j = i; j > 0 && sorted[j - 1].id > sorted[j].id; j--) swap(sorted[j - 1], sorted[j]);
+        }
+        string out;
+        capsule_dir_head(out, sorted.size());
+        out.append((const char*)&sorted[0], sorted.size() * sizeof(CapsuleRecord));
+        return out;
+    }
+};
+
+static Coffer* encodeColumn(Archive& ar, int id, const string& text, int lines, int eleLen, int expectCodec){
+    Coffer* c = makeCoffer(id, text, lines, eleLen);
+    CHECK(c -> compress("Zstd", 3) > 0);
+    c -> selectCodec();
+    if(expectCodec == CODEC_SEEKABLE) c -> makeSeekable(3);
+    if(c -> compressed != expectCodec) printf("capsule %d: codec %d, expected %d\n", id, c -> compressed, expectCodec);
+    CHECK(c -> compressed == expectCodec);
+    ar.add(c, text);
+    return c;
+}
+
+static void testCodecs(Archive& ar){
+    const int rows = 5000;
+    //RLE: one value repeated
+    delete encodeColumn(ar, (1 << 16) | (1 << 8) | 2, intColumn(vector<long long>(rows, 4711), 6), rows, 6, CODEC_RLE);
+    //FOR: values scattered over a small range
+    vector<long long> v(rows);
+    for(int i = 0; i < rows; i++) v[i] = 100000 + nextRand() % 5000;
+    Coffer* forCol = encodeColumn(ar, (1 << 16) | (2 << 8) | 2, intColumn(v, 8), rows, 8, CODEC_FOR);
+    vector<long long> got;
+    CHECK(forCol -> decodeInts(got) == rows && got == v);
+    //DELTA: a counter with small, partly negative steps far from zero
+    long long x = 1700000000000LL;
+    for(int i = 0; i < rows; i++){ x += (long long)(nextRand() % 7) - 2; v[i] = x; }
+    Coffer* deltaCol = encodeColumn(ar, (1 << 16) | (3 << 8) | 2, intColumn(v, 14), rows, 14, CODEC_DELTA);
+    CHECK(deltaCol -> decodeInts(got) == rows && got == v);
+    //a column that is not canonical decimals stays zstd
+    string hex;
+    char buf[32];
+    for(int i = 0; i < rows; i++){ snprintf(buf, sizeof(buf), "%08llx", nextRand() & 0xFFFFFFFULL); hex += buf; }
+    delete encodeColumn(ar, (1 << 16) | (4 << 8) | 2, hex, rows, 8, CODEC_ZSTD);
+    delete forCol;
+    delete deltaCol;
+
+    //codec_int_decode straight on the encoder output, edge widths included
+    string enc;
+    vector<long long> one(1, 7);
+    CHECK(codec_for_encode(intColumn(one, 1).data(), 1, 1, 1, enc));
+    long long out1 = -1;
+    CHECK(codec_int_decode(CODEC_FOR, (const unsigned char*)enc.data(), enc.size(), 1, &out1) == 1 && out1 == 7);
+    vector<long long> big(64);
+    for(int i = 0; i < 64; i++) big[i] = 999999999999999999LL - (long long)(nextRand() % 1000000);
+    string col = intColumn(big, 18);
+    CHECK(codec_delta_encode(col.data(), col.size(), 18, 64, enc));
+    vector<long long> dec(64);
+    CHECK(codec_int_decode(CODEC_DELTA, (const unsigned char*)enc.data(), enc.size(), col.size(), &dec[0]) == 64 && dec == big);
+    string text(col.size(), '\0');
+    CHECK(codec_int_format(CODEC_DELTA, (const unsigned char*)enc.data(), enc.size(), &text[0], col.size()) == (int)col.size() && text == col);
+    //truncated streams are rejected, not read past
+    CHECK(codec_int_decode(CODEC_DELTA, (const unsigned char*)enc.data(), enc.size() - 9, col.size(), &dec[0]) == -1);
+    CHECK(codec_int_decode(CODEC_FOR, (const unsigned char*)enc.data(), CODEC_FOR_HEAD - 1, col.size(), &dec[0]) == -1);
+    //zero padded or blank rows do not round trip as text and must not be typed
+    CHECK(!codec_for_encode("0012", 4, 2, 2, enc));
+    CHECK(!codec_for_encode("  12", 4, 2, 2, enc));
+}
+
+static void testSeekable(Archive& ar){
+    //random hex rows, several frames of SEEKABLE_FRAME_BYTES
+    const int width = 16, rows = 20000;
+    string text;
+    char buf[32];
+    for(int i = 0; i < rows; i++){ snprintf(buf, sizeof(buf), "%016llx", nextRand() >> (nextRand() % 40)); text += buf; }
+    delete encodeColumn(ar, (2 << 16) | (1 << 8) | 2, text, rows, width, CODEC_SEEKABLE);
+}
+
+static void checkSeekRows(Coffer* c, const string& text){
+    int frameRows = c -> frameRows();
+    CHECK(frameRows == SEEKABLE_FRAME_BYTES / c -> eleLen);
+    vector<char> out(text.size());
+    int starts[] = {0, frameRows - 1, frameRows, 3 * frameRows - 5, c -> lines - 1};
+    for(int s: starts){
+        int n = min(10, c -> lines - s);
+        CHECK(c -> decompressRows(s, n, &out[0]) == n * c -> eleLen);
+        CHECK(memcmp(&out[0], text.data() + (size_t)s * c -> eleLen, n * c -> eleLen) == 0);
+    }
+    CHECK(c -> decompressRows(c -> lines - 1, 2, &out[0]) == -1);
+}
+
+static void testDictionary(Archive& ar, ZSTD_DDict*& ddict, int& dictName){
+    //many small capsules of one kind, the case trainDictionaries handles
+    vector<string> texts;
+    string samples;
+    vector<size_t> sizes;
+    for(int k = 0; k < 64; k++){
+        string t;
+        for(int i = 0; i < 40; i++){
+            t += "session opened for user " + to_string(nextRand() % 50) + " by (uid=" + to_string(nextRand() % 3) + ")\n";
+        }
+        texts.push_back(t);
+        samples += t;
+        sizes.push_back(t.size());
+    }
+    string dict(4096, '\0');
+    size_t dictLen = ZDICT_trainFromBuffer(&dict[0], dict.size(), samples.data(), &sizes[0], sizes.size());
+    CHECK(!ZDICT_isError(dictLen));
+    if(ZDICT_isError(dictLen)) return;
+    dict.resize(dictLen);
+    dictName = (4 << 8) | TYPE_ZDICT;
+    ZSTD_CDict* cdict = ZSTD_createCDict(dict.data(), dictLen, 3);
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_dictIDFlag, 0);
+    ZSTD_CCtx_refCDict(cctx, cdict);
+    for(int k = 0; k < (int)texts.size(); k++){
+        Coffer* c = makeCoffer((3 << 16) | (k << 8) | 3, texts[k], 40, -1);
+        size_t bound = ZSTD_compressBound(c -> srcLen);
+        c -> cdata = new Byte[bound];
+        size_t res = ZSTD_compress2(cctx, c -> cdata, bound, c -> data, c -> srcLen);
+        CHECK(!ZSTD_isError(res));
+        c -> destLen = res;
+        c -> compressed = CODEC_ZSTD;
+        c -> dictId = dictName;
+        ar.add(c, texts[k]);
+        delete c;
+    }
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeCDict(cdict);
+    ddict = ZSTD_createDDict(dict.data(), dictLen);
+}
+
+static void testTimeColumn(){
+    //several blocks, out of order and equal stamps included
+    vector<long long> t;
+    long long x = 1696000000000LL;
+    for(int i = 0; i < 3 * TIME_COL_BLOCK_ROWS + 17; i++){
+        x += (long long)(nextRand() % 2000) - 300;
+        t.push_back(i % 1000 == 0 ? 0 : x);
+    }
+    string col = encode_time_column(t);
+    vector<long long> back;
+    vector<TimeBlock> blocks;
+    CHECK(decode_time_column(col.data(), col.size(), back, &blocks) == (int)t.size());
+    CHECK(back == t);
+    CHECK(blocks.size() == 4 && blocks[3].rows == 17);
+    if(blocks.size() == 4){
+        long long lo = t[TIME_COL_BLOCK_ROWS], hi = lo;
+        for(int i = TIME_COL_BLOCK_ROWS; i < 2 * TIME_COL_BLOCK_ROWS; i++){ lo = min(lo, t[i]); hi = max(hi, t[i]); }
+        CHECK(blocks[1].tmin == lo && blocks[1].tmax == hi);
+    }
+    vector<long long> none;
+    string empty = encode_time_column(none);
+    CHECK(decode_time_column(empty.data(), empty.size(), back, NULL) == 0);
+    //a cut body or a block offset pointing outside it is corrupt
+    back.clear();
+    CHECK(decode_time_column(col.data(), col.size() - 3, back, NULL) == -1);
+    string bad = col;
+    int off = -1;
+    memcpy(&bad[3 * sizeof(int) + offsetof(TimeBlock, offset)], &off, sizeof(int));
+    back.clear();
+    CHECK(decode_time_column(bad.data(), bad.size(), back, NULL) == -1);
+}
+
+static void testSketch(){
+    //sparse and dense packing, merged back into empty registers
+    int counts[] = {300, 100000};
+    for(int n: counts){
+        vector<uint8_t> reg(HLL_M, 0), back(HLL_M, 0);
+        for(int i = 0; i < n; i++){
+            string v = "user" + to_string(i);
+            hll_add(&reg[0], HLL_P, v.data(), v.size());
+        }
+        string packed;
+        hll_pack(&reg[0], packed);
+        CHECK((n < 1000) == (packed.size() != HLL_M));
+        CHECK(hll_unpack_merge(packed.data(), packed.size(), &back[0]));
+        CHECK(back == reg);
+        double est = hll_estimate(&back[0], HLL_P);
+        CHECK(est > n * 0.95 && est < n * 1.05);
+    }
+    vector<uint8_t> reg(HLL_M, 0);
+    CHECK(!hll_unpack_merge("\x01\x02", 2, &reg[0]));
+    CHECK(!hll_unpack_merge("\xff\xff\x01", 3, &reg[0]));
+}
+
+int main(){
+    Archive ar;
+    testCodecs(ar);
+    testSeekable(ar);
+    ZSTD_DDict* ddict = NULL;
+    int dictName = 0;
+    testDictionary(ar, ddict, dictName);
+    testTimeColumn();
+    testSketch();
+
+    //read every capsule back through the directory, the way LogStoreApi does
+    string dir = ar.directory();
+    uint32_t recSize = 0;
+    int count = capsule_dir_count(dir.data(), dir.size(), recSize);
+    CHECK(count == (int)ar.recs.size() && recSize == sizeof(CapsuleRecord));
+    CHECK(capsule_dir_count(dir.data(), dir.size() - 1, recSize) == -1);
+    CHECK(capsule_dir_count("E1 1 0 10 20 2 -1\n", 18, recSize) == -1);
+    CHECK(capsule_dir_find(dir.data(), recSize, count, 12345) == NULL);
+    string mapped = ar.body + string(MAP_OVERREAD, '\0');
+    for(size_t i = 0; i < ar.recs.size() && count > 0; i++){
+        const CapsuleRecord* r = capsule_dir_find(dir.data(), recSize, count, ar.recs[i].id);
+        CHECK(r != NULL && memcmp(r, &ar.recs[i], sizeof(CapsuleRecord)) == 0);
+        if(r == NULL) continue;
+        Coffer c(*r);
+        CHECK(c.readMap((const unsigned char*)mapped.data(), ar.body.size(), 0) == r -> destLen);
+        //row reads straight from the frames, the seek table must follow a reload of cdata
+        if(c.compressed == CODEC_SEEKABLE){
+            checkSeekRows(&c, ar.texts[i]);
+            c.release();
+            CHECK(c.readMap((const unsigned char*)mapped.data(), ar.body.size(), 0) == r -> destLen);
+            checkSeekRows(&c, ar.texts[i]);
+        }
+        if(c.dictId != 0){
+            CHECK(c.dictId == dictName);
+            //without the dictionary the capsule must fail, not decode to garbage
+            if(r -> id == ((3 << 16) | 3)) CHECK(c.decompress(NULL) == -1);
+        }
+        int n = c.decompress(c.dictId != 0 ? ddict : NULL);
+        CHECK(n == (int)ar.texts[i].size() && memcmp(c.data, ar.texts[i].data(), n) == 0);
+    }
+    ZSTD_freeDDict(ddict);
+    printf("%s: %d failed checks\n", failures ? "FAILED" : "OK", failures);
+    return failures;
+}
@@ -18,10 +18,14 @@
 #include <cmath>
 #include <vector>
 #include <climits>
+#include <thread>
+#include <atomic>
 
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <dirent.h>
+#include <errno.h>
 
 #include "LengthParser.h"
 #include "util.h"
@@ -32,6 +36,7 @@
 #include "timer.h"
 #include "Coffer.h"
 #include "TimeParser.h"
+#include "Tokenizer.h"
 
 
 using namespace std;
@@ -111,7 +116,7 @@ int LoadcVars(const char *varname, char *vars)
 }
 
 //clove rewrite 20220415,  use mmap
-int matchFile(string input_path, LengthParser* parser, string zip_mode, int * Eid, int* failed_num, char** failed_log, map<int, VarArray*>& variables, int& nowLine)
+int matchFile(string input_path, LengthParser* parser, string zip_mode, int * Eid, FailedLines& failed, map<int, VarArray*>& variables, int& nowLine)
 {
     char *mbuf =NULL;
 	int len = LoadFileToMem(input_path.c_str(), &mbuf);
@@ -142,11 +147,7 @@ int matchFile(string input_path, LengthParser* parser, string zip_mode, int * Ei
             if(eid == -1)
             {
                 // lineLen = lineEnd-lineStart;
-				failed_num[failLine] = nowLine;
-                failed_log[failLine] = (char*)malloc(sizeof(char) * (i-lineStart+1));
-                strncpy(failed_log[failLine], mbuf + lineStart, i-lineStart);
-                failed_log[failLine][i-lineStart] = '\0';
-			    //SysDebug("Failed log: %s\n", failed_log[failLine]);
+				failed.Add(nowLine, mbuf + lineStart, i-lineStart);
                 failLine++;
 			}
             nowLine++;
@@ -178,8 +179,19 @@ int matchFile(string input_path, LengthParser* parser, string zip_mode, int * Ei
 	return failLine;
 }
 
+//LOGGREP_SAMPLE_SEED picks the sample, which only depends on the seed and the line number in the window
+#define SAMPLE_SEED 4
+static inline bool sampleLine(unsigned long long seed, int line, int sampleRange)
+{
+    unsigned long long z = seed + (unsigned long long)(line + 1) * 0x9E3779B97F4A7C15ull;//splitmix64
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    return z % sampleRange == 0;
+}
+
 // 从内存缓冲区匹配数据
-int matchBuffer(char* mbuf, int len, LengthParser* parser, string zip_mode, int * Eid, int* failed_num, char** failed_log, map<int, VarArray*>& variables, int& nowLine)
+int matchBuffer(char* mbuf, int len, LengthParser* parser, string zip_mode, int * Eid, FailedLines& failed, map<int, VarArray*>& variables, int& nowLine)
 {
     if(len <= 0 || mbuf == NULL)
     {
@@ -188,55 +200,24 @@ int matchBuffer(char* mbuf, int len, LengthParser* parser, string zip_mode, int
     
     SegTag* segArray = new SegTag[MAXTOCKEN*100];
     int segSize=0;
-    int segStart=0; int lineStart=0;
+    int lineStart=0;
     int failLine =0;
-    for (int i=0; i<len; i++)
+    while(lineStart < len)
 	{
-        if (mbuf[i] == '\n')
-		{
-            //判断最后是否还有字符串的遗留，也需要处理
-            if(i > segStart)
-            {
-                segArray[segSize].tag = 0;
-                segArray[segSize].startPos = segStart;
-                segArray[segSize].segLen=i-segStart;
-                segSize++;
-            }
-            //执行处理程序
-            int eid = parser -> SearchTemplate(mbuf, segArray, segSize, variables, true);
-			Eid[nowLine] = eid;
-            if(eid == -1)
-            {
-                // lineLen = lineEnd-lineStart;
-				failed_num[failLine] = nowLine;
-                failed_log[failLine] = (char*)malloc(sizeof(char) * (i-lineStart+1));
-                strncpy(failed_log[failLine], mbuf + lineStart, i-lineStart);
-                failed_log[failLine][i-lineStart] = '\0';
-			    //SysDebug("Failed log: %s\n", failed_log[failLine]);
-                failLine++;
-			}
-            nowLine++;
-            segSize=0;
-            segStart =i+1;
-            lineStart=i+1;
-		}
-        else if(strchr(delim,mbuf[i]))//记录分割符号
+        char* nl = (char*)memchr(mbuf + lineStart, '\n', len - lineStart);
+        if(nl == NULL) break;
+        int i = nl - mbuf;
+        segSize = tokenize_line(mbuf, lineStart, i, segArray, MAXTOCKEN*100);
+        //执行处理程序
+        int eid = parser -> SearchTemplate(mbuf, segArray, segSize, variables, true);
+        Eid[nowLine] = eid;
+        if(eid == -1)
         {
-            if(i > segStart)//delim前有字符串
-            {
-                segArray[segSize].tag = 0;
-                segArray[segSize].startPos = segStart;
-                segArray[segSize].segLen=i-segStart;
-                segSize++;
-
-            }
-            //记录分隔符本身
-            segArray[segSize].tag = mbuf[i];
-            segArray[segSize].segLen=1;
-            segArray[segSize].startPos = i;
-            segStart =i+1;
-            segSize++;
+            failed.Add(nowLine, mbuf + lineStart, i-lineStart);
+            failLine++;
         }
+        nowLine++;
+        lineStart=i+1;
     }
 	//SysDebug("Failed line: %d\n", failLine);
     if(zip_mode != "Z") cout << "Failed rate: " << (double)failLine / nowLine << endl;
@@ -245,6 +226,198 @@ int matchBuffer(char* mbuf, int len, LengthParser* parser, string zip_mode, int
 }
 
 
+//minimal bytes handed to one matching thread, smaller inputs stay serial
+#define MIN_CHUNK_BYTES (1024*1024)
+
+//one newline-aligned slice of the input, matched by its own thread
+typedef struct MatchChunk
+{
+    int start;
+    int end;
+    int lines;
+    vector<int> eid;
+    FailedLines failed;//line numbers inside the chunk
+    map<int, VarArray*> variables;
+    map<int, int> counter;
+}MatchChunk;
+
+//per-job cap set by batch mode before its workers start, the jobs share the cores
+int batchJobThreads = 0;
+
+//LOGGREP_COMPRESS_THREADS overrides the core count, 1 forces the serial path
+int getMatchThreads()
+{
+    int n = (int)std::thread::hardware_concurrency();
+    const char* tv = getenv("LOGGREP_COMPRESS_THREADS");
+    if(tv){ int x = atoi(tv); if(x > 0) n = x; }
+    if(batchJobThreads > 0 && n > batchJobThreads) n = batchJobThreads;
+    if(n <= 0) n = 1;
+    return n;
+}
+
+void matchChunk(char* mbuf, LengthParser* parser, MatchChunk* chunk)
+{
+    SegTag* segArray = new SegTag[MAXTOCKEN*100];
+    int segSize=0;
+    int lineStart=chunk->start;
+    while(lineStart < chunk->end)
+    {
+        char* nl = (char*)memchr(mbuf + lineStart, '\n', chunk->end - lineStart);
+        if(nl == NULL) break;
+        int i = nl - mbuf;
+        segSize = tokenize_line(mbuf, lineStart, i, segArray, MAXTOCKEN*100);
+        int eid = parser -> SearchTemplate(mbuf, segArray, segSize, chunk->variables, true, chunk->counter);
+        chunk->eid.push_back(eid);
+        if(eid == -1)
+        {
+            chunk->failed.Add(chunk->lines, mbuf + lineStart, i-lineStart);
+        }
+        chunk->lines++;
+        lineStart=i+1;
+    }
+    delete [] segArray;
+}
+
+//same result as matchBuffer: the template pool is only read by the workers,
+//per-chunk variables/counters/failed lines are merged back in chunk order
+int matchBufferParallel(char* mbuf, int len, LengthParser* parser, string zip_mode, int * Eid, FailedLines& failed, map<int, VarArray*>& variables, int& nowLine)
+{
+    if(len <= 0 || mbuf == NULL)
+    {
+        return 0;
+    }
+    int threads = getMatchThreads();
+    if(threads > len / MIN_CHUNK_BYTES) threads = len / MIN_CHUNK_BYTES;
+    if(threads <= 1)
+    {
+        return matchBuffer(mbuf, len, parser, zip_mode, Eid, failed, variables, nowLine);
+    }
+
+    vector<MatchChunk*> chunks;
+    int start = 0;
+    for(int t = 0; t < threads && start < len; t++)
+    {
+        int end = (t == threads - 1) ? len : (int)((long long)len * (t + 1) / threads);
+        if(end <= start) continue;
+        while(end < len && mbuf[end - 1] != '\n') end++;//align to the next line
+        MatchChunk* chunk = new MatchChunk();
+        chunk->start = start;
+        chunk->end = end;
+        chunk->lines = 0;
+        chunks.push_back(chunk);
+        start = end;
+    }
+    vector<thread> workers;
+    for(size_t t = 0; t < chunks.size(); t++)
+    {
+        workers.push_back(thread(matchChunk, mbuf, parser, chunks[t]));
+    }
+    for(auto &w: workers) w.join();
+
+    int failLine = 0;
+    for(auto &chunk: chunks)
+    {
+        for(int i = 0; i < chunk->lines; i++)
+        {
+            Eid[nowLine + i] = chunk->eid[i];
+        }
+        failed.Append(chunk->failed, nowLine);
+        failLine += chunk->failed.count();
+        for(auto &c: chunk->counter)
+        {
+            parser->TC[c.first] += c.second;
+        }
+        for(auto &v: chunk->variables)
+        {
+            if(variables.find(v.first) == variables.end() || variables[v.first] == NULL)
+            {
+                variables[v.first] = new VarArray(v.first, v.second->nowPos);
+            }
+            variables[v.first]->Append(v.second);
+            delete v.second;
+        }
+        nowLine += chunk->lines;
+        delete chunk;
+    }
+    if(zip_mode != "Z") cout << "Failed rate: " << (double)failLine / nowLine << endl;
+    return failLine;
+}
+
+//second mining pass, LOGGREP_REMINE_RATE overrides the failed share that triggers it (1 turns it off)
+#define REMINE_RATE 0.05
+#define REMINE_SAMPLES 5000 //failed lines parsed at most, taken at an even stride: the same parse work as the 1% first pass on a 500k line window
+#define REMINE_MIN_HITS 64 //LOGGREP_REMINE_MIN_HITS, lines a mined template must cover, below that the outlier block compresses better
+
+//templates are mined from the failed lines alone and those lines are matched again; the sampled
+//templates are sealed first, so rows they already extracted keep their stable id and layout
+int remineFailed(char* mbuf, int len, LengthParser* parser, string zip_mode, int * Eid, FailedLines& failed, map<int, VarArray*>& variables, int nowLine)
+{
+    int failLine = failed.count();
+    double rate = REMINE_RATE;
+    const char* rv = getenv("LOGGREP_REMINE_RATE");
+    if(rv) rate = atof(rv);
+    if(failLine == 0 || nowLine == 0 || (double)failLine / nowLine <= rate)
+    {
+        return failLine;
+    }
+    //spans of the failed lines in the buffer, in line order
+    vector<int> spanLine, spanStart, spanEnd;
+    spanLine.reserve(failLine);
+    spanStart.reserve(failLine);
+    spanEnd.reserve(failLine);
+    int line = 0, lineStart = 0;
+    while(lineStart < len && line < nowLine)
+    {
+        char* nl = (char*)memchr(mbuf + lineStart, '\n', len - lineStart);
+        if(nl == NULL) break;
+        int i = nl - mbuf;
+        if(Eid[line] == -1)
+        {
+            spanLine.push_back(line);
+            spanStart.push_back(lineStart);
+            spanEnd.push_back(i);
+        }
+        line++;
+        lineStart = i + 1;
+    }
+    set<unsigned int> sealedSids;
+    for(auto &pool: parser->LengthTemplatePool)
+    {
+        for(auto &temp: *pool.second) sealedSids.insert(stable_id_from_string(temp->output()));
+    }
+    parser->Seal();
+    SegTag* segArray = new SegTag[MAXTOCKEN*100];
+    int n = spanStart.size();
+    int stride = (n + REMINE_SAMPLES - 1) / REMINE_SAMPLES;
+    for(int f = 0; f < n; f += stride)
+    {
+        int segSize = tokenize_line(mbuf, spanStart[f], spanEnd[f], segArray, MAXTOCKEN*100);
+        parser->parseTemplate(mbuf, segArray, segSize);
+    }
+    int minHits = REMINE_MIN_HITS;
+    const char* hv = getenv("LOGGREP_REMINE_MIN_HITS");
+    if(hv){ int x = atoi(hv); if(x > 0) minHits = x; }
+    int dropped = parser->DropUnsealed((minHits + stride - 1) / stride, sealedSids);
+    parser->BuildIndex();
+
+    FailedLines rest;
+    for(int f = 0; f < n; f++)
+    {
+        int segSize = tokenize_line(mbuf, spanStart[f], spanEnd[f], segArray, MAXTOCKEN*100);
+        int lineNo = spanLine[f];
+        int eid = parser->SearchTemplate(mbuf, segArray, segSize, variables, true);
+        Eid[lineNo] = eid;
+        if(eid == -1)
+        {
+            rest.Add(lineNo, mbuf + spanStart[f], spanEnd[f] - spanStart[f]);
+        }
+    }
+    delete [] segArray;
+    if(zip_mode != "Z") printf("Remine: %d failed lines, %d mined templates dropped, failed rate: %lf\n", failLine, dropped, (double)rest.count() / nowLine);
+    failed = rest;
+    return failed.count();
+}
+
 bool outputVar(string fileName, vector<string>* temp){
 	FILE* fo = fopen(fileName.c_str(), "w");
 	if (fo == NULL){
@@ -282,195 +455,15 @@ bool outputEntry(string fileName, int* entry, int maxIdx, int size){
 }
 
 /*
-从内存缓冲区处理数据
-buffer: 内存缓冲区
-buffer_len: 缓冲区长度
+对一个变量建立 dictionary 或 sub-pattern, capsule 写入 encoder, 描述追加到 SUBPATTERN
+variable 之间互不依赖, 可以并行
 */
-void proc_buffer(char* buffer, int buffer_len, string output_path, string cp_mode, string zip_mode, int compression_level, double threashold);
-
-/*
-主处理函数入口
-./Input A.log -> A.zip
-
-*/
-void proc(string input_path, string output_path, string cp_mode, string zip_mode, int compression_level, double threashold){
-    
-    timeval stime_s = ___StatTime_Start();    
-	
-    bool dict = true;
-    bool sub = true;
-    
-    char* mbuf = NULL;
-    int len = LoadFileToMem(input_path.c_str(), &mbuf);
-    if (len <= 0){
-        SysWarning("Read file failed!\n");
-        return;
-    }
-    
-    // 调用通用处理函数
-    proc_buffer(mbuf, len, output_path, cp_mode, zip_mode, compression_level, threashold);
-}
-
-/*
-从内存缓冲区处理数据
-buffer: 内存缓冲区
-buffer_len: 缓冲区长度
-*/
-void proc_buffer(char* buffer, int buffer_len, string output_path, string cp_mode, string zip_mode, int compression_level, double threashold){
-    
-    timeval stime_s = ___StatTime_Start();    
-	
-    bool dict = true;
-    bool sub = true;
-    
-    char* mbuf = buffer;
-    int len = buffer_len;
-    if (len <= 0 || mbuf == NULL){
-        SysWarning("Invalid buffer data!\n");
-        return;
-    }
-    SegTag* segArray = new SegTag[MAXTOCKEN * 100];
-    int segSize = 0;
-    int segStart = 0, lineStart = 0;
-
-    int sampleRange = 100;
-
-    int nowLine = 0, nowSample = 0;
-    bool sampled = false;
-    LengthParser parser(threashold);
-
-    // time column and fixed-size segment accounting
-    vector<long long> time_values;
-    time_values.reserve(100000);
-    vector<int> seg_line_starts; vector<int> seg_line_ends;
-    vector<long long> seg_min_ts; vector<long long> seg_max_ts;
-    int current_segment_bytes = 0;
-    int current_segment_min_line = 0;
-    long long cur_seg_min = LLONG_MAX; long long cur_seg_max = LLONG_MIN;
-
-    for (int i = 0; i < len; i++){
-        if(segSize == MAXTOCKEN*100 - 1){
-            SysWarning("segSize out of bound\n");
-        }
-        if(mbuf[i] == '\n'){
-            if(sampled && i > segStart){
-                segArray[segSize].tag = 0;
-                segArray[segSize].startPos = segStart;
-                segArray[segSize].segLen = i - segStart;
-                segSize++;
-            }
-            if(sampled){
-                nowSample++;
-                parser.parseTemplate(mbuf, segArray, segSize);
-                //execute parsing process
-            }
-            //SysDebug("Remaining: %d\n", remaining);
-            if(rand() % sampleRange == 1){
-                sampled = true;
-            }else{
-                sampled = false;
-            }
-            // extract timestamp for this line
-            int line_len = i - lineStart;
-            long long ts_ms = 0;
-            auto span = detect_timestamp_span(mbuf + lineStart, line_len);
-            if(span.first >= 0){
-                if(!parse_timestamp_ms(mbuf + lineStart + span.first, span.second, ts_ms)){
-                    ts_ms = (long long)time(NULL) * 1000LL;
-                }
-            } else {
-                ts_ms = (long long)time(NULL) * 1000LL;
-            }
-            time_values.push_back(ts_ms);
-            current_segment_bytes += (i - lineStart + 1);
-            if(ts_ms < cur_seg_min) cur_seg_min = ts_ms;
-            if(ts_ms > cur_seg_max) cur_seg_max = ts_ms;
-            nowLine++;
-            segSize = 0;
-            segStart = i + 1;
-            lineStart = i + 1;
-            if(i - lineStart > MAX_VALUE_LEN){
-                SysWarning("[WARNING] line length out of bound: %d\n", i - lineStart);
-            }
-            // finalize a segment when exceeding threshold bytes
-            if(current_segment_bytes >= DEFAULT_SEGMENT_BYTES){
-                seg_line_starts.push_back(current_segment_min_line);
-                seg_line_ends.push_back(nowLine - 1);
-                seg_min_ts.push_back(cur_seg_min == LLONG_MAX ? (long long)time(NULL)*1000LL : cur_seg_min);
-                seg_max_ts.push_back(cur_seg_max == LLONG_MIN ? (long long)time(NULL)*1000LL : cur_seg_max);
-                current_segment_min_line = nowLine;
-                current_segment_bytes = 0; cur_seg_min = LLONG_MAX; cur_seg_max = LLONG_MIN;
-            }
-        }else if(sampled && strchr(delim, mbuf[i])){
-            if (i > segStart){
-                segArray[segSize].tag = 0;
-                segArray[segSize].startPos = segStart;
-                segArray[segSize].segLen = i-segStart;
-                segSize++;
-            }
-            segArray[segSize].tag = mbuf[i];
-            segArray[segSize].segLen = 1;
-            segArray[segSize].startPos = i;
-            segStart = i + 1;
-            segSize++;
-        }
-    }
-    if(zip_mode != "Z") printf("Tot Size: %d, Sampler Size: %d\n", nowLine, nowSample);
-
-    int expendTime = sampleRange * 4;
-    
-    //build varaible_mapping;
-    map<int, VarArray*> variable_mapping;  
-    for(auto &pool:parser.LengthTemplatePool){
-        vector<templateNode*>* nowPool = pool.second;
-        for(auto &temp: *nowPool){
-            for(int i = 0; i < temp->varLength; i++){
-                unsigned int sid = stable_id_from_string(temp->output());
-                int nowTag = ((sid)<<POS_TEMPLATE) | (i<<POS_VAR);
-                variable_mapping[nowTag] = new VarArray(nowTag, parser.STC[temp->Eid] * expendTime);
-            }
-        }
-    }
-    
-
-    if(zip_mode != "Z") parser.TemplatePrint();
-    if(zip_mode != "Z") cout << "start match" << endl;
-	//Streaming processing(match, match again, extract varibales and output)
-	double stime = ___StatTime_End(stime_s);
-
-    timeval mtime_s = ___StatTime_Start();
-    int * Eid = new int[nowLine];
-    
-
-    
-    int* failed_num = new int[MAXLOG * 2];
-    char** failed_log = new char*[MAXLOG * 2];
-	
-    int nowline = 0;
-    int failLine = matchBuffer(mbuf, len, &parser, zip_mode, Eid, failed_num, failed_log, variable_mapping, nowline);
-    
-
-    double mtime = ___StatTime_End(mtime_s);
-///*    
-    Encoder* encoder = new Encoder(cp_mode, zip_mode, compression_level);
-    encoder -> serializeTemplate(output_path, &parser);
-    encoder -> serializeTemplateOutlier(failed_log, failLine);
-
-    //Here variable strings get, need to split, and 
-	//For each variable, build union -> split -> build sub-pattern
-    string SUBPATTERN = "";
-    int SUBCOUNT = 0;
-    
-    timeval vtime_s = ___StatTime_Start();
-    if(zip_mode != "Z") cout << "start variable process" << endl;
-    char tempArray[MAX_VALUE_LEN];
-	for(map<int, VarArray*>::iterator it = variable_mapping.begin(); it != variable_mapping.end(); it++){
-        
-
+void encodeVariable(char* mbuf, int varTag, VarArray* temp, bool dict, bool sub, Encoder* encoder, string& SUBPATTERN, int& SUBCOUNT, Arena& arena)
+{
+    arena.reset();
+    union_srand((unsigned int)varTag);
 		bool debug = false;
         //if(it ->first == ((12<<POS_TEMPLATE) + (1<<POS_VAR))) debug = true;//E12_V1s
-        VarArray * temp = it -> second;
-        int varTag = it ->first;
         int templateNum = varTag >> POS_TEMPLATE;
         int variableNum = (varTag >> POS_VAR) & 0xff;
 
@@ -491,7 +484,7 @@ void proc_buffer(char* buffer, int buffer_len, string output_path, string cp_mod
             SUBCOUNT++;
             string fileName = to_string((varTag | (TYPE_VAR << POS_TYPE)));
             encoder -> serializeVar(fileName, mbuf, temp, maxLen);
-			continue;
+			return;
 		}
        
 		Union** tree = new Union* [MAXUNION];
@@ -507,7 +500,7 @@ void proc_buffer(char* buffer, int buffer_len, string output_path, string cp_mod
             for(int i=0; i< temp->nowPos; i++)
             {
                 
-				entry[idx++] = root -> dictionary[root ->HashValue[i]];
+				entry[idx++] = root -> dictionary.find(root ->HashValue[i]) -> entry;
 			}
 			encoder -> serializeEntry(to_string(varTag | (TYPE_ENTRY << POS_TYPE)), entry, root -> dicMax, idx);
             encoder -> serializeDic(to_string(varTag | (TYPE_DIC << POS_TYPE)), mbuf,temp, root);    
@@ -517,6 +510,8 @@ void proc_buffer(char* buffer, int buffer_len, string output_path, string cp_mod
             }
             SUBPATTERN += "\n";
             SUBCOUNT++;
+            delete [] entry;
+            delete root;
 		
 		}else if (sub){ //Build sub-pattern
 			vector<int> container;
@@ -577,7 +572,7 @@ void proc_buffer(char* buffer, int buffer_len, string output_path, string cp_mod
                 }
                 
                 //if(debug) cout << nextConstant << endl;    	
-                SubPattern* pat = new SubPattern(tree[i], nextConstant, temp ->nowPos);
+                SubPattern* pat = new SubPattern(tree[i], nextConstant, temp ->nowPos, &arena);
 				subPatternPool.push_back(pat);
 			}
             
@@ -593,26 +588,24 @@ void proc_buffer(char* buffer, int buffer_len, string output_path, string cp_mod
 			
             
 			set<int> outlier_idx;
-			vector<pair<int, string> > outlier;
+			vector<pair<int, StrView> > outlier;
             for(int i=0; i< temp->nowPos; i++)
 			{
 				int strIdx = 0; //The reading point
 				bool jump = false;
                 int varLen = temp->len[i];
-                strncpy(tempArray,mbuf + temp->startPos[i], varLen);
-                tempArray[varLen] = '\0';
-				string nowStr = tempArray;
+                StrView nowStr = {mbuf + temp->startPos[i], varLen};
                 //if(debug) cout << "count: " << count << endl;
 				bool success = true;
                 for(vector<SubPattern*>::iterator pit = subPatternPool.begin(); pit != subPatternPool.end(); pit++){
-					if(!(*pit) ->extract(nowStr, strIdx, jump)){
+					if(!(*pit) ->extract(nowStr.ptr, nowStr.len, strIdx, jump)){
 						//if(debug) cout << "count: " << count << " outlier: " << nowStr << " strIdx: " << strIdx << endl;
                         outlier.push_back(make_pair(i, nowStr));
 						outlier_idx.insert(i);
 						success = false;
                         break;
 					}
-					if(debug) cout << " success " << nowStr << " strIdx: " << strIdx  << "varLen" << varLen << endl;
+					if(debug) cout << " success " << string(nowStr.ptr, nowStr.len) << " strIdx: " << strIdx  << "varLen" << varLen << endl;
 				}
                 if(success && strIdx != varLen) {
                     //cout << "here: " << nowStr << endl;
@@ -653,11 +646,299 @@ void proc_buffer(char* buffer, int buffer_len, string output_path, string cp_mod
             SUBPATTERN += to_string(varTag) + " S " + subPattern + "\n";
             SUBCOUNT++;
             //fprintf(fw, "%s S %s\n", (it ->first).c_str(), subPattern.c_str());
+            for(auto &pat: subPatternPool) delete pat;
+            for(int i = 0; i < nowEnd; i++) delete tree[i];//root included
+
+        }
+        delete [] tree;
+}
+
+//each worker encodes into its own Encoder, results are merged back in variable_mapping order
+void encodeVariablesParallel(char* mbuf, map<int, VarArray*>& variable_mapping, bool dict, bool sub, Encoder* encoder, string& SUBPATTERN, int& SUBCOUNT)
+{
+    vector<pair<int, VarArray*> > vars(variable_mapping.begin(), variable_mapping.end());
+    int n = (int)vars.size();
+    int threads = min(getMatchThreads(), n);
+    if(threads <= 1){
+        Arena arena;
+        for(int i = 0; i < n; i++) encodeVariable(mbuf, vars[i].first, vars[i].second, dict, sub, encoder, SUBPATTERN, SUBCOUNT, arena);
+        return;
+    }
+    vector<Encoder*> sinks(n);
+    vector<string> patterns(n);
+    vector<int> counts(n, 0);
+    for(int i = 0; i < n; i++) sinks[i] = encoder -> fork();
+    std::atomic<int> next(0);
+    vector<std::thread> workers;
+    for(int t = 0; t < threads; t++){
+        workers.push_back(std::thread([&](){
+            Arena arena; //one per worker, rewound for every variable
+            for(int i = next++; i < n; i = next++){
+                encodeVariable(mbuf, vars[i].first, vars[i].second, dict, sub, sinks[i], patterns[i], counts[i], arena);
+            }
+        }));
+    }
+    for(auto &w: workers) w.join();
+    for(int i = 0; i < n; i++){
+        encoder -> absorb(sinks[i]);
+        delete sinks[i];
+        SUBPATTERN += patterns[i];
+        SUBCOUNT += counts[i];
+    }
+}
 
+/*
+从内存缓冲区处理数据
+buffer: 内存缓冲区
+buffer_len: 缓冲区长度
+group: archive 中的 capsule group 序号, >0 时追加到 output_path
+template_lib: 模板库路径, 非空时先载入已有模板, 压缩后写回新发现的模板
+pstats: 非空时填入各阶段耗时与行数
+*/
+void proc_buffer(char* buffer, int buffer_len, string output_path, string cp_mode, string zip_mode, int compression_level, double threashold, int group = 0, string template_lib = "", ProcStats* pstats = NULL);
 
+/*
+流式处理: 每次读入一个按行对齐的窗口, 压缩为一个 capsule group 并追加到同一个 archive
+峰值内存由 window_bytes 决定
+*/
+int proc_stream(FILE* fin, string output_path, string cp_mode, string zip_mode, int compression_level, double threashold, long long window_bytes, string template_lib = ""){
+    if(window_bytes <= 0) window_bytes = DEFAULT_WINDOW_BYTES;
+    if(window_bytes > MAX_WINDOW_BYTES) window_bytes = MAX_WINDOW_BYTES;
+    long long capacity = window_bytes;
+    char* buffer = (char*)malloc(capacity);
+    if(buffer == NULL){
+        SysWarning("Failed to allocate window buffer\n");
+        return 0;
+    }
+    long long filled = 0;
+    int group = 0;
+    bool eof = false;
+    while(true){
+        if(!eof){
+            size_t n = fread(buffer + filled, 1, capacity - filled, fin);
+            filled += n;
+            if(filled < capacity) eof = true;
         }
-//		cout << "$$$$$$$$$$$$$Now end process: " << it -> first << endl;
-	}
+        long long cut = filled;
+        if(!eof){
+            //keep the unfinished last line for the next window
+            while(cut > 0 && buffer[cut - 1] != '\n') cut--;
+            if(cut == 0){
+                if(capacity >= MAX_WINDOW_BYTES){
+                    SysWarning("line longer than %lld bytes, cut\n", capacity);
+                    cut = filled;
+                }else{
+                    //a single line longer than the window
+                    capacity = min(capacity * 2, (long long)MAX_WINDOW_BYTES);
+                    char* nbuf = (char*)realloc(buffer, capacity);
+                    if(nbuf == NULL){
+                        SysWarning("Failed to grow window buffer\n");
+                        break;
+                    }
+                    buffer = nbuf;
+                    continue;
+                }
+            }
+        }
+        if(cut > 0){
+            if(zip_mode != "Z") printf("window %d: %lld bytes\n", group, cut);
+            proc_buffer(buffer, (int)cut, output_path, cp_mode, zip_mode, compression_level, threashold, group, template_lib);
+            group++;
+        }
+        memmove(buffer, buffer + cut, filled - cut);
+        filled -= cut;
+        if(eof) break;
+    }
+    free(buffer);
+    return group;
+}
+
+/*
+主处理函数入口
+./Input A.log -> A.zip
+
+*/
+void proc(string input_path, string output_path, string cp_mode, string zip_mode, int compression_level, double threashold, string template_lib = ""){
+    
+    timeval stime_s = ___StatTime_Start();    
+	
+    bool dict = true;
+    bool sub = true;
+
+    //a whole-file mapping overflows the int offsets, switch to windows
+    struct stat st;
+    if(stat(input_path.c_str(), &st) == 0 && (long long)st.st_size > MAX_WINDOW_BYTES){
+        printf("input larger than %lld bytes, compress in windows of %lld bytes\n", MAX_WINDOW_BYTES, DEFAULT_WINDOW_BYTES);
+        FILE* fin = fopen(input_path.c_str(), "rb");
+        if(fin == NULL){
+            SysWarning("Read file failed!\n");
+            return;
+        }
+        proc_stream(fin, output_path, cp_mode, zip_mode, compression_level, threashold, DEFAULT_WINDOW_BYTES, template_lib);
+        fclose(fin);
+        return;
+    }
+    
+    char* mbuf = NULL;
+    int len = LoadFileToMem(input_path.c_str(), &mbuf);
+    if (len <= 0){
+        SysWarning("Read file failed!\n");
+        return;
+    }
+    
+    // 调用通用处理函数
+    proc_buffer(mbuf, len, output_path, cp_mode, zip_mode, compression_level, threashold, 0, template_lib);
+    munmap(mbuf, len);
+}
+
+/*
+从内存缓冲区处理数据
+buffer: 内存缓冲区
+buffer_len: 缓冲区长度
+*/
+void proc_buffer(char* buffer, int buffer_len, string output_path, string cp_mode, string zip_mode, int compression_level, double threashold, int group, string template_lib, ProcStats* pstats){
+    
+    timeval stime_s = ___StatTime_Start();    
+	
+    bool dict = true;
+    bool sub = true;
+    
+    char* mbuf = buffer;
+    int len = buffer_len;
+    if (len <= 0 || mbuf == NULL){
+        SysWarning("Invalid buffer data!\n");
+        return;
+    }
+    SegTag* segArray = new SegTag[MAXTOCKEN * 100];
+    int segSize = 0;
+    int lineStart = 0;
+
+    int sampleRange = 100;
+    unsigned long long sampleSeed = SAMPLE_SEED;
+    const char* sv = getenv("LOGGREP_SAMPLE_SEED");
+    if(sv) sampleSeed = strtoull(sv, NULL, 10);
+
+    int nowLine = 0, nowSample = 0;
+    bool sampled = false;
+    LengthParser parser(threashold);
+    if(template_lib != ""){
+        //library templates go first in every pool, sampled lines hitting them are not parsed again
+        int libCount = parser.LoadTemplateLibrary(template_lib);
+        if(zip_mode != "Z") printf("Template library: %d templates\n", libCount);
+    }
+
+    // time column and fixed-size segment accounting
+    vector<long long> time_values;
+    time_values.reserve(100000);
+    TimestampCache time_cache;
+    vector<int> seg_line_starts; vector<int> seg_line_ends;
+    vector<long long> seg_min_ts; vector<long long> seg_max_ts;
+    int current_segment_bytes = 0;
+    int current_segment_min_line = 0;
+    long long cur_seg_min = LLONG_MAX; long long cur_seg_max = LLONG_MIN;
+
+    while(lineStart < len){
+        char* nl = (char*)memchr(mbuf + lineStart, '\n', len - lineStart);
+        if(nl == NULL) break;
+        int i = nl - mbuf;
+        sampled = sampleLine(sampleSeed, nowLine, sampleRange);
+        if(sampled){
+            segSize = tokenize_line(mbuf, lineStart, i, segArray, MAXTOCKEN * 100);
+            if(segSize == MAXTOCKEN*100){
+                SysWarning("segSize out of bound\n");
+            }
+            nowSample++;
+            parser.parseTemplate(mbuf, segArray, segSize);
+            //execute parsing process
+        }
+        // extract timestamp for this line
+        int line_len = i - lineStart;
+        long long ts_ms = 0;
+        auto span = detect_timestamp_span(mbuf + lineStart, line_len);
+        if(span.first >= 0){
+            if(!time_cache.parse(mbuf + lineStart + span.first, span.second, ts_ms)){
+                ts_ms = (long long)time(NULL) * 1000LL;
+            }
+        } else {
+            ts_ms = (long long)time(NULL) * 1000LL;
+        }
+        time_values.push_back(ts_ms);
+        current_segment_bytes += (i - lineStart + 1);
+        if(ts_ms < cur_seg_min) cur_seg_min = ts_ms;
+        if(ts_ms > cur_seg_max) cur_seg_max = ts_ms;
+        nowLine++;
+        segSize = 0;
+        lineStart = i + 1;
+        if(i - lineStart > MAX_VALUE_LEN){
+            SysWarning("[WARNING] line length out of bound: %d\n", i - lineStart);
+        }
+        // finalize a segment when exceeding threshold bytes
+        if(current_segment_bytes >= DEFAULT_SEGMENT_BYTES){
+            seg_line_starts.push_back(current_segment_min_line);
+            seg_line_ends.push_back(nowLine - 1);
+            seg_min_ts.push_back(cur_seg_min == LLONG_MAX ? (long long)time(NULL)*1000LL : cur_seg_min);
+            seg_max_ts.push_back(cur_seg_max == LLONG_MIN ? (long long)time(NULL)*1000LL : cur_seg_max);
+            current_segment_min_line = nowLine;
+            current_segment_bytes = 0; cur_seg_min = LLONG_MAX; cur_seg_max = LLONG_MIN;
+        }
+    }
+    if(zip_mode != "Z") printf("Tot Size: %d, Sampler Size: %d\n", nowLine, nowSample);
+
+    int expendTime = sampleRange * 4;
+    parser.BuildIndex();
+    
+    //build varaible_mapping;
+    map<int, VarArray*> variable_mapping;  
+    for(auto &pool:parser.LengthTemplatePool){
+        vector<templateNode*>* nowPool = pool.second;
+        for(auto &temp: *nowPool){
+            //library templates the sampler never saw get their arrays on the first hit
+            if(parser.STC.find(temp->Eid) == parser.STC.end()) continue;
+            for(int i = 0; i < temp->varLength; i++){
+                unsigned int sid = stable_id_from_string(temp->output());
+                int nowTag = ((sid)<<POS_TEMPLATE) | (i<<POS_VAR);
+                variable_mapping[nowTag] = new VarArray(nowTag, parser.STC[temp->Eid] * expendTime);
+            }
+        }
+    }
+    
+
+    if(zip_mode != "Z") parser.TemplatePrint();
+    if(zip_mode != "Z") cout << "start match" << endl;
+	//Streaming processing(match, match again, extract varibales and output)
+	double stime = ___StatTime_End(stime_s);
+
+    timeval mtime_s = ___StatTime_Start();
+    int * Eid = new int[nowLine];
+    
+
+    
+    FailedLines failed;
+    int nowline = 0;
+    matchBufferParallel(mbuf, len, &parser, zip_mode, Eid, failed, variable_mapping, nowline);
+    remineFailed(mbuf, len, &parser, zip_mode, Eid, failed, variable_mapping, nowline);
+    if(template_lib != ""){
+        int libCount = parser.SaveTemplateLibrary(template_lib);
+        if(zip_mode != "Z") printf("Template library saved: %d templates\n", libCount);
+    }
+    
+
+    double mtime = ___StatTime_End(mtime_s);
+///*    
+    Encoder* encoder = new Encoder(cp_mode, zip_mode, compression_level);
+    encoder -> group = group;
+    encoder -> threads = getMatchThreads();
+    encoder -> serializeTemplate(output_path, &parser);
+    encoder -> serializeTemplateOutlier(failed);
+
+    //Here variable strings get, need to split, and 
+	//For each variable, build union -> split -> build sub-pattern
+    string SUBPATTERN = "";
+    int SUBCOUNT = 0;
+    
+    timeval vtime_s = ___StatTime_Start();
+    if(zip_mode != "Z") cout << "start variable process" << endl;
+    encodeVariablesParallel(mbuf, variable_mapping, dict, sub, encoder, SUBPATTERN, SUBCOUNT);
     double vtime = ___StatTime_End(vtime_s);
     
     timeval ctime_s = ___StatTime_Start();
@@ -679,29 +960,32 @@ void proc_buffer(char* buffer, int buffer_len, string output_path, string cp_mod
     
     double ctime = ___StatTime_End(ctime_s);
 	
-    free(Eid);
+    delete encoder;
+    delete [] Eid;
+    delete [] segArray;
     for(auto &temp: variable_mapping){
-        free(temp.second);
+        delete temp.second;
     }
-    if(failLine > 0){
-        for(int i=0;i<failLine;i++){
-            if(failed_log[i]) free(failed_log[i]);
-        }
-    }
-    delete [] failed_num;
-    delete [] failed_log;
 
     if(zip_mode != "Z") printf("stime: %lfs, mtime: %lfs, vtime:%lfs, ctime:%lfs\n", stime, mtime, vtime, ctime);
+    if(pstats){
+        pstats -> stime = stime;
+        pstats -> mtime = mtime;
+        pstats -> vtime = vtime;
+        pstats -> ctime = ctime;
+        pstats -> lines = nowLine;
+        pstats -> samples = nowSample;
+        pstats -> failed = failed.count();
+    }
 //*/
 }
 
 // ./THULR -I /apsarapangu/disk9/LogSeg/Android/0.log -O /apsarapangu/disk9/PillBox_test/Android.zip
-// 函数声明
-void proc_buffer(char* buffer, int buffer_len, string output_path, string cp_mode, string zip_mode, int compression_level, double threashold);
 
 // 提供给Python调用的接口函数
 extern "C" {
-    int compress_from_memory(const char* buffer, int buffer_len, const char* output_path) {
+    //library_path may be NULL, otherwise the template library of the index the output belongs to
+    int compress_from_memory_lib(const char* buffer, int buffer_len, const char* output_path, const char* library_path) {
         if (buffer == NULL || buffer_len <= 0 || output_path == NULL) {
             return -1;
         }
@@ -714,10 +998,229 @@ extern "C" {
             return -2;
         }
         memcpy(data_copy, buffer, buffer_len);
-        proc_buffer(data_copy, buffer_len, string(output_path), cp_mode, zip_mode, compression_level, threashold);
+        string template_lib = (library_path == NULL) ? "" : string(library_path);
+        proc_buffer(data_copy, buffer_len, string(output_path), cp_mode, zip_mode, compression_level, threashold, 0, template_lib);
         free(data_copy);
         return 0;
     }
+
+    int compress_from_memory(const char* buffer, int buffer_len, const char* output_path) {
+        return compress_from_memory_lib(buffer, buffer_len, output_path, NULL);
+    }
+}
+
+/*
+批量压缩: 目录(递归)或文件列表里的每个文件压缩为 <output_dir>/<相对路径>.zip
+同一 source(同一目录下只有数字不同的文件名, 如按日期或序号滚动的日志)的文件按名字顺序在同一个 worker 上依次压缩,
+共享 <template_dir>/<source>.tpl 模板库; 不同 source 并行, 最多 jobs 个, 结果汇总到 <output_dir>/batch_report.json
+*/
+typedef struct BatchFile
+{
+    string input;
+    string output;
+    long long bytes;
+    long long outBytes;
+    double seconds;
+    bool ok;
+}BatchFile;
+
+typedef struct BatchSource
+{
+    string name;
+    string templateLib;
+    long long bytes;
+    vector<BatchFile> files;
+}BatchSource;
+
+static int makeDirs(const string& path){
+    for(size_t p = path.find('/', 1); ; p = path.find('/', p + 1)){
+        string dir = path.substr(0, p);
+        if(mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) return -1;
+        if(p == string::npos) return 0;
+    }
+}
+
+static void listBatchDir(const string& root, const string& rel, vector<string>& out){
+    string dir = (rel == "") ? root : root + "/" + rel;
+    DIR* d = opendir(dir.c_str());
+    if(d == NULL) return;
+    struct dirent* e;
+    vector<string> names;
+    while((e = readdir(d)) != NULL){
+        if(e -> d_name[0] == '.') continue;
+        names.push_back(e -> d_name);
+    }
+    closedir(d);
+    sort(names.begin(), names.end());
+    for(auto &name: names){
+        string r = (rel == "") ? name : rel + "/" + name;
+        struct stat st;
+        if(stat((root + "/" + r).c_str(), &st) != 0) continue;
+        if(S_ISDIR(st.st_mode)) listBatchDir(root, r, out);
+        else if(S_ISREG(st.st_mode) && st.st_size > 0) out.push_back(r);
+    }
+}
+
+//directory plus the file name without its digits: app-2023-08-01.log and app-2023-08-02.log are one source
+static string batchSourceKey(const string& rel){
+    size_t slash = rel.rfind('/');
+    string key = (slash == string::npos) ? "" : rel.substr(0, slash + 1);
+    for(size_t i = (slash == string::npos) ? 0 : slash + 1; i < rel.size(); i++){
+        if(!isdigit((unsigned char)rel[i])) key += rel[i];
+    }
+    return key;
+}
+
+static string batchJson(const string& s){
+    string out;
+    for(char c: s){
+        if(c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+static void batchWorker(vector<BatchSource*>* sources, atomic<int>* next, string cp_mode, string zip_mode, int compression_level, double threashold){
+    while(true){
+        int k = (*next)++;
+        if(k >= (int)sources -> size()) break;
+        BatchSource* src = (*sources)[k];
+        for(auto &f: src -> files){
+            remove(f.output.c_str());
+            timeval t = ___StatTime_Start();
+            proc(f.input, f.output, cp_mode, zip_mode, compression_level, threashold, src -> templateLib);
+            f.seconds = ___StatTime_End(t);
+            struct stat st;
+            f.ok = stat(f.output.c_str(), &st) == 0 && st.st_size > 0;
+            f.outBytes = f.ok ? st.st_size : 0;
+        }
+    }
+}
+
+//returns the number of failed files, -1 when there is nothing to compress
+int proc_batch(string input, bool is_list, string output_dir, string cp_mode, string zip_mode, int compression_level, double threashold, string template_dir, int jobs){
+    vector<string> inputs, rels;
+    if(is_list){
+        ifstream fin(input.c_str());
+        if(!fin){
+            SysWarning("open file list %s failed\n", input.c_str());
+            return -1;
+        }
+        string line;
+        while(getline(fin, line)){
+            while(!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+            if(line.empty() || line[0] == '#') continue;
+            //the whole path minus its leading /, ./ and ../, so /a/x/app.log and /b/x/app.log stay apart
+            inputs.push_back(line);
+            rels.push_back(line);
+            string& rel = rels.back();
+            while(rel.compare(0, 1, "/") == 0 || rel.compare(0, 2, "./") == 0 || rel.compare(0, 3, "../") == 0) rel = rel.substr(rel.find('/') + 1);
+        }
+    }else{
+        listBatchDir(input, "", rels);
+        for(auto &r: rels) inputs.push_back(input + "/" + r);
+    }
+    if(inputs.empty()){
+        SysWarning("batch: no input files under %s\n", input.c_str());
+        return -1;
+    }
+    //../a/x.log and ../../a/x.log still map to one archive, refuse before anything is written
+    map<string, string> seen;
+    for(size_t i = 0; i < rels.size(); i++){
+        auto it = seen.find(rels[i]);
+        if(it != seen.end()){
+            SysWarning("batch: %s and %s both compress to %s.zip\n", it -> second.c_str(), inputs[i].c_str(), rels[i].c_str());
+            return -1;
+        }
+        seen[rels[i]] = inputs[i];
+    }
+    if(template_dir == "") template_dir = output_dir;
+    if(makeDirs(output_dir) != 0 || makeDirs(template_dir) != 0){
+        SysWarning("batch: create %s failed\n", output_dir.c_str());
+        return -1;
+    }
+
+    map<string, BatchSource*> byKey;
+    for(size_t i = 0; i < inputs.size(); i++){
+        struct stat st;
+        if(stat(inputs[i].c_str(), &st) != 0 || !S_ISREG(st.st_mode)){
+            SysWarning("batch: skip %s\n", inputs[i].c_str());
+            continue;
+        }
+        string key = batchSourceKey(rels[i]);
+        BatchSource* src = byKey[key];
+        if(src == NULL){
+            src = new BatchSource();
+            src -> name = key;
+            string lib = key;
+            replace(lib.begin(), lib.end(), '/', '_');
+            src -> templateLib = template_dir + "/" + lib + ".tpl";
+            src -> bytes = 0;
+            byKey[key] = src;
+        }
+        BatchFile f;
+        f.input = inputs[i];
+        f.output = output_dir + "/" + rels[i] + ".zip";
+        f.bytes = st.st_size;
+        f.outBytes = 0;
+        f.seconds = 0;
+        f.ok = false;
+        size_t slash = f.output.rfind('/');
+        if(makeDirs(f.output.substr(0, slash)) != 0) SysWarning("batch: create directory for %s failed\n", f.output.c_str());
+        src -> files.push_back(f);
+        src -> bytes += f.bytes;
+    }
+    //largest source first, the pool then ends with the short ones
+    vector<BatchSource*> sources;
+    for(auto &it: byKey) sources.push_back(it.second);
+    stable_sort(sources.begin(), sources.end(), [](const BatchSource* a, const BatchSource* b){ return a -> bytes > b -> bytes; });
+
+    int cores = getMatchThreads();
+    if(jobs <= 0) jobs = cores;
+    jobs = max(1, min(jobs, (int)sources.size()));
+    batchJobThreads = max(1, cores / jobs);
+    printf("batch: %d files, %d sources, %d jobs x %d threads\n", (int)inputs.size(), (int)sources.size(), jobs, batchJobThreads);
+
+    timeval t = ___StatTime_Start();
+    atomic<int> next(0);
+    vector<thread> workers;
+    for(int j = 0; j < jobs; j++){
+        workers.push_back(thread(batchWorker, &sources, &next, cp_mode, zip_mode, compression_level, threashold));
+    }
+    for(auto &w: workers) w.join();
+    double wall = ___StatTime_End(t);
+    batchJobThreads = 0;
+
+    long long inBytes = 0, outBytes = 0;
+    int files = 0, failed = 0;
+    string runs = "";
+    char buf[256];
+    for(auto &src: sources){
+        for(auto &f: src -> files){
+            files++;
+            inBytes += f.bytes;
+            outBytes += f.outBytes;
+            if(!f.ok){
+                failed++;
+                SysWarning("batch: %s failed\n", f.input.c_str());
+            }
+            snprintf(buf, sizeof(buf), ", \"bytes\": %lld, \"out_bytes\": %lld, \"seconds\": %.4f, \"ok\": %d}", f.bytes, f.outBytes, f.seconds, f.ok ? 1 : 0);
+            if(runs != "") runs += ",\n";
+            runs += "  {\"input\": \"" + batchJson(f.input) + "\", \"output\": \"" + batchJson(f.output) + "\", \"source\": \"" + batchJson(src -> name) + "\"" + buf;
+        }
+        delete src;
+    }
+    string report = output_dir + "/batch_report.json";
+    FILE* fo = fopen(report.c_str(), "w");
+    if(fo == NULL){
+        SysWarning("batch: open %s failed\n", report.c_str());
+    }else{
+        fprintf(fo, "{\"files\": %d, \"failed\": %d, \"sources\": %d, \"jobs\": %d, \"bytes\": %lld, \"out_bytes\": %lld, \"ratio\": %.4f, \"seconds\": %.4f, \"mbs\": %.4f, \"runs\": [\n%s\n]}\n",
+            files, failed, (int)sources.size(), jobs, inBytes, outBytes, outBytes > 0 ? (double)inBytes / outBytes : 0.0, wall, wall > 0 ? inBytes / 1e6 / wall : 0.0, runs.c_str());
+        fclose(fo);
+    }
+    printf("batch: %d files, %d failed, %lld -> %lld bytes in %.2fs, report %s\n", files, failed, inBytes, outBytes, wall, report.c_str());
+    return failed;
 }
 
 #ifndef LOGGREP_NO_MAIN
@@ -725,17 +1228,17 @@ int main(int argc, char *argv[]){
 //TODO:
 //1. Fix parser bugs
 //2. Integrate compression methods
-//3. Batch small files
 
 	// clock_t start = clock();
 	int o;
-	const char *optstring = "HhI:O:C:Z:L:B";
-	srand(4);
+	const char *optstring = "HhI:O:T:C:Z:L:BW:D:F:P:";
 	//Input Content
-	string input_path; string output_path;
+	string input_path; string output_path; string template_lib;
     string cp_mode, zip_mode;
     int compression_level = 1;
     bool from_stdin = false;
+    long long window_bytes = 0; //>0: streaming mode
+    string batch_input; bool batch_list = false; int batch_jobs = 0;
     //Input A.log -> A.zip
 	while ((o = getopt(argc, argv, optstring)) != -1)
 	{
@@ -750,6 +1253,10 @@ int main(int argc, char *argv[]){
 			output_path = optarg;
 			printf("output path : %s\n", output_path.c_str());
 			break;
+        case 'T':
+            template_lib = optarg;
+            printf("template library path: %s\n", template_lib.c_str());
+            break;
         case 'C':
             cp_mode = optarg;
             printf("Compression Mode(Lzma, Zstd): %s\n", cp_mode.c_str());
@@ -766,15 +1273,33 @@ int main(int argc, char *argv[]){
             from_stdin = true;
             printf("Reading from standard input\n");
             break;
+        case 'W':
+            window_bytes = atoll(optarg) * 1024 * 1024;
+            printf("Streaming window(MB): %s\n", optarg);
+            break;
+        case 'D':
+        case 'F':
+            batch_input = optarg;
+            batch_list = (o == 'F');
+            printf("batch %s: %s\n", batch_list ? "file list" : "directory", batch_input.c_str());
+            break;
+        case 'P':
+            batch_jobs = atoi(optarg);
+            printf("batch jobs: %d\n", batch_jobs);
+            break;
         case 'h':
 		case 'H':
 			printf("-I input path\n");
 			printf("-O output path\n");
-			printf("-T template path\n");
+			printf("-T template library path, loaded before and updated after compression\n");
 			printf("-C compression methods(Zstd or Lzma)\n");
 			printf("-L compression_level\n");
 			printf("-Z compression_mode\n");
 			printf("-B read from standard input\n");
+			printf("-W streaming window size in MB, at most 1024, bounds memory for large inputs\n");
+			printf("-D batch: compress every file under a directory, -O is the output directory\n");
+			printf("-F batch: compress the files listed one per line in a file, each archive keeps the full path of its file under -O\n");
+			printf("-P batch: parallel jobs, files of one source share the template library in -T (a directory) or -O\n");
             return 0;
 			break;
 		case '?':
@@ -786,7 +1311,7 @@ int main(int argc, char *argv[]){
 	}
 	
 	//Basic input check
-	if (input_path == "" && !from_stdin){
+	if (input_path == "" && !from_stdin && batch_input == ""){
 		printf("error : No input file and not reading from stdin\n");
 		return -1;
 	}
@@ -800,11 +1325,26 @@ int main(int argc, char *argv[]){
         cp_mode = "Zstd";
     }
     if(zip_mode == ""){
-        zip_mode = "O"; 
+        zip_mode = (batch_input != "") ? "Z" : "O"; //batch jobs print over each other, keep them quiet
     }
     double threashold = 0.5;
     
-    if (from_stdin) {
+    if (batch_input != "") {
+        int failed = proc_batch(batch_input, batch_list, output_path, cp_mode, zip_mode, compression_level, threashold, template_lib, batch_jobs);
+        return (failed == 0) ? 0 : 1;
+    } else if (window_bytes > 0) {
+        // 流式处理, 内存占用由窗口大小决定
+        FILE* fin = from_stdin ? stdin : fopen(input_path.c_str(), "rb");
+        if (fin == NULL) {
+            printf("Open input file failed\n");
+            return -1;
+        }
+        int groups = proc_stream(fin, output_path, cp_mode, zip_mode, compression_level, threashold, window_bytes, template_lib);
+        if (fin != stdin) fclose(fin);
+        if (groups == 0) {
+            printf("No data read from input\n");
+        }
+    } else if (from_stdin) {
         // 从标准输入读取数据
         const int BUFFER_SIZE = 1024 * 1024; // 1MB 初始缓冲区
         char* buffer = (char*)malloc(BUFFER_SIZE);
@@ -834,7 +1374,7 @@ int main(int argc, char *argv[]){
         
         if (total_size > 0) {
             // 处理从标准输入读取的数据
-            proc_buffer(buffer, total_size, output_path, cp_mode, zip_mode, compression_level, threashold);
+            proc_buffer(buffer, total_size, output_path, cp_mode, zip_mode, compression_level, threashold, 0, template_lib);
         } else {
             printf("No data read from standard input\n");
         }
@@ -842,7 +1382,7 @@ int main(int argc, char *argv[]){
         free(buffer);
     } else {
         // 从文件读取数据
-        proc(input_path, output_path, cp_mode, zip_mode, compression_level, threashold);
+        proc(input_path, output_path, cp_mode, zip_mode, compression_level, threashold, template_lib);
     }
 }
 #endif
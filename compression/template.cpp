@@ -22,22 +22,27 @@ templateNode::templateNode(int eid, char* log, SegTag segArray[MAXTOCKEN], int t
     length = token_size;
     templates = new char* [length];
     templatesTags = new int[length];
+    templatesLen = new int[length];
 	varLength = 0;
+    frozen = false;
     for (int i = 0;i < length;i++){
         int now_segLen = segArray[i].segLen;
         templates[i]= new char[now_segLen+1];
         strncpy(templates[i], log + segArray[i].startPos, now_segLen);
         templates[i][now_segLen] = '\0';
         templatesTags[i] = segArray[i].tag;
+        templatesLen[i] = now_segLen;
     }
 }
 
 templateNode::~templateNode(){
 	//cout<<"distruction templates:"<<Eid<<endl;
     for(int i = 0; i < length; i++){
-        free(templates[i]);
+        delete [] templates[i];
     }
-    free(templates);
+    delete [] templates;
+    delete [] templatesTags;
+    delete [] templatesLen;
 }
 
 //the match function foe match,need length
@@ -60,7 +65,7 @@ int templateNode::matchMatch(char* tockens, SegTag segArray[MAXTOCKEN], int tock
         temp = tockens + segArray[i].startPos;
         int lastIndex = segArray[i].segLen-1;
         //优先检查长度和首尾两个字符
-        int tLen = strlen(templates[i]);
+        int tLen = templatesLen[i];
         if(
         segArray[i].segLen != tLen ||
         temp[lastIndex] != templates[i][lastIndex] || 
@@ -97,7 +102,7 @@ double templateNode::parseMatch(char* log, SegTag segArray[MAXTOCKEN], int token
             sim++;
             continue;
         }
-        int tLen = strlen(templates[i]);
+        int tLen = templatesLen[i];
         if (tLen != segArray[i].segLen){ //Different length no similarity++
             tot_size++;
             continue;
@@ -128,8 +133,13 @@ void templateNode::merge(char* log, SegTag segArray[MAXTOCKEN], int token_size){
         if (strncmp(log + segArray[i].startPos, templates[i], segArray[i].segLen) != 0){
             //printf("Find differenet\n");
             string temp = "<*>";
+            if(templatesLen[i] < (int)temp.size()){ //token buffer too short for "<*>"
+                delete [] templates[i];
+                templates[i] = new char[temp.size() + 1];
+            }
             strcpy(templates[i], temp.c_str());
             templatesTags[i] = 2;//2代表变量
+            templatesLen[i] = temp.size();
             varLength++;
             varIndex.push_back(i);
         }
@@ -148,6 +158,7 @@ void templateNode::initPara(){
 		    varLength++;
         	varIndex.push_back(i);
             templatesTags[i]=2;//2代表变量
+            templatesLen[i]=3;
 		}
 	}
 }
@@ -21,9 +21,11 @@ public:
 	int Eid;
     char ** templates;
     int* templatesTags;
+    int* templatesLen;//cached strlen of templates
     int length;
 	int varLength;
 	vector<int> varIndex;
+    bool frozen;//loaded from the template library: only exact hits, never merged
     int delimBitmap[128];
     //constructor, need Eid, tokens,and length
     templateNode(int Eid, char* log, SegTag segArray[MAXTOCKEN], int token_size);
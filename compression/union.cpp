@@ -10,6 +10,71 @@
 #include<ctype.h>
 #include<algorithm>
 using namespace std;
+
+static thread_local unsigned int union_seed = 1;
+
+void union_srand(unsigned int seed){
+    union_seed = seed;
+}
+
+static inline int union_rand(){
+    return rand_r(&union_seed);
+}
+DicTable::DicTable(){
+    count = 0;
+    mask = 0;
+}
+
+void DicTable::reserve(int n){
+    unsigned int cap = 16;
+    while(cap < (unsigned int)n * 2) cap <<= 1;
+    if(cap <= slots.size()) return;
+    vector<DicSlot> old;
+    old.swap(slots);
+    DicSlot empty = {0, -1, -1};
+    slots.assign(cap, empty);
+    mask = cap - 1;
+    count = 0;
+    bool inserted;
+    for(auto &o: old){
+        if(o.pos < 0) continue;
+        DicSlot* s = insert(o.hash, o.pos, inserted);
+        s -> entry = o.entry;
+    }
+}
+
+void DicTable::grow(){
+    reserve(slots.empty() ? 8 : (int)slots.size());
+}
+
+DicSlot* DicTable::find(unsigned int hash){
+    if(slots.empty()) return NULL;
+    for(unsigned int i = (hash * 0x9E3779B1u) & mask; ; i = (i + 1) & mask){
+        DicSlot* s = &slots[i];
+        if(s -> pos < 0) return NULL;
+        if(s -> hash == hash) return s;
+    }
+}
+
+DicSlot* DicTable::insert(unsigned int hash, int pos, bool& inserted){
+    if((unsigned int)(count + 1) * 2 > slots.size()) grow();
+    for(unsigned int i = (hash * 0x9E3779B1u) & mask; ; i = (i + 1) & mask){
+        DicSlot* s = &slots[i];
+        if(s -> pos < 0){
+            s -> hash = hash;
+            s -> entry = -1;
+            s -> pos = pos;
+            count++;
+            inserted = true;
+            return s;
+        }
+        if(s -> hash == hash){
+            inserted = false;
+            return s;
+        }
+    }
+}
+
 Union::Union(char* globuf, VarArray* varMapping, double _rate){ //Start construct
     globalMem = globuf;
     _tot = varMapping ->nowPos;
@@ -21,19 +86,18 @@ Union::Union(char* globuf, VarArray* varMapping, double _rate){ //Start construc
     HashValue = new unsigned int[_tot];
     UniquePos = new unsigned int[_tot];
     int nowIdx = 0;
+    bool inserted;
+    dictionary.reserve(min(_tot, 1024));
     for(int i=0; i< _tot; i++){   
         if(dictionary.size() < _tot * uniqueRate){
             int varLen = varMapping->len[i];
             unsigned int hashValue = _stringHash_(globalMem + varMapping->startPos[i], varLen);
             HashValue[i] = hashValue;
-            if(dictionary.find(hashValue) == dictionary.end()){
-                UniquePos[nowIdx++] = i;
-                dictionary.insert(pair<unsigned int, int>(hashValue, -1));
-                posDictionary.insert(pair<unsigned int, int>(hashValue, i));
-            }
+            dictionary.insert(hashValue, i, inserted);
+            if(inserted) UniquePos[nowIdx++] = i;
         }
         //cout << "remaining: " << remaining << " select: " << select << endl;
-        if (rand() % remaining < select && nowSize < select){
+        if (union_rand() % remaining < select && nowSize < select){
             int varLen = varMapping ->len[i];
             char* buffer =  new char[varLen + 1];
             strncpy(buffer, globalMem + varMapping ->startPos[i], varLen);
@@ -60,6 +124,8 @@ Union::Union(char* globuf, VarArray* varMapping, double _rate){ //Start construc
 
 Union::Union(char** _data, int _num, int _type, int _tot, set<int> _outlier){ //Split construct
     data = _data;
+    HashValue = NULL;
+    UniquePos = NULL;
     num = _num;
     type = _type;
     tot = _tot;
@@ -256,7 +322,7 @@ void Union::buildMapping(VarArray* varMapping){
         for(int t = 0; t < tot; t++){
             int nowUniquePos = UniquePos[t];
             if(Formats[t] == nowHash){
-                dictionary[HashValue[nowUniquePos]] = dicEntry++;
+                dictionary.find(HashValue[nowUniquePos]) -> entry = dicEntry++;
                 nowPaddingSize[i] = max(nowPaddingSize[i], varMapping->len[nowUniquePos]);
             }
         }
@@ -272,11 +338,12 @@ void Union::buildMapping(VarArray* varMapping){
     nowCounter[finalIdx] = 0;
     for(int i = 0; i < tot; i++){
         int nowUniquePos = UniquePos[i];
-        if(dictionary[HashValue[nowUniquePos]] == -1){
+        DicSlot* slot = dictionary.find(HashValue[nowUniquePos]);
+        if(slot -> entry == -1){
             finalType |= getType(globalMem + varMapping->startPos[nowUniquePos], varMapping->len[nowUniquePos]);
             nowCounter[finalIdx]++;
             nowPaddingSize[finalIdx] = max(nowPaddingSize[finalIdx], varMapping->len[nowUniquePos]);
-            dictionary[HashValue[nowUniquePos]] = dicEntry++;
+            slot -> entry = dicEntry++;
         }
     }
     
@@ -284,21 +351,17 @@ void Union::buildMapping(VarArray* varMapping){
     //printf("end build mapping\n");
 }
 
-vector<pair<unsigned int, int> >* Union::getContainer(){
-    vector<pair<unsigned int, int> >* container = new vector<pair<unsigned int, int> >(dictionary.begin(), dictionary.end());
-    sort(container -> begin(), container -> end(), rpairCmp);
+vector<pair<int, int> >* Union::getContainer(){
+    vector<pair<int, int> >* container = new vector<pair<int, int> >();
+    container -> reserve(dictionary.size());
+    dictionary.forEach([&](DicSlot& s){ container -> push_back(make_pair(s.entry, s.pos)); });
+    sort(container -> begin(), container -> end());
     return container;
 }
 
-bool Union::pairCmp (pair<unsigned int, int> t1, pair<unsigned int, int> t2){
-    return (t1.second > t2.second);
-}
 bool Union::formatCmp (pair<string, int> t1, pair<string, int> t2){
     return (t1.second > t2.second);
 }
-bool Union::rpairCmp (pair<unsigned int, int> t1, pair<unsigned int, int> t2){
-    return (t1.second < t2.second);
-}
 bool Union::unionCmp(Union& u1, Union& u2){
     if(u1.type < 0 && u2.type >= 0) return true;
     if(u2.type < 0 && u1.type >= 0) return false;
@@ -309,18 +372,15 @@ bool Union::unionCmp(Union& u1, Union& u2){
 // }
 string Union::outputDic(VarArray* varMapping){
     string temp = "";
-    vector<pair<unsigned int, int> > container;
-    for(map<unsigned int, int >:: iterator it = dictionary.begin(); it != dictionary.end(); it++){
-        container.push_back(make_pair(it ->first, it ->second));
-    }
-    sort(container.begin(), container.end(), pairCmp);
+    vector<pair<int, int> >* container = getContainer();
     char buf[MAX_VALUE_LEN];
-    for(vector<pair<unsigned int, int> >::iterator it = container.begin(); it != container.end(); it++){
-        int Pos = posDictionary[it -> first];
+    for(vector<pair<int, int> >::reverse_iterator it = container -> rbegin(); it != container -> rend(); it++){
+        int Pos = it -> second;
         strncpy(buf, globalMem + varMapping->startPos[Pos], varMapping->len[Pos]);
         buf[varMapping->len[Pos]] = '\0';
         temp += string(buf) + "\n";
     }
+    delete container;
     return temp;
 }
 void Union::output(){
@@ -342,11 +402,11 @@ int Union::split (Union** tree, int nowEnd){
     while(trial--){
         
         //Select random element
-        int pivot_idx = rand() % tot;
+        int pivot_idx = union_rand() % tot;
         int totrand = 0;
         bool block = false;
         while(outlier.find(pivot_idx) != outlier.end()){
-            pivot_idx = rand() % tot;
+            pivot_idx = union_rand() % tot;
             if(totrand++ > 10){
                 block = true;
                 break;
@@ -408,9 +468,9 @@ int Union::split (Union** tree, int nowEnd){
         //cout << "test LCS" << endl;
         //test LCS(find another string)
         //Success -> matchLCS -> split success
-        pivot_idx = rand() % tot;
+        pivot_idx = union_rand() % tot;
         
-        while(outlier.find(pivot_idx) != outlier.end()) pivot_idx = rand() % tot;
+        while(outlier.find(pivot_idx) != outlier.end()) pivot_idx = union_rand() % tot;
         char* pivot2 = data[pivot_idx];
         char* LCS = getLCS(pivot, pivot2);
         //cout << "Start to test pivot: " << pivot << " pivot2: " << pivot2 << " LCS: " << LCS << endl;
@@ -7,6 +7,30 @@
 #include"constant.h"
 using namespace std;
 
+//Dictionary slot: hash of a value, its dictionary entry (-1 until numbered) and its first row
+typedef struct DicSlot
+{
+    unsigned int hash;
+    int entry;
+    int pos;
+}DicSlot;
+
+//Flat open-addressing table keyed by value hash, rows point into the VarArray storage
+class DicTable{
+public:
+    DicTable();
+    int size() const { return count; }
+    void reserve(int n);
+    DicSlot* find(unsigned int hash); //NULL if absent
+    DicSlot* insert(unsigned int hash, int pos, bool& inserted); //existing slot, or a new one with entry -1
+    template<class F> void forEach(F f){ for(auto &s: slots) if(s.pos >= 0) f(s); }
+private:
+    vector<DicSlot> slots;
+    int count;
+    unsigned int mask;
+    void grow();
+};
+
 class Union{
 public:
     int num; //The # of union
@@ -23,9 +47,7 @@ private:
     char** data;
 
 
-    static bool pairCmp(pair<unsigned int, int> t1, pair<unsigned int, int> t2);
     static bool formatCmp(pair<string, int> t1, pair<string, int> t2);
-    static bool rpairCmp(pair<unsigned int, int> t1, pair<unsigned int, int> t2);
    // int getHex();
 
     //char* getFormat(char* target);
@@ -59,11 +81,10 @@ public:
     
     static bool unionCmp(Union& u1, Union& u2);
     
-    vector<pair<unsigned int, int> >* getContainer();
+    vector<pair<int, int> >* getContainer(); //(entry, first row) ordered by entry
 
     //Dictioanry 
-    map<unsigned int, int> dictionary;
-    map<unsigned int, int> posDictionary;
+    DicTable dictionary;
     map<string, int> format_counter;
 
     int dicMax;
@@ -88,4 +109,8 @@ public:
     bool execute(Union** tree, int nowStart, int& nowEnd); // 1) try to split, 2) if can not split, fix type
     void output();
 };
+
+//Union sampling draws from a per-thread generator, seed it before building a variable
+//so the result does not depend on which thread (or in which order) variables are encoded
+void union_srand(unsigned int seed);
 #endif 
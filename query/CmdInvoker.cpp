@@ -224,7 +224,7 @@ void CmdInvoker::DoInvokeCmd(char *args[MAX_CMD_ARG_COUNT], int argCount)
 void CmdInvoker::DoInvokeCmd_ForTest(char* path, char *args[MAX_CMD_ARG_COUNT], int argCount)
 {
 	//ProfilerStart("test_capture.prof");
-	m_logDisp->Connect(path);
+	m_logDisp->Connect(path, args, argCount);
 	m_logDisp->SearchByWildcard(args, argCount);
 	//ProfilerStop();
 }
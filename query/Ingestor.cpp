@@ -1,13 +1,14 @@
 #include "Ingestor.h"
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <mutex>
-extern "C" int compress_from_memory(const char* buffer, int buffer_len, const char* output_path);
+extern "C" int compress_from_memory_lib(const char* buffer, int buffer_len, const char* output_path, const char* library_path);
 #include <string>
 #include <sys/stat.h>
 #include <cstdio>
@@ -16,7 +17,8 @@ extern "C" int compress_from_memory(const char* buffer, int buffer_len, const ch
 #include <limits>
 #include <fstream>
 #ifdef LOGGREP_LOCAL_STUB
-extern "C" int compress_from_memory(const char* buffer, int buffer_len, const char* output_path){
+extern "C" int compress_from_memory_lib(const char* buffer, int buffer_len, const char* output_path, const char* library_path){
+    (void)library_path;
     FILE* f = fopen(output_path, "w");
     if(!f) return -1;
     size_t w = fwrite(buffer, 1, (size_t)buffer_len, f);
@@ -51,6 +53,15 @@ static std::string join_path(const std::string& a, const std::string& b){
     return a + std::string("/") + b;
 }
 
+// segments of one index share templates.lib, so template ids stay stable across flushes
+// LOGGREP_TEMPLATE_LIB=0 learns every segment from scratch
+static int compress_segment(const std::string& dir, const std::string& buf, const std::string& fpath){
+    const char* v = getenv("LOGGREP_TEMPLATE_LIB");
+    bool use_lib = !(v && strcmp(v, "0")==0);
+    std::string lib = join_path(dir, std::string("templates.lib"));
+    return compress_from_memory_lib(buf.c_str(), (int)buf.size(), fpath.c_str(), use_lib ? lib.c_str() : nullptr);
+}
+
 static uint32_t crc32_calc(const char* data, size_t len){
     uint32_t crc = 0xFFFFFFFFu;
     for(size_t i=0;i<len;i++){
@@ -99,6 +110,7 @@ RollingWriter::RollingWriter(const std::string& dir)
     v=getenv("LOGGREP_MAX_DISK_BYTES"); if(v){ size_t x=parse_size_bytes(v); if(x>0) m_max_disk_bytes=x; }
     v=getenv("LOGGREP_WAL_FSYNC"); if(v){ int x=atoi(v); m_fsync_wal = (x>0); }
     ensure_dir();
+    m_manifest.Open(m_dir);
     open_new_wal();
     load_existing_segments();
     m_flusher = std::thread([this](){ this->bg_worker(); });
@@ -143,10 +155,11 @@ int RollingWriter::bulk_append(const std::vector<std::string>& lines, std::strin
     long long start_ms = m_start_ms==0? now : m_start_ms;
     long long end_ms = now;
     uint32_t crc = crc32_calc(m_buf.c_str(), m_buf.size());
-    int rc = compress_from_memory(m_buf.c_str(), (int)m_buf.size(), fpath.c_str());
+    int rc = compress_segment(m_dir, m_buf, fpath);
     if(rc==0){
         m_segments.push_back(fpath);
         struct stat stsz; if(stat(fpath.c_str(), &stsz)==0){ m_segments_bytes += (size_t)stsz.st_size; }
+        manifest_add(fpath, start_ms);
         m_buf.clear();
         m_bytes = 0;
         m_records = 0;
@@ -176,6 +189,7 @@ int RollingWriter::bulk_append(const std::vector<std::string>& lines, std::strin
             m_segments.pop_front();
             struct stat stod; if(stat(old.c_str(), &stod)==0){ size_t osz=(size_t)stod.st_size; if(m_segments_bytes>=osz) m_segments_bytes -= osz; }
             unlink(old.c_str());
+            manifest_drop(old);
         }
     }
     return (int)lines.size();
@@ -195,10 +209,11 @@ int RollingWriter::flush(std::string& out_segment){
     long long start_ms = m_start_ms==0? now : m_start_ms;
     long long end_ms = now;
     uint32_t crc = crc32_calc(m_buf.c_str(), m_buf.size());
-    int rc = compress_from_memory(m_buf.c_str(), (int)m_buf.size(), fpath.c_str());
+    int rc = compress_segment(m_dir, m_buf, fpath);
     if(rc==0){
         m_segments.push_back(fpath);
         struct stat stsz; if(stat(fpath.c_str(), &stsz)==0){ m_segments_bytes += (size_t)stsz.st_size; }
+        manifest_add(fpath, start_ms);
         m_buf.clear();
         m_bytes = 0;
         m_records = 0;
@@ -227,11 +242,25 @@ int RollingWriter::flush(std::string& out_segment){
             m_segments.pop_front();
             struct stat stod; if(stat(old.c_str(), &stod)==0){ size_t osz=(size_t)stod.st_size; if(m_segments_bytes>=osz) m_segments_bytes -= osz; }
             unlink(old.c_str());
+            manifest_drop(old);
         }
     }
     return prev_records;
 }
 
+// segments.manifest record of a flushed segment; lines without a timestamp get the compressor's
+// time(NULL), somewhere between the start of the second of start_ms and now
+void RollingWriter::manifest_add(const std::string& fpath, long long start_ms){
+    SegmentEntry e;
+    segment_summarize(fpath, m_buf.data(), m_buf.size(), start_ms / 1000 * 1000, now_ms(), e);
+    m_manifest.Append(e);
+}
+
+void RollingWriter::manifest_drop(const std::string& fpath){
+    size_t slash = fpath.rfind('/');
+    m_manifest.Drop(slash==std::string::npos ? fpath : fpath.substr(slash+1));
+}
+
 RollingWriter::~RollingWriter(){ m_stop.store(true); if(m_flusher.joinable()) m_flusher.join(); }
 
 void RollingWriter::bg_worker(){
@@ -302,6 +331,7 @@ void RollingWriter::load_existing_segments(){
         m_segments.pop_front();
         struct stat stod; if(stat(old.c_str(), &stod)==0){ size_t osz=(size_t)stod.st_size; if(m_segments_bytes>=osz) m_segments_bytes -= osz; }
         unlink(old.c_str());
+        manifest_drop(old);
     }
 }
 
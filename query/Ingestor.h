@@ -9,6 +9,7 @@
 #include <condition_variable>
 #include <sys/stat.h>
 #include <unistd.h>
+#include "SegmentManifest.h"
 
 class RollingWriter {
 private:
@@ -33,6 +34,7 @@ private:
     std::thread m_flusher;
     std::atomic<bool> m_stop;
     std::condition_variable m_cv;
+    SegmentManifest m_manifest;
     void bg_worker();
     long long now_ms();
     void ensure_dir();
@@ -40,6 +42,8 @@ private:
     void fsync_wal();
     void load_existing_segments();
     void load_index_config();
+    void manifest_add(const std::string& fpath, long long start_ms);
+    void manifest_drop(const std::string& fpath);
 public:
     RollingWriter(const std::string& dir);
     ~RollingWriter();
@@ -1,6 +1,7 @@
 #include <fstream>
 #include <cstring> 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -11,6 +12,7 @@
 #include "var_alias.h"
 #include "StatisticsAPI.h"
 #include "HLL.h"
+#include "SegmentManifest.h"
 #include <map>
 #include <vector>
 #include <climits>
@@ -36,6 +38,13 @@ LogDispatcher::~LogDispatcher()
 }
 
 int LogDispatcher::Connect(char* dirPath)
+{
+	return Connect(dirPath, NULL, 0);
+}
+
+//with the query args, segments.manifest drops segments outside its -time range or missing one of its
+//literals before their archives are opened; LOGGREP_MANIFEST=0 opens everything
+int LogDispatcher::Connect(char* dirPath, char *args[MAX_CMD_ARG_COUNT], int argCount)
 {
     DIR *d;
     struct dirent *file;
@@ -50,13 +59,27 @@ int LogDispatcher::Connect(char* dirPath)
     }
 	int loadNum =0;
 	int totalFilesNum =0;
+	int prunedNum =0;
 	m_fileCnt =0;
+	SegmentFilter filter;
+	SegmentManifest manifest;
+	const char* mv = getenv("LOGGREP_MANIFEST");
+	bool prune = !(mv && atoi(mv) == 0) && args != NULL && filter.Build(args, argCount) > 0 && manifest.Load(dirPath) > 0;
     auto has_suffix = [](const char* name, const char* suf){ size_t ln=strlen(name); size_t ls=strlen(suf); if(ls>ln) return false; return strncmp(name+ln-ls, suf, ls)==0; };
     while((file = readdir(d)) != NULL)
     {
         if(strncmp(file->d_name, ".", 1) == 0 || strlen(file->d_name) < 3) continue;
         if(!(has_suffix(file->d_name, ".zip"))) continue;
         if(has_suffix(file->d_name, ".zip.meta") || has_suffix(file->d_name, ".zip.variables") || has_suffix(file->d_name, ".zip.templates")) continue;
+        if(prune)
+        {
+            const SegmentEntry* seg = manifest.Find(file->d_name);
+            if(seg && !filter.Keep(*seg))
+            {
+                prunedNum++;
+                continue;
+            }
+        }
         SyslogDebug("%s %s\n", dirPath, file->d_name);
         
         LogStoreApi* logStore = new LogStoreApi();
@@ -66,6 +89,24 @@ int LogDispatcher::Connect(char* dirPath)
 			m_nServerHandle = 1;
 			m_logStores[m_fileCnt++] = logStore;
 			SyslogDebug("%d --load patterns success,load num:%d, path:%s/%s.\n", m_fileCnt-1, loadNum, dirPath, file->d_name);
+			//streamed archives hold several capsule groups back to back
+			char groupPath[MAX_FILE_NAMELEN] = {'\0'};
+			snprintf(groupPath, MAX_FILE_NAMELEN, "%s/%s", dirPath, file->d_name);
+			struct stat st;
+			long long fileSize = (stat(groupPath, &st) == 0) ? (long long)st.st_size : 0;
+			long long nextGroup = logStore->GetGroupEnd();
+			while(nextGroup > 0 && nextGroup < fileSize && m_fileCnt < MAX_FILE_CNT)
+			{
+				LogStoreApi* groupStore = new LogStoreApi();
+				if(groupStore->Connect(dirPath, file->d_name, nextGroup) <= 0)
+				{
+					SyslogError("path:%s/%s group at %lld load failed, skipped already!\n", dirPath, file->d_name, nextGroup);
+					delete groupStore;
+					break;
+				}
+				m_logStores[m_fileCnt++] = groupStore;
+				nextGroup = groupStore->GetGroupEnd();
+			}
 		}
 		else
 		{
@@ -74,12 +115,21 @@ int LogDispatcher::Connect(char* dirPath)
 		totalFilesNum++;
     }
     closedir(d);
-	if(m_nServerHandle == 0)
+	if(m_nServerHandle == 0 && prunedNum == 0)
 	{
 		SyslogError("error load logStore. path:%s.\n", dirPath);
 		return 0;
 	}
-	printf("load logStore success,load num:%d/%d, path:%s.\n", m_fileCnt, totalFilesNum, dirPath);
+	//every segment pruned: connected, with nothing to search
+	m_nServerHandle = 1;
+	if(prunedNum > 0)
+	{
+		printf("load logStore success,load num:%d/%d, pruned:%d, path:%s.\n", m_fileCnt, totalFilesNum, prunedNum, dirPath);
+	}
+	else
+	{
+		printf("load logStore success,load num:%d/%d, path:%s.\n", m_fileCnt, totalFilesNum, dirPath);
+	}
 	//CalRunningTime();
 	return m_fileCnt;
 }
@@ -157,6 +207,7 @@ int LogDispatcher::CalRunningTime()
 		glb_stat.total_decom_capsule_time += ss.total_decom_capsule_time;
 		glb_stat.total_queried_cap_cnt += ss.total_queried_cap_cnt;
 		glb_stat.valid_cap_filter_cnt += ss.valid_cap_filter_cnt;
+		glb_stat.total_filtered_cap_cnt += ss.total_filtered_cap_cnt;
 		glb_stat.hit_at_mainpat_cnt += ss.hit_at_mainpat_cnt;
 		glb_stat.hit_at_subpat_cnt += ss.hit_at_subpat_cnt;
 	}
@@ -173,6 +224,7 @@ int LogDispatcher::CalRunningTime()
 	SysTotCount("tot_decom_cap: %d\n", glb_stat.total_decom_capsule_cnt);
 	SysTotCount("tot_check_cap: %d\n", glb_stat.total_queried_cap_cnt);
 	SysTotCount("tot_valid_cap: %d\n", glb_stat.valid_cap_filter_cnt);
+	SysTotCount("tot_skip_cap: %d\n", glb_stat.total_filtered_cap_cnt);
 	SysTotCount("tot_cap: %d\n", glb_stat.total_capsule_cnt);
 	SysTotCount("tot_decom_time: %lf\n", glb_stat.total_decom_capsule_time);
 	SysTotCount("P2P time:%lf s\n", runt.LogMetaTime + m_runt.SearchTotalTime + m_runt.MaterializFulTime);
@@ -314,7 +366,7 @@ int LogDispatcher::Aggregate_Distinct(char *args[MAX_CMD_ARG_COUNT], int argCoun
     std::vector<HyperLogLog> locals(m_fileCnt, HyperLogLog(12));
     struct DArg{ LogStoreApi** stores; int fileCnt; std::atomic<int>* nextIdx; char** args; int ac; const std::string* alias; std::vector<HyperLogLog>* locals; } a;
     a.stores=m_logStores; a.fileCnt=m_fileCnt; a.nextIdx=&nextIdx; a.args=args; a.ac=argCount; a.alias=&alias; a.locals=&locals;
-    auto worker = [](void* p)->void*{ DArg* a=(DArg*)p; bool isEmpty = (a->ac == 1 && (a->args[0] == NULL || a->args[0][0] == '\0')); while(true){ int i=a->nextIdx->fetch_add(1); if(i>=a->fileCnt) break; LogStoreApi* logStore=a->stores[i]; LISTBITMAPS bitmaps; logStore->BuildBitmapsForQuery(a->args, a->ac, bitmaps); if(!isEmpty && bitmaps.empty()) continue; VarAliasManager* mgr=VarAliasManager::getInstance(); std::vector<int> vids=mgr->getVarIds(*a->alias); StatisticsAPI stats(logStore); for(size_t k=0;k<vids.size();k++){ int varId=vids[k]; int pid=(varId & 0xFFFF0000); LISTBITMAPS::iterator ib=bitmaps.find(pid); BitMap* filter = NULL; if(ib == bitmaps.end()){ if(isEmpty) filter = NULL; else continue; } else { filter = ib->second; if(!isEmpty && filter == NULL) continue; } stats.BuildHLL(varId, filter, (*a->locals)[i]); } for(LISTBITMAPS::iterator it=bitmaps.begin(); it!=bitmaps.end(); ++it){ if(it->second) delete it->second; } } return NULL; };
+    auto worker = [](void* p)->void*{ DArg* a=(DArg*)p; bool isEmpty = (a->ac == 1 && (a->args[0] == NULL || a->args[0][0] == '\0')); while(true){ int i=a->nextIdx->fetch_add(1); if(i>=a->fileCnt) break; LogStoreApi* logStore=a->stores[i]; LISTBITMAPS bitmaps; logStore->BuildBitmapsForQuery(a->args, a->ac, bitmaps); if(!isEmpty && bitmaps.empty()) continue; VarAliasManager* mgr=VarAliasManager::getInstance(); std::vector<int> vids=mgr->getVarIds(*a->alias); StatisticsAPI stats(logStore); for(size_t k=0;k<vids.size();k++){ int varId=vids[k]; int pid=(varId & 0xFFFF0000); LISTBITMAPS::iterator ib=bitmaps.find(pid); BitMap* filter = NULL; if(ib == bitmaps.end()){ if(isEmpty) filter = NULL; else continue; } else { filter = ib->second; if(!isEmpty && filter == NULL) continue; } if(filter == NULL && stats.MergeStoredHLL(varId, (*a->locals)[i])) continue; stats.BuildHLL(varId, filter, (*a->locals)[i]); } for(LISTBITMAPS::iterator it=bitmaps.begin(); it!=bitmaps.end(); ++it){ if(it->second) delete it->second; } } return NULL; };
     std::vector<pthread_t> ths; ths.resize(n);
     for(int i=0;i<n;i++){ pthread_create(&ths[i], NULL, worker, &a); }
     for(int i=0;i<n;i++){ void* rv=NULL; pthread_join(ths[i], &rv); }
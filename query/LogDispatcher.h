@@ -31,6 +31,7 @@ private:
 
 public:
     int Connect(char* dirPath);
+    int Connect(char* dirPath, char *args[MAX_CMD_ARG_COUNT], int argCount);
     int IsConnect();
     void DisConnect();
 
@@ -6,7 +6,9 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <errno.h>
+#include <climits>
 #include "LogStore_API.h"
 #include "var_alias.h"
 #include "../compression/TimeParser.h"
@@ -65,6 +67,18 @@ static bool __contains_ic(const char* text, const char* pat);
 static bool __parse_numeric_expr(const std::string& expr, long& outA, long& outB, int& opType);
 static unsigned long long __hash64_str(const char* s){ unsigned long long h=1469598103934665603ULL; while(*s){ h^=(unsigned long long)(unsigned char)(*s++); h*=1099511628211ULL; } return h; }
 static unsigned long long __mix64(unsigned long long x){ x+=0x9E3779B97F4A7C15ULL; x=(x^(x>>30))*0xBF58476D1CE4E5B9ULL; x=(x^(x>>27))*0x94D049BB133111EBULL; x^=x>>31; return x; }
+//dic hits are passed around as padded strings, packed entries compare ints
+static void __dic_query_vals(const char* querySegs, int querySegCnt, std::vector<int>& vals){
+    for(int i=0;i<querySegCnt;i++){
+        char* seg = (char*)querySegs + i*MAX_DICENTY_LEN;
+        vals.push_back(atoi(seg, strnlen(seg, MAX_DICENTY_LEN)));
+    }
+}
+
+static int __entry_pad_len(Coffer* meta){
+    return meta->eleLen > 0 ? meta->eleLen : MAX_DICENTY_LEN - 1;
+}
+
 static long long __parse_time_arg(const char* s){
     if(!s) return LLONG_MIN;
     long long out=0;
@@ -83,8 +97,19 @@ LogStoreApi::LogStoreApi()
     m_fd = -1;
     m_fptr = NULL;
     m_glbMetaHeadLen =0;
+    m_glbBase =0;
+    m_glbEnd =0;
+    m_map = NULL;
+    m_mapLen =0;
+    m_mapBase =0;
+    m_dir = NULL;
+    m_dirCount =0;
+    m_dirRecSize =0;
     m_maxBitmapSize =0;
     m_outliers = NULL;
+    m_outliersReady = false;
+    m_varoutsReady = false;
+    m_timeReady = false;
     m_glbExchgLogicmap = NULL;
     m_glbExchgPatmap = NULL;
     m_glbExchgBitmap = NULL;
@@ -132,16 +157,7 @@ int LogStoreApi::BootLoader(char* path, char* filename)
 	ret = LoadSubPatternToGlbMap(coffer1 ->data, coffer1->srcLen);
 	//ClearCoffer(coffer1);
 	if(ret <= 0) return -6;
-	//load templates.outlier
-	Coffer* coffer2 = NULL;
-	ret = DeCompressCapsule(OUTL_PAT_NAME, coffer2);
-	if(ret <= 0) return -7;
-	if(coffer2->lines > 0)
-	{
-		ret = LoadOutliers(coffer2 ->data, coffer2->srcLen, coffer2->lines);
-		//ClearCoffer(coffer2);
-		if(ret <= 0) return -8;
-	}
+	//outliers, var outliers and time are left to the first query that reads them
 	
     char aliasConfigPath[MAX_FILE_NAMELEN] = {'\0'};
     sprintf(aliasConfigPath, "%s/var_alias.conf", path);
@@ -154,21 +170,117 @@ int LogStoreApi::BootLoader(char* path, char* filename)
 	m_glbExchgBitmap = new BitMap(m_maxBitmapSize);
 	m_glbExchgSubBitmap = new BitMap(m_maxBitmapSize);
 	m_glbExchgSubTempBitmap = new BitMap(m_maxBitmapSize);
-
-    // load time column & segment index if present
-    LoadTimeColumn();
-    LoadTimeIndex();
 	return ret;
 }
 
+//outlier lines of this group, decompressed on first call
+CELL* LogStoreApi::Outliers()
+{
+	if(m_outliersReady) return m_outliers;
+	std::lock_guard<std::mutex> lock(m_lazyMutex);
+	if(!m_outliersReady)
+	{
+		Coffer* coffer = FindCoffer(OUTL_PAT_NAME);
+		if(coffer && coffer->lines > 0)
+		{
+			if(DeCompressCapsule(OUTL_PAT_NAME, coffer) <= 0 || LoadOutliers(coffer->data, coffer->srcLen, coffer->lines) <= 0)
+			{
+				SyslogError("Error: load outliers failed in %s\n", FileName.c_str());
+			}
+		}
+		m_outliersReady = true;
+	}
+	return m_outliers;
+}
+
+int LogStoreApi::OutlierCount()
+{
+	Coffer* coffer = FindCoffer(OUTL_PAT_NAME);
+	return coffer ? coffer->lines : 0;
+}
+
+//outliers of one variable or NULL; all var outlier capsules are loaded together by the first call
+VarOutliers* LogStoreApi::VarOuts(int varFullName)
+{
+	if(!m_varoutsReady)
+	{
+		std::lock_guard<std::mutex> lock(m_lazyMutex);
+		if(!m_varoutsReady)
+		{
+			for(size_t i = 0; i < m_varoutNames.size(); i++)
+			{
+				Coffer* coffer = FindCoffer(m_varoutNames[i]);
+				if(coffer) LoadVarOutliers(m_varoutNames[i], coffer->lines, coffer->srcLen);
+			}
+			m_varoutsReady = true;
+		}
+	}
+	LISTOUTS::iterator it = m_varouts.find(varFullName);
+	return it == m_varouts.end() ? NULL : it->second;
+}
+
+int LogStoreApi::EnsureTime()
+{
+	if(m_timeReady) return m_timeValues.size();
+	std::lock_guard<std::mutex> lock(m_lazyMutex);
+	if(!m_timeReady)
+	{
+		LoadTimeColumn();
+		LoadTimeIndex();
+		m_timeReady = true;
+	}
+	return m_timeValues.size();
+}
+
+//map this capsule group up to the end of the file once, capsules are then decompressed straight from the
+//page cache; LOGGREP_MMAP=0 keeps the fseek+fread path
+int LogStoreApi::MapArchive()
+{
+	const char* mv = getenv("LOGGREP_MMAP");
+	if(mv && atoi(mv) == 0) return 0;
+	struct stat st;
+	int fd = fileno(m_fptr);
+	if(fstat(fd, &st) != 0 || st.st_size <= m_glbBase) return 0;
+	long long page = sysconf(_SC_PAGESIZE);
+	m_mapBase = m_glbBase / page * page;
+	m_mapLen = st.st_size - m_mapBase;
+	//private and writable: a stray write into a raw column used in place stays in this process
+	void* p = mmap(NULL, m_mapLen, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, m_mapBase);
+	if(p == MAP_FAILED)
+	{
+		SyslogError("mmap %s failed: %s, fall back to fread\n", FileName.c_str(), strerror(errno));
+		m_mapLen = 0;
+		m_mapBase = 0;
+		return 0;
+	}
+	m_map = (unsigned char*)p;
+	//a query touches a few capsules, read ahead only what DeCompressCapsule asks for
+	madvise(m_map, m_mapLen, MADV_RANDOM);
+	fclose(m_fptr);
+	m_fptr = NULL;
+	return 1;
+}
+
 int LogStoreApi::LoadGlbMetaHeader(char* filename, size_t& destLen, size_t& srcLen)
 {
 	m_fptr = fopen(filename, "rb");
 	if(m_fptr == NULL) return -1;
-    fread(&destLen, sizeof(size_t), 1, m_fptr);
-    fread(&srcLen, sizeof(size_t), 1, m_fptr);
+	if(MapArchive() > 0)
+	{
+		long long pos = m_glbBase - m_mapBase;
+		if(pos + 2 * (long long)sizeof(size_t) > (long long)m_mapLen) return -2;
+		memcpy(&destLen, m_map + pos, sizeof(size_t));
+		memcpy(&srcLen, m_map + pos + sizeof(size_t), sizeof(size_t));
+	}
+	else
+	{
+		if(m_glbBase > 0 && fseeko(m_fptr, (off_t)m_glbBase, SEEK_SET) != 0) return -1;
+		if(fread(&destLen, sizeof(size_t), 1, m_fptr) != 1) return -2;
+		if(fread(&srcLen, sizeof(size_t), 1, m_fptr) != 1) return -2;
+	}
 	if(destLen <= 0 || srcLen <=0) return -2;
-	m_glbMetaHeadLen = sizeof(size_t) + sizeof(size_t) + destLen;
+	m_glbMetaHeadLen = m_glbBase + sizeof(size_t) + sizeof(size_t) + destLen;
+	m_glbEnd = m_glbMetaHeadLen;
 	return 1;
 }
 
@@ -187,33 +299,44 @@ int LogStoreApi::LoadGlbMetadata(char* filename, size_t destLen, size_t srcLen)
 		return -1;
 	}
 
-	//decompression
+	//decompression, the meta frame follows the header in the mapping
 	unsigned char* pZstd = nullptr;
-	try {
-		pZstd = new unsigned char[destLen + 5];
-	} catch(std::bad_alloc& e) {
-		SyslogError("内存分配失败: pZstd (大小: %zu): %s\n", destLen + 5, e.what());
-		return -1;
-	}
+	unsigned char* pRead = nullptr;
+	if (m_map) {
+		long long pos = m_glbBase - m_mapBase + 2 * sizeof(size_t);
+		if (pos + (long long)destLen > (long long)m_mapLen) {
+			SyslogError("读取压缩数据失败: 元数据超出文件末尾 %lld + %zu > %zu\n", pos, destLen, m_mapLen);
+			return -1;
+		}
+		pZstd = m_map + pos;
+	} else {
+		try {
+			pRead = new unsigned char[destLen + 5];
+		} catch(std::bad_alloc& e) {
+			SyslogError("内存分配失败: pZstd (大小: %zu): %s\n", destLen + 5, e.what());
+			return -1;
+		}
 
-	size_t readSize = fread(pZstd, sizeof(char), destLen, m_fptr);
-	if (readSize != destLen) {
-		SyslogError("读取压缩数据失败: 预期 %zu 字节，实际读取 %zu 字节\n", destLen, readSize);
-		delete[] pZstd;
-		return -1;
+		size_t readSize = fread(pRead, sizeof(char), destLen, m_fptr);
+		if (readSize != destLen) {
+			SyslogError("读取压缩数据失败: 预期 %zu 字节，实际读取 %zu 字节\n", destLen, readSize);
+			delete[] pRead;
+			return -1;
+		}
+		pZstd = pRead;
 	}
 
 	size_t decom_buf_size = ZSTD_getFrameContentSize(pZstd, destLen);
 	if (decom_buf_size == ZSTD_CONTENTSIZE_ERROR || decom_buf_size == ZSTD_CONTENTSIZE_UNKNOWN) {
 		SyslogError("无法确定解压后大小: %s\n", filename);
-		delete[] pZstd;
+		delete[] pRead;
 		return -1;
 	}
 
 	// 检查解压后大小与预期大小是否一致
 	if (decom_buf_size != srcLen) {
 		SyslogError("解压后大小与预期不符: 预期=%zu, 实际=%zu\n", srcLen, decom_buf_size);
-		delete[] pZstd;
+		delete[] pRead;
 		return -1;
 	}
 
@@ -224,15 +347,42 @@ int LogStoreApi::LoadGlbMetadata(char* filename, size_t destLen, size_t srcLen)
 		if(res != srcLen) {
 			SyslogError("解压缩失败: %s, 预期大小 %zu, 实际大小 %d\n", filename, srcLen, res);
 			delete[] meta;
-			delete[] pZstd;
+			delete[] pRead;
 			return -1;
 		}
+	//binary directory: records stay in the buffer and become coffers when looked up
+	int dirCount = capsule_dir_count(meta, srcLen, m_dirRecSize);
+	if(dirCount >= 0)
+	{
+		delete[] pRead;
+		m_dir = meta;
+		m_dirCount = dirCount;
+		for(int i = 0; i < dirCount; i++)
+		{
+			const CapsuleRecord* r = capsule_dir_at(m_dir, m_dirRecSize, i);
+			if(r->srcLen <= 0) continue;
+			if(r->lines > 0)//written to the archive
+			{
+				m_glbEnd = max(m_glbEnd, m_glbMetaHeadLen + r->offset + r->destLen);
+				Statistic.total_capsule_cnt++;
+			}
+			if(r->eleLen == -3 && r->lines > 0)//var outliers
+			{
+				m_varoutNames.push_back(r->id);
+			}
+			if(r->id <= 0)
+			{
+				SyslogError("ErrorMeta:%d filename:%s\n", r->id, FileName.c_str());
+			}
+		}
+		return dirCount;
+	}
 	int offset =0, index =0;
-	char* meta_buffer = new char[128];
+	char* meta_buffer = new char[256];//meta lines carry column statistics
 	if (!meta_buffer) {
 		SyslogError("内存分配失败: meta_buffer\n");
 		delete[] meta;
-		delete[] pZstd;
+		delete[] pRead;
 		return -1;
 	}
 
@@ -246,16 +396,18 @@ int LogStoreApi::LoadGlbMetadata(char* filename, size_t destLen, size_t srcLen)
 				SyslogError("内存分配失败: newCoffer\n");
 				delete[] meta;
 				delete[] meta_buffer;
-				delete[] pZstd;
+				delete[] pRead;
 				return -1;
 			}
 
 			int iname = atoi(newCoffer->filenames.c_str());
 			if(newCoffer->srcLen > 0)
 				m_glbMeta[iname] = newCoffer;
+			if(newCoffer->srcLen > 0 && newCoffer->lines > 0)//written to the archive
+				m_glbEnd = max(m_glbEnd, m_glbMetaHeadLen + newCoffer->offset + newCoffer->destLen);
 			if(newCoffer->eleLen == -3 && newCoffer->lines > 0)//var outliers
 			{
-				LoadVarOutliers(iname, newCoffer->lines, newCoffer->srcLen);
+				m_varoutNames.push_back(iname);
 			}	
 			offset=0;
 			index++;
@@ -274,7 +426,7 @@ int LogStoreApi::LoadGlbMetadata(char* filename, size_t destLen, size_t srcLen)
 		}
         else
 		{
-			if (offset < 127) { // 防止缓冲区溢出
+			if (offset < 255) { // 防止缓冲区溢出
 				meta_buffer[offset++] = *p;
 			} else {
 				SyslogError("meta_buffer溢出，行太长\n");
@@ -284,11 +436,11 @@ int LogStoreApi::LoadGlbMetadata(char* filename, size_t destLen, size_t srcLen)
 
 	delete[] meta;
 	delete[] meta_buffer;
-	delete[] pZstd;
+	delete[] pRead;
 	return index;
 	} catch(std::bad_alloc& e) {
 		SyslogError("内存分配失败: %s\n", e.what());
-		delete[] pZstd;
+		delete[] pRead;
 		return -1;
 	}
 
@@ -659,13 +811,115 @@ int LogStoreApi::AddSubPatternToMap(int vid, char type, char* content)
 	return 0;
 }
 
+//digest a dictionary capsule once and keep it for the connection
+ZSTD_DDict* LogStoreApi::LoadDictionary(int dictName)
+{
+	map<int, ZSTD_DDict*>::iterator it = m_ddicts.find(dictName);
+	if(it != m_ddicts.end()) return it->second;
+	Coffer* dict;
+	if(DeCompressCapsule(dictName, dict, 1) <= 0) return NULL;
+	ZSTD_DDict* ddict = ZSTD_createDDict(dict->data, dict->srcLen);
+	ClearCoffer(dict);
+	if(ddict) m_ddicts[dictName] = ddict;
+	return ddict;
+}
+
+//meta of capsule patName, NULL when this group has none; a lookup never adds an empty entry
+Coffer* LogStoreApi::FindCoffer(int patName)
+{
+	std::lock_guard<std::mutex> lock(m_metaMutex);
+	LISTMETAS::iterator it = m_glbMeta.find(patName);
+	if(it != m_glbMeta.end()) return it->second;
+	if(m_dir == NULL) return NULL;
+	const CapsuleRecord* r = capsule_dir_find(m_dir, m_dirRecSize, m_dirCount, patName);
+	if(r == NULL || r->srcLen <= 0) return NULL;
+	Coffer* coffer = new Coffer(*r);
+	m_glbMeta[patName] = coffer;
+	return coffer;
+}
+
+//compressed bytes of a capsule into cdata once, a pointer into the archive mapping when mapped
+int LogStoreApi::LoadCapsule(Coffer* coffer)
+{
+	if(coffer->cdata != NULL) return coffer->destLen;
+	return m_map ? coffer->readMap(m_map, m_mapLen, m_glbMetaHeadLen - m_mapBase) : coffer->readFile(m_fptr, m_glbMetaHeadLen);
+}
+
+//int64 rows of a FOR/DELTA capsule decoded straight from cdata, never materializing the padded text column;
+//-1 for other codecs, which go through DeCompressCapsule and the text
+int LogStoreApi::ReadIntCapsule(int patName, std::vector<long long>& values)
+{
+	Coffer* coffer = FindCoffer(patName);
+	if(coffer == NULL || coffer->eleLen <= 0 || (m_fptr == NULL && m_map == NULL)) return -1;
+	if(coffer->compressed != CODEC_FOR && coffer->compressed != CODEC_DELTA) return -1;
+	if(LoadCapsule(coffer) < 0) return -1;
+	return coffer->decodeInts(values) == coffer->lines ? coffer->lines : -1;
+}
+
+//rows [rowStart, rowStart + rowCount) of a fixed width capsule into buf; a seekable capsule that is not
+//decompressed yet only decodes the frames covering them
+int LogStoreApi::DeCompressCapsuleRows(int patName, int rowStart, int rowCount, OUT char* buf)
+{
+	Coffer* coffer = FindCoffer(patName);
+	if(coffer == NULL || coffer->eleLen <= 0 || (m_fptr == NULL && m_map == NULL)) return -1;
+	if(coffer->data == NULL)
+	{
+		if(coffer->compressed != CODEC_SEEKABLE)
+		{
+			if(DeCompressCapsule(patName, coffer, 1) <= 0) return -1;
+		}
+		else if(LoadCapsule(coffer) < 0)
+		{
+			return -2;
+		}
+	}
+	return coffer->decompressRows(rowStart, rowCount, buf);
+}
+
+//frame rows when the first entryCnt rows of bitmap touch at most half the frames of a seekable capsule, else 0
+int LogStoreApi::UseFrames(Coffer* meta, BitMap* bitmap, int entryCnt)
+{
+	if(meta == NULL || meta->compressed != CODEC_SEEKABLE || meta->data != NULL || meta->eleLen <= 0) return 0;
+	if(bitmap->BeSizeFul() || entryCnt <= 0 || LoadCapsule(meta) < 0) return 0;
+	int frameRows = meta->frameRows();
+	if(frameRows <= 0 || frameRows >= meta->lines) return 0;
+	int frames = (meta->lines + frameRows - 1) / frameRows;
+	int touched = 0, last = -1;
+	for(int i = 0; i < entryCnt; i++)
+	{
+		int f = bitmap->GetIndex(i) / frameRows;
+		if(f != last) touched++;
+		last = f;
+	}
+	return touched * 2 <= frames ? frameRows : 0;
+}
+
+//row of a seekable capsule, decoding its frame into cur when the row is outside the frame held there
+char* LogStoreApi::SeekRow(int patName, Coffer* meta, int frameRows, int row, FrameCursor& cur)
+{
+	if(row < 0 || row >= meta->lines) return NULL;
+	if(cur.count == 0 || row < cur.first || row >= cur.first + cur.count)
+	{
+		cur.first = row / frameRows * frameRows;
+		cur.count = min(frameRows, meta->lines - cur.first);
+		cur.buf.resize((size_t)cur.count * meta->eleLen + MAP_OVERREAD);
+		if(DeCompressCapsuleRows(patName, cur.first, cur.count, &cur.buf[0]) < 0)
+		{
+			cur.count = 0;
+			return NULL;
+		}
+		Statistic.total_decom_capsule_cnt++;
+	}
+	return &cur.buf[(size_t)(row - cur.first) * meta->eleLen];
+}
+
 //decompress patterns
 int LogStoreApi::DeCompressCapsule(int patName, OUT Coffer* &coffer, int type)
 {
 	int ret = 1;
 	//if find in cache, then fetch directly
-	coffer = m_glbMeta[patName];
-	if(coffer == NULL || m_fptr == NULL) {
+	coffer = FindCoffer(patName);
+	if(coffer == NULL || (m_fptr == NULL && m_map == NULL)) {
 		SyslogError("错误: coffer或文件指针为空，patName=%d\n", patName);
 		return -1; //error patName
 	}
@@ -691,30 +945,44 @@ int LogStoreApi::DeCompressCapsule(int patName, OUT Coffer* &coffer, int type)
 
 	timeval tt1 = ___StatTime_Start();
 	
-	// 读取压缩数据
-	int res = coffer->readFile(m_fptr, m_glbMetaHeadLen);
+	// 读取压缩数据, 映射时 cdata 直接指向映射
+	int res = LoadCapsule(coffer);
 	if(res < 0) {
 		SyslogError("错误: 读取压缩数据失败，patName=%d\n", patName);
 		return -2;
 	}
-	
-	// 在解压缩前检查压缩数据的有效性
-	size_t decom_buf_size = ZSTD_getFrameContentSize(coffer->cdata, coffer->destLen);
-	if(decom_buf_size == ZSTD_CONTENTSIZE_ERROR || decom_buf_size == ZSTD_CONTENTSIZE_UNKNOWN) {
-		SyslogError("错误: 无法确定解压后大小或压缩数据无效，patName=%d\n", patName);
-		return -3;
+	if(coffer->mapped && coffer->destLen > MAP_WILLNEED_MIN)
+	{
+		//the mapping is MADV_RANDOM, fault in a large capsule with one read ahead instead of page by page
+		long long page = sysconf(_SC_PAGESIZE);
+		long long start = (coffer->cdata - m_map) / page * page;
+		madvise(m_map + start, coffer->cdata + coffer->destLen - (m_map + start), MADV_WILLNEED);
 	}
 	
-	// 检查解压后大小与预期大小是否一致
-	if(decom_buf_size != (size_t)coffer->srcLen) {
-		SyslogError("错误: 解压后大小与预期不符，patName=%d, 预期=%d, 实际=%zu\n", 
-			patName, coffer->srcLen, decom_buf_size);
-		return -3;
+	// 在解压缩前检查压缩数据的有效性, raw/rle/for capsules are no zstd frames
+	if(coffer->compressed == CODEC_ZSTD) {
+		size_t decom_buf_size = ZSTD_getFrameContentSize(coffer->cdata, coffer->destLen);
+		if(decom_buf_size == ZSTD_CONTENTSIZE_ERROR || decom_buf_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+			SyslogError("错误: 无法确定解压后大小或压缩数据无效，patName=%d\n", patName);
+			return -3;
+		}
+		
+		// 检查解压后大小与预期大小是否一致
+		if(decom_buf_size != (size_t)coffer->srcLen) {
+			SyslogError("错误: 解压后大小与预期不符，patName=%d, 预期=%d, 实际=%zu\n", 
+				patName, coffer->srcLen, decom_buf_size);
+			return -3;
+		}
 	}
 	
 	// 解压缩数据
+	ZSTD_DDict* ddict = NULL;
+	if(coffer->dictId != 0 && (ddict = LoadDictionary(coffer->dictId)) == NULL) {
+		SyslogError("错误: 加载字典失败，patName=%d, dictId=%d\n", patName, coffer->dictId);
+		return -3;
+	}
 	try {
-		res = coffer->decompress();
+		res = coffer->decompress(ddict);
 		if(res < 0) {
 			SyslogError("错误: 解压缩失败，patName=%d\n", patName);
 			ret = -3;
@@ -747,11 +1015,22 @@ int LogStoreApi::DeCompressCapsule(int patName, OUT Coffer* &coffer, int type)
 int LogStoreApi::LoadTimeColumn()
 {
     Coffer* coffer = NULL;
-    if(m_glbMeta.find(TIME_COL_NAME) == m_glbMeta.end()) return 0;
+    if(FindCoffer(TIME_COL_NAME) == NULL) return 0;
     int ret = DeCompressCapsule(TIME_COL_NAME, coffer);
     if(ret <= 0) return 0;
     if(!coffer || !coffer->data) return 0;
     m_timeValues.clear();
+    m_timeBlocks.clear();
+    if(coffer->eleLen == TIME_COL_BINARY){
+        if(decode_time_column(coffer->data, coffer->srcLen, m_timeValues, &m_timeBlocks) < 0){
+            SyslogError("Error: bad time column in %s\n", FileName.c_str());
+            m_timeValues.clear();
+            m_timeBlocks.clear();
+            return 0;
+        }
+        return m_timeValues.size();
+    }
+    //old archives: fixed-width space padded decimals
     int count = coffer->lines;
     int width = coffer->eleLen;
     m_timeValues.reserve(count);
@@ -771,7 +1050,7 @@ int LogStoreApi::LoadTimeColumn()
 int LogStoreApi::LoadTimeIndex()
 {
     Coffer* coffer = NULL;
-    if(m_glbMeta.find(TIME_INDEX_NAME) == m_glbMeta.end()) return 0;
+    if(FindCoffer(TIME_INDEX_NAME) == NULL) return 0;
     int ret = DeCompressCapsule(TIME_INDEX_NAME, coffer);
     if(ret <= 0) return 0;
     if(!coffer || !coffer->data) return 0;
@@ -802,13 +1081,30 @@ int LogStoreApi::LoadTimeIndex()
 
 BitMap* LogStoreApi::BuildTimeBitmap(long long start_ms, long long end_ms)
 {
-    if(m_timeValues.empty()) return NULL;
+    if(EnsureTime() == 0) return NULL;
     BitMap* bm = new BitMap(m_timeValues.size());
-    for(size_t i=0;i<m_timeValues.size();i++){
-        long long v = m_timeValues[i];
-        if(v >= start_ms && v <= end_ms){
-            bm->Union((int)i);
+    if(m_timeBlocks.empty()){
+        for(size_t i=0;i<m_timeValues.size();i++){
+            long long v = m_timeValues[i];
+            if(v >= start_ms && v <= end_ms){
+                bm->Union((int)i);
+            }
+        }
+        return bm;
+    }
+    //skip blocks by min/max, take fully covered blocks without comparing
+    int row = 0;
+    for(size_t b=0;b<m_timeBlocks.size();b++){
+        const TimeBlock& blk = m_timeBlocks[b];
+        int end = row + blk.rows;
+        if(blk.tmax < start_ms || blk.tmin > end_ms){ row = end; continue; }
+        bool full = blk.tmin >= start_ms && blk.tmax <= end_ms;
+        for(int i=row;i<end;i++){
+            if(full || (m_timeValues[i] >= start_ms && m_timeValues[i] <= end_ms)){
+                bm->Union(i);
+            }
         }
+        row = end;
     }
     return bm;
 }
@@ -874,6 +1170,7 @@ int LogStoreApi::QueryInMmapByKMP(int varname, const char* queryStr, BitMap* bit
 int LogStoreApi::QueryByBM_Union(int varname, const char* queryStr, int queryType, BitMap* bitmap)
 {
     if(queryType == QTYPE_ALIGN_FULL){ int pass = CheckBloom(varname, queryStr); if(pass == 0) return 0; }
+    if(CheckCapsuleStats(varname, queryStr) == 0) return bitmap->BeSizeFul() ? DEF_BITMAP_FULL : bitmap->GetSize();
     Coffer* meta=NULL;
     int len = DeCompressCapsule(varname, meta);
 	if(len <=0)
@@ -950,6 +1247,14 @@ int LogStoreApi::QueryByBM_Union_RefRange(int varname, const char* queryStr, int
 
 int LogStoreApi::QueryByBM_AxB_Union(int varname, const char* queryStrA, const char* queryStrB, BitMap* bitmap)
 {
+	int aLen = strlen(queryStrA);
+	int bLen = strlen(queryStrB);
+	if(CheckCapsuleStats(varname, queryStrA) == 0 || CheckCapsuleStats(varname, queryStrB) == 0)
+	{
+		//what the scan below gives when no row matches
+		if(FindCoffer(varname)->eleLen < aLen + bLen) return 0;
+		return bitmap->BeSizeFul() ? DEF_BITMAP_FULL : bitmap->GetSize();
+	}
 	Coffer* meta;
 	int len = DeCompressCapsule(varname, meta);
 	if(len <=0)
@@ -958,8 +1263,6 @@ int LogStoreApi::QueryByBM_AxB_Union(int varname, const char* queryStrA, const c
 	}
 	//SyslogDebug("%s: meta: Len:%d line:%d ele: %d\n", FormatVarName(varname), meta->srcLen, meta->lines, meta->eleLen);
 	//SyslogDebug("------------%s\n", meta->data);
-	int aLen = strlen(queryStrA);
-	int bLen = strlen(queryStrB);
 	if(meta->eleLen >= (aLen + bLen))//same length of each line
 	{
 		return BMwildcard_AxB(meta->data, meta->lines, meta->eleLen, queryStrA, queryStrB, bitmap);
@@ -979,6 +1282,12 @@ int LogStoreApi::QueryByBM_Union_ForDic(int varname, const char* querySegs, int
 		return 0;
 	}
 	int ret =0;
+	if(meta->eleLen == ELE_BITPACKED)
+	{
+		std::vector<int> vals;
+		__dic_query_vals(querySegs, querySegCnt, vals);
+		return Packed_Equal(meta->data, meta->lines, &vals[0], querySegCnt, bitmap);
+	}
 	if(INC_TEST_FIXED && meta->eleLen > 0)//same length of each line
 	{
 		if(querySegCnt == 1)
@@ -1014,6 +1323,7 @@ int LogStoreApi::QueryByBM_Union_ForDic(int varname, const char* querySegs, int
 int LogStoreApi::QueryByBM_Pushdown(int varname, const char* queryStr, BitMap* bitmap, int type)
 {
     if(type == QTYPE_ALIGN_FULL){ int pass = CheckBloom(varname, queryStr); if(pass == 0){ bitmap->Reset(); return 0; } }
+    if(bitmap->GetSize() > 0 && CheckCapsuleStats(varname, queryStr) == 0){ bitmap->Reset(); return 0; }
     Coffer* meta;
     int len = DeCompressCapsule(varname, meta);
 	if(len <=0)
@@ -1074,6 +1384,7 @@ int LogStoreApi::QueryByBM_Pushdown(int varname, const char* queryStr, BitMap* b
 int LogStoreApi::QueryByBM_Pushdown_RefMap(int varname, const char* queryStr, BitMap* bitmap, BitMap* refBitmap, int type)
 {
     if(type == QTYPE_ALIGN_FULL){ int pass = CheckBloom(varname, queryStr); if(pass == 0){ return 0; } }
+    if(CheckCapsuleStats(varname, queryStr) == 0) return 0;
     Coffer* meta;
     int len = DeCompressCapsule(varname, meta);
 	if(len <=0)
@@ -1135,6 +1446,12 @@ int LogStoreApi::QueryByBM_Pushdown_ForDic(int varname, const char* querySegs, i
 		return 0;
 	}
 	int ret =0;
+	if(meta->eleLen == ELE_BITPACKED)
+	{
+		std::vector<int> vals;
+		__dic_query_vals(querySegs, querySegCnt, vals);
+		return Packed_Equal_Pushdown(meta->data, meta->lines, &vals[0], querySegCnt, bitmap);
+	}
 	//SyslogDebug("%s: meta: Len:%d line:%d ele: %d\n", FormatVarName(varname), meta->srcLen, meta->lines, meta->eleLen);
 	//SyslogDebug("------------%s %d\n", meta->data, bitmap->GetSize());
 	if(INC_TEST_FIXED && meta->eleLen > 0)//same length of each line
@@ -1227,6 +1544,12 @@ int LogStoreApi::QueryByBM_Pushdown_ForDic_RefMap(int varname, const char* query
 		return 0;
 	}
 	int ret =0;
+	if(meta->eleLen == ELE_BITPACKED)
+	{
+		std::vector<int> vals;
+		__dic_query_vals(querySegs, querySegCnt, vals);
+		return Packed_Equal_Pushdown_RefMap(meta->data, meta->lines, &vals[0], querySegCnt, bitmap, refBitmap);
+	}
 	//SyslogDebug("%s: meta: Len:%d line:%d ele: %d\n", FormatVarName(varname), meta->srcLen, meta->lines, meta->eleLen);
 	//SyslogDebug("------------%s %d\n", meta->data, bitmap->GetSize());
 	if(INC_TEST_FIXED && meta->eleLen > 0)//same length of each line
@@ -1320,7 +1643,22 @@ int LogStoreApi::QueryByBM_Pushdown_ForDic_RefMap(int varname, const char* query
 //return  0: false    1:true
 int LogStoreApi::LoadcVarsByBitmap(int varname, BitMap* bitmap, OUT char *vars, int entryCnt, int varsLineLen, int flag)
 {
-	Coffer* meta;
+	Coffer* meta = FindCoffer(varname);
+	int frameRows = INC_TEST_FIXED ? UseFrames(meta, bitmap, entryCnt) : 0;
+	if(frameRows > 0)
+	{
+		//a few rows of a large column: decode only their frames
+		FrameCursor cur;
+		for(int i = 0; i < entryCnt; i++)
+		{
+			char* row = SeekRow(varname, meta, frameRows, bitmap->GetIndex(i), cur);
+			if(row == NULL) continue;
+			char* out = vars + i * varsLineLen;
+			if(!flag) out += strlen(out);
+			::RemovePadding(row, meta->eleLen, out);
+		}
+		return 1;
+	}
 	int ret = DeCompressCapsule(varname, meta, 1);
 	if(ret <=0) return 0;
 	if(INC_TEST_FIXED && meta->eleLen > 0)
@@ -1353,31 +1691,49 @@ int LogStoreApi::LoadcVars(int varname, int entryCnt, OUT char *vars, int varsLi
 
 int LogStoreApi::ClearCoffer(Coffer* &coffer)
 {
-	if(coffer && coffer ->data)
-	{
-		delete[] coffer ->data;
-		coffer ->data = NULL;
-	} 
-	if(coffer && coffer ->cdata) 
+	if(coffer)
 	{
-		delete[] coffer ->cdata;
-		coffer ->cdata = NULL;
+		coffer ->release();
 	}
 	return 1;
 }
 int LogStoreApi::ClearVarFromCache()
 {
+	std::lock_guard<std::mutex> lock(m_metaMutex);
 	LISTMETAS::iterator it = m_glbMeta.begin();
 	for (; it != m_glbMeta.end();it++)
 	{
-		ClearCoffer(it->second);
-		it->second = NULL;
+		delete it->second;
+	}
+	m_glbMeta.clear();
+	if(m_dir)
+	{
+		delete[] m_dir;
+		m_dir = NULL;
+		m_dirCount = 0;
 	}
 	if(m_outliers)
 	{
 		delete[] m_outliers;
 		m_outliers = NULL;
 	}
+	for(LISTOUTS::iterator vit = m_varouts.begin(); vit != m_varouts.end(); vit++)
+	{
+		if(vit->second == NULL) continue;
+		for(map<int, char*>::iterator oit = vit->second->Outliers.begin(); oit != vit->second->Outliers.end(); oit++)
+		{
+			delete[] oit->second;
+		}
+		delete vit->second;
+	}
+	m_varouts.clear();
+	m_varoutNames.clear();
+	m_timeValues.clear();
+	m_timeBlocks.clear();
+	m_segments.clear();
+	m_outliersReady = false;
+	m_varoutsReady = false;
+	m_timeReady = false;
 	return 0;
 }
 
@@ -1434,7 +1790,7 @@ int LogStoreApi::GetVals_Subpat_Pushdown(int varName, const char* regPattern, in
 	//first check outliers
 	int varFullName = varName + VAR_TYPE_OUTLIER;
 	BitMap* tempBitmap = NULL;
-	if(m_varouts[varFullName] != NULL)
+	if(VarOuts(varFullName) != NULL)
 	{
 		tempBitmap = new BitMap(bitmap->TotalSize);
 		GetVarOutliers_BM(varFullName, regPattern, queryType, tempBitmap, bitmap);
@@ -1526,7 +1882,7 @@ int LogStoreApi::GetVals_Subpat_Pushdown_RefMap(int varName, const char* regPatt
 	//first check outliers
 	int varFullName = varName + VAR_TYPE_OUTLIER;
 	BitMap* tempBitmap = NULL;
-	if(m_varouts[varFullName] != NULL)
+	if(VarOuts(varFullName) != NULL)
 	{
 		tempBitmap = new BitMap(refBitmap->TotalSize);
 		GetVarOutliers_BM(varFullName, regPattern, queryType, tempBitmap, refBitmap);
@@ -1670,7 +2026,7 @@ int LogStoreApi::GetDicIndexs(int varName, const char* regPattern, int queryType
 	{
 		SyslogDebug("----in dic query index: %d %d\n", varName, num);
 		int varfname = varName + VAR_TYPE_ENTRY;
-		int entryLen = m_glbMeta[varfname]->eleLen;
+		int entryLen = __entry_pad_len(FindCoffer(varfname));
 		//dic search result may be bigger than 1
 		dicQuerySegs = new char[MAX_DICENTY_LEN * num];
 		memset(dicQuerySegs, '\0', MAX_DICENTY_LEN * num);
@@ -1729,7 +2085,7 @@ int LogStoreApi::GetVals_AxB_Dic(int varName, const char* queryA, const char* qu
 	if(num > 0)
 	{
 		varfname = varName + (varType == VAR_TYPE_DIC ? VAR_TYPE_ENTRY : (varType == VAR_TYPE_SUB ? VAR_TYPE_SUB : VAR_TYPE_VAR));
-		int entryLen = m_glbMeta[varfname]->eleLen;
+		int entryLen = __entry_pad_len(FindCoffer(varfname));
 		//dic search result may be bigger than 1
 		char* paddingStr = new char[MAX_DICENTY_LEN * num];
 		memset(paddingStr, '\0', MAX_DICENTY_LEN * num);
@@ -1815,7 +2171,7 @@ int LogStoreApi::GetVarOutliers_BM(int varName, const char *queryStr, int queryT
 {
 	int matchResult;
 	int bitmapIndex =0;
-	VarOutliers* outliers = m_varouts[varName];
+	VarOutliers* outliers = VarOuts(varName);
 	int flag = 0;
 	if(refBitmap->GetSize() == DEF_BITMAP_FULL)
 	{
@@ -1859,24 +2215,24 @@ int LogStoreApi::GetOutliers_MultiToken(char *args[MAX_CMD_ARG_COUNT], int argCo
 {
 	char queryStr[MAX_PATTERN_SIZE]={'\0'};
 	RecombineString(args, argCountS, argCountE, queryStr);
-	int lineCount = m_glbMeta[OUTL_PAT_NAME] ->lines;
+	int lineCount = OutlierCount();
 	if(beReverse)
 	{
-		return QueryInStrArray_BM_Reverse(m_outliers, lineCount, queryStr, bitmap);
+		return QueryInStrArray_BM_Reverse(Outliers(), lineCount, queryStr, bitmap);
 	}
-	return QueryInStrArray_BM(m_outliers, lineCount, queryStr, bitmap);
+	return QueryInStrArray_BM(Outliers(), lineCount, queryStr, bitmap);
 }
 
 int LogStoreApi::GetOutliers_MultiToken_RefMap(char *args[MAX_CMD_ARG_COUNT], int argCountS, int argCountE, BitMap* bitmap, BitMap* refbitmap, bool beReverse)
 {
 	char queryStr[MAX_PATTERN_SIZE]={'\0'};
 	RecombineString(args, argCountS, argCountE, queryStr);
-	int lineCount = m_glbMeta[OUTL_PAT_NAME] ->lines;
+	int lineCount = OutlierCount();
 	if(beReverse)
 	{
-		return QueryInStrArray_BM_Reverse_RefMap(m_outliers, lineCount, queryStr, bitmap, refbitmap);
+		return QueryInStrArray_BM_Reverse_RefMap(Outliers(), lineCount, queryStr, bitmap, refbitmap);
 	}
-	return QueryInStrArray_BM_RefMap(m_outliers, lineCount, queryStr, bitmap, refbitmap);
+	return QueryInStrArray_BM_RefMap(Outliers(), lineCount, queryStr, bitmap, refbitmap);
 }
 
 
@@ -1886,17 +2242,17 @@ int LogStoreApi::GetOutliers_SinglToken(char *arg, BitMap* bitmap, bool beRevers
 	//the style maybe:  	abcd, ab*, a*d, *cd, *bc*.
 	//spit seq with '*':	abcd, ab,  [a,b], cd, bc.
 	int mCount = Split_NoDelim(arg, WILDCARD, wArray);
-	int lineCount = m_glbMeta[OUTL_PAT_NAME] ->lines;
+	int lineCount = OutlierCount();
 	int bitmapSize =0;
 	if(mCount == 1)
 	{
 		if(beReverse)
 		{
-			bitmapSize = QueryInStrArray_BM_Reverse(m_outliers, lineCount, wArray[0], bitmap);
+			bitmapSize = QueryInStrArray_BM_Reverse(Outliers(), lineCount, wArray[0], bitmap);
 		}
 		else
 		{
-			bitmapSize = QueryInStrArray_BM(m_outliers, lineCount, wArray[0], bitmap);
+			bitmapSize = QueryInStrArray_BM(Outliers(), lineCount, wArray[0], bitmap);
 		}
 	}
 	else if(mCount == 2)//a*b
@@ -1906,11 +2262,11 @@ int LogStoreApi::GetOutliers_SinglToken(char *arg, BitMap* bitmap, bool beRevers
 		queryAxB += wArray[1];
 		if(beReverse)
 		{
-			bitmapSize = QueryInStrArray_CReg_Reverse(m_outliers, lineCount, queryAxB.c_str(), bitmap);
+			bitmapSize = QueryInStrArray_CReg_Reverse(Outliers(), lineCount, queryAxB.c_str(), bitmap);
 		}
 		else
 		{
-			bitmapSize = QueryInStrArray_CReg(m_outliers, lineCount, queryAxB.c_str(), bitmap);
+			bitmapSize = QueryInStrArray_CReg(Outliers(), lineCount, queryAxB.c_str(), bitmap);
 		}
 	}
 	return bitmapSize;
@@ -1922,17 +2278,17 @@ int LogStoreApi::GetOutliers_SinglToken_RefMap(char *arg, BitMap* bitmap, BitMap
 	//the style maybe:  	abcd, ab*, a*d, *cd, *bc*.
 	//spit seq with '*':	abcd, ab,  [a,b], cd, bc.
 	int mCount = Split_NoDelim(arg, WILDCARD, wArray);
-	int lineCount = m_glbMeta[OUTL_PAT_NAME] ->lines;
+	int lineCount = OutlierCount();
 	int bitmapSize =0;
 	if(mCount == 1)
 	{
 		if(beReverse)
 		{
-			bitmapSize = QueryInStrArray_BM_Reverse_RefMap(m_outliers, lineCount, wArray[0], bitmap, refbitmap);
+			bitmapSize = QueryInStrArray_BM_Reverse_RefMap(Outliers(), lineCount, wArray[0], bitmap, refbitmap);
 		}
 		else
 		{
-			bitmapSize = QueryInStrArray_BM_RefMap(m_outliers, lineCount, wArray[0], bitmap, refbitmap);
+			bitmapSize = QueryInStrArray_BM_RefMap(Outliers(), lineCount, wArray[0], bitmap, refbitmap);
 		}
 	}
 	else if(mCount == 2)//a*b
@@ -1942,11 +2298,11 @@ int LogStoreApi::GetOutliers_SinglToken_RefMap(char *arg, BitMap* bitmap, BitMap
 		queryAxB += wArray[1];
 		if(beReverse)
 		{
-			bitmapSize = QueryInStrArray_CReg_Reverse_RefMap(m_outliers, lineCount, queryAxB.c_str(), bitmap, refbitmap);
+			bitmapSize = QueryInStrArray_CReg_Reverse_RefMap(Outliers(), lineCount, queryAxB.c_str(), bitmap, refbitmap);
 		}
 		else
 		{
-			bitmapSize = QueryInStrArray_CReg_RefMap(m_outliers, lineCount, queryAxB.c_str(), bitmap, refbitmap);
+			bitmapSize = QueryInStrArray_CReg_RefMap(Outliers(), lineCount, queryAxB.c_str(), bitmap, refbitmap);
 		}
 	}
 	return bitmapSize;
@@ -1960,8 +2316,10 @@ int LogStoreApi::Materializ_Dic(int varname, BitMap* bitmap, int entryCnt, OUT c
 	int dicname = varname + VAR_TYPE_DIC;
 	int entryname = varname + (varType == VAR_TYPE_DIC ? VAR_TYPE_ENTRY : (varType == VAR_TYPE_SUB ? VAR_TYPE_SUB : VAR_TYPE_VAR));
 	//load entries and dic
-	Coffer* entryMeta; Coffer* dicMeta;
-	int ret = DeCompressCapsule(entryname, entryMeta, 1);
+	Coffer* entryMeta = FindCoffer(entryname); Coffer* dicMeta;
+	int frameRows = UseFrames(entryMeta, bitmap, entryCnt);
+	FrameCursor cur;
+	int ret = frameRows > 0 ? 1 : DeCompressCapsule(entryname, entryMeta, 1);
 	if(ret <=0) return 0;
 	ret = DeCompressCapsule(dicname, dicMeta, 1);
 	if(ret <=0) return 0;
@@ -1975,9 +2333,20 @@ int LogStoreApi::Materializ_Dic(int varname, BitMap* bitmap, int entryCnt, OUT c
 		for(int i=0;i< entryCnt;i++)
 		{
 			//calc dic offset
-			if(bitmap->GetIndex(i) < entryMeta->lines)
+			if(frameRows > 0)
+			{
+				char* row = SeekRow(entryname, entryMeta, frameRows, bitmap->GetIndex(i), cur);
+				if(row == NULL) continue;
+				dicOffset = GetEntryValue(row, entryLen, 0);
+				if(dicOffset < dicMeta->lines)
+				{
+					int offset = GetDicOffsetByEntry(m_subpatterns[varname], dicOffset, dicLen);
+					RemovePadding(dicBuf + offset, dicLen, vars + i * MAX_VALUE_LEN);
+				}
+			}
+			else if(bitmap->GetIndex(i) < entryMeta->lines)
 			{
-				dicOffset = atoi(entryBuf + bitmap->GetIndex(i) * entryLen, entryLen);
+				dicOffset = GetEntryValue(entryBuf, entryLen, bitmap->GetIndex(i));
 				if(dicOffset < dicMeta->lines)
 				{
 					int offset = GetDicOffsetByEntry(m_subpatterns[varname], dicOffset, dicLen);
@@ -1996,13 +2365,12 @@ int LogStoreApi::Materializ_Dic(int varname, BitMap* bitmap, int entryCnt, OUT c
 		{
 			if(i < entryMeta->lines)
 			{
-				dicOffset = atoi(entryBuf, entryLen);
+				dicOffset = GetEntryValue(entryBuf, entryLen, i);
 				if(dicOffset < dicMeta->lines)
 				{
 					int offset = GetDicOffsetByEntry(m_subpatterns[varname], dicOffset, dicLen);
 					RemovePadding(dicBuf + offset, dicLen, vars + i * MAX_VALUE_LEN);
 				}
-				entryBuf += entryLen;
 			}
 			else
 			{
@@ -2022,6 +2390,7 @@ int LogStoreApi::Materializ_Dic_Kmp(int varname, BitMap* bitmap, int entryCnt, O
 	Coffer* entryMeta; Coffer* dicMeta;
 	int ret = DeCompressCapsule(entryname, entryMeta, 1);
 	if(ret <=0) return 0;
+	if(entryMeta->eleLen == ELE_BITPACKED) return Materializ_Dic(varname, bitmap, entryCnt, vars);
 	ret = DeCompressCapsule(dicname, dicMeta, 1);
 	if(ret <=0) return 0;
 	char* dicBuf = dicMeta->data;
@@ -2078,12 +2447,12 @@ int LogStoreApi::Materializ_Dic_Kmp(int varname, BitMap* bitmap, int entryCnt, O
 }
 
 //return: index of outlier or -1
-int LogStoreApi::RebuiltData_Subpat(char* data, int entryLen, int index, int no, int outfilename, string constStr, OUT char* vars)
+//content: row index of the sub var column
+int LogStoreApi::RebuiltData_Subpat(char* content, int entryLen, int index, int no, int outfilename, string constStr, OUT char* vars)
 {
-	int offsetT = index * entryLen;
-	char* content = data + offsetT;
 	//data in outlier
-	if(content[entryLen-1] == ' ' && (m_varouts[outfilename] != NULL) && (m_varouts[outfilename] ->Outliers.find(index) != m_varouts[outfilename] ->Outliers.end()))
+	VarOutliers* outs;
+	if(content[entryLen-1] == ' ' && (outs = VarOuts(outfilename)) != NULL && outs->Outliers.find(index) != outs->Outliers.end())
 	{
 		return index;
 	}
@@ -2121,8 +2490,10 @@ int LogStoreApi::Materializ_Subpat(SubPattern* subpat, int varname, BitMap* bitm
         else
         {
             subVarName = varname | (varIndex<<4) | VAR_TYPE_SUB;
-            Coffer* entryMeta;
-            int ret = DeCompressCapsule(subVarName, entryMeta, 1);
+            Coffer* entryMeta = FindCoffer(subVarName);
+            int frameRows = INC_TEST_FIXED ? UseFrames(entryMeta, bitmap, entryCnt) : 0;
+            FrameCursor cur;
+            int ret = frameRows > 0 ? 1 : DeCompressCapsule(subVarName, entryMeta, 1);
             if(ret <=0)
             {
                 SyslogError("Materializ_Subpat: load subpat failed. %d\n", subVarName);
@@ -2136,7 +2507,9 @@ int LogStoreApi::Materializ_Subpat(SubPattern* subpat, int varname, BitMap* bitm
                     for(int j=0; j< entryCnt;j++)
                     {
                         int bitmapIndex = bitmap->GetIndex(j);
-                        int tempIndex = RebuiltData_Subpat(entryMeta->data, entryLen, bitmapIndex, j, outfilename, constStr, vars);
+                        char* row = frameRows > 0 ? SeekRow(subVarName, entryMeta, frameRows, bitmapIndex, cur) : entryMeta->data + bitmapIndex * entryLen;
+                        if(row == NULL) continue;
+                        int tempIndex = RebuiltData_Subpat(row, entryLen, bitmapIndex, j, outfilename, constStr, vars);
                         if(tempIndex >=0)
                         {
                             out_idx_vars.push_back(j);
@@ -2155,7 +2528,7 @@ int LogStoreApi::Materializ_Subpat(SubPattern* subpat, int varname, BitMap* bitm
                 {
                     for(int j=0;j< entryCnt;j++)
                     {
-                        int tempIndex = RebuiltData_Subpat(entryMeta->data, entryLen, j, j, outfilename, constStr, vars);
+                        int tempIndex = RebuiltData_Subpat(entryMeta->data + j * entryLen, entryLen, j, j, outfilename, constStr, vars);
                         if(tempIndex >=0)
                         {
                             out_idx_vars.push_back(j);
@@ -2183,10 +2556,11 @@ int LogStoreApi::Materializ_Subpat(SubPattern* subpat, int varname, BitMap* bitm
         }
     }
     
-    if(m_varouts[outfilename] != NULL)
+    VarOutliers* outs = VarOuts(outfilename);
+    if(outs != NULL)
     {
         for(size_t t=0; t< out_idx_outs.size(); ++t){
-            char* outData = m_varouts[outfilename] ->Outliers[out_idx_outs[t]];
+            char* outData = outs ->Outliers[out_idx_outs[t]];
             if(outData != NULL)
                 memcpy(vars + out_idx_vars[t] * MAX_VALUE_LEN, outData, strlen(outData));
         }
@@ -2311,7 +2685,7 @@ int LogStoreApi::MaterializOutlier(BitMap* bitmap, int cnt, int refNum)
 	int doCnt = refNum > cnt ? cnt : refNum;
 	for(int i=0; i< doCnt; i++)
 	{
-		SyslogOut("%s\n", m_outliers[bitmap->GetIndex(i)]);
+		SyslogOut("%s\n", Outliers()[bitmap->GetIndex(i)]);
 	}
 }
 
@@ -2407,7 +2781,7 @@ int LogStoreApi::MaterializOutlier_JSON(BitMap* bitmap, int cnt, int refNum, std
     
     for(int i=0; i < doCnt; i++)
     {
-        std::string escaped_log = escape_json(std::string(m_outliers[bitmap->GetIndex(i)]));
+        std::string escaped_log = escape_json(std::string(Outliers()[bitmap->GetIndex(i)]));
         
         if(i > 0) json_out.append(",\n");
         json_out.append("  {\n");
@@ -2429,9 +2803,16 @@ int LogStoreApi::IsConnect()
 	return m_nServerHandle;
 }
 
-int LogStoreApi::Connect(char *logStorePath, char* fileName)
+long long LogStoreApi::GetGroupEnd()
+{
+	return m_glbEnd;
+}
+
+//groupOffset: start of the capsule group, >0 for the later groups of a streamed archive
+int LogStoreApi::Connect(char *logStorePath, char* fileName, long long groupOffset)
 {
 	if(m_nServerHandle == 1) return m_nServerHandle;
+	m_glbBase = groupOffset;
 	if(logStorePath == NULL || strlen(logStorePath) <=3)
 	{
 		logStorePath = DIR_PATH_DEFAULT;
@@ -2486,6 +2867,11 @@ int LogStoreApi::DisConnect()
 		}
 	}
 	m_subpatterns.clear();
+	for (map<int, ZSTD_DDict*>::iterator itor = m_ddicts.begin(); itor != m_ddicts.end(); itor++)
+	{
+		ZSTD_freeDDict(itor->second);
+	}
+	m_ddicts.clear();
 	memset(m_filePath,'\0',MAX_DIR_PATH);
 	if(m_fd > 0)
 	{
@@ -2497,7 +2883,13 @@ int LogStoreApi::DisConnect()
 		fclose(m_fptr);//release file handle
 		m_fptr = NULL;
 	}
-	ClearVarFromCache();//clear cached vars to release mem
+	ClearVarFromCache();//clear cached vars to release mem, mapped capsules point into m_map
+	if(m_map)
+	{
+		munmap(m_map, m_mapLen);
+		m_map = NULL;
+		m_mapLen = 0;
+	}
 	Release_SearchTemp();
 	m_nServerHandle = 0;
 	return m_nServerHandle;
@@ -3855,8 +4247,8 @@ int LogStoreApi::SearchByLogic_not(char *args[MAX_CMD_ARG_COUNT], int argCountS,
 				string queryAxB(wArray[0]);
 				queryAxB += ".*";
 				queryAxB += wArray[1];
-				int lineCount = m_glbMeta[OUTL_PAT_NAME]->lines;
-				QueryInStrArray_CReg_RefMap(m_outliers, lineCount, queryAxB.c_str(), bitmaps[OUTL_PAT_NAME], bitmaps[OUTL_PAT_NAME]);
+				int lineCount = OutlierCount();
+				QueryInStrArray_CReg_RefMap(Outliers(), lineCount, queryAxB.c_str(), bitmaps[OUTL_PAT_NAME], bitmaps[OUTL_PAT_NAME]);
 			}
 			if(bitmaps[OUTL_PAT_NAME]->GetSize() == 0)
 			{
@@ -3866,7 +4258,7 @@ int LogStoreApi::SearchByLogic_not(char *args[MAX_CMD_ARG_COUNT], int argCountS,
 		}
 		else
 		{
-			BitMap* bitmap_outlier = new BitMap(m_glbMeta[OUTL_PAT_NAME]->lines);
+			BitMap* bitmap_outlier = new BitMap(OutlierCount());
 			bitmap_outlier->SetSize();
 			if(mCount == 1)
 			{
@@ -3881,8 +4273,8 @@ int LogStoreApi::SearchByLogic_not(char *args[MAX_CMD_ARG_COUNT], int argCountS,
 				string queryAxB(wArray[0]);
 				queryAxB += ".*";
 				queryAxB += wArray[1];
-				int lineCount = m_glbMeta[OUTL_PAT_NAME]->lines;
-				QueryInStrArray_CReg_RefMap(m_outliers, lineCount, queryAxB.c_str(), bitmaps[OUTL_PAT_NAME], bitmaps[OUTL_PAT_NAME]);
+				int lineCount = OutlierCount();
+				QueryInStrArray_CReg_RefMap(Outliers(), lineCount, queryAxB.c_str(), bitmaps[OUTL_PAT_NAME], bitmaps[OUTL_PAT_NAME]);
 			}
 			if(bitmap_outlier->BeSizeFul())
 			{
@@ -4064,7 +4456,7 @@ int LogStoreApi::SearchByLogic_norm(char *args[MAX_CMD_ARG_COUNT], int argCountS
 	ifind = bitmaps.find(OUTL_PAT_NAME);
 	if(ifind == bitmaps.end())
 	{
-		BitMap* bitmap_outlier = new BitMap(m_glbMeta[OUTL_PAT_NAME]->lines);
+		BitMap* bitmap_outlier = new BitMap(OutlierCount());
 		bitmap_outlier->SetSize();
 		if(mCount == 1)
 		{
@@ -4079,8 +4471,8 @@ int LogStoreApi::SearchByLogic_norm(char *args[MAX_CMD_ARG_COUNT], int argCountS
 			string queryAxB(wArray[0]);
 			queryAxB += ".*";
 			queryAxB += wArray[1];
-			int lineCount = m_glbMeta[OUTL_PAT_NAME]->lines;
-			QueryInStrArray_CReg(m_outliers, lineCount, queryAxB.c_str(), bitmap_outlier);
+			int lineCount = OutlierCount();
+			QueryInStrArray_CReg(Outliers(), lineCount, queryAxB.c_str(), bitmap_outlier);
 		}
 		if(bitmap_outlier->GetSize() == 0)
 		{
@@ -4120,7 +4512,7 @@ int LogStoreApi::SearchByLogic_norm(char *args[MAX_CMD_ARG_COUNT], int argCountS
 		}
 		else
 		{
-			BitMap* bitmap_outlier = new BitMap(m_glbMeta[OUTL_PAT_NAME]->lines);
+			BitMap* bitmap_outlier = new BitMap(OutlierCount());
 			bitmap_outlier->SetSize();
 			if(mCount == 1)
 			{
@@ -4341,7 +4733,7 @@ int LogStoreApi::SearchByLogic_norm_RefMap(char *args[MAX_CMD_ARG_COUNT], int ar
 	ifind = refbitmaps.find(OUTL_PAT_NAME);
 	if(ifind == refbitmaps.end())
 	{
-		BitMap* bitmap_outlier = new BitMap(m_glbMeta[OUTL_PAT_NAME]->lines);
+		BitMap* bitmap_outlier = new BitMap(OutlierCount());
 		bitmap_outlier->SetSize();
 		if(mCount == 1)
 		{
@@ -4393,7 +4785,7 @@ int LogStoreApi::SearchByLogic_norm_RefMap(char *args[MAX_CMD_ARG_COUNT], int ar
 			LISTBITMAPS::iterator ifind = bitmaps.find(OUTL_PAT_NAME);
 			if(ifind == bitmaps.end() || bitmaps[OUTL_PAT_NAME] != NULL)
 			{
-				bitmaps[OUTL_PAT_NAME] = new BitMap(m_glbMeta[OUTL_PAT_NAME]->lines);
+				bitmaps[OUTL_PAT_NAME] = new BitMap(OutlierCount());
 			}
 			if(mCount == 1)
 			{
@@ -4415,7 +4807,7 @@ int LogStoreApi::SearchByLogic_norm_RefMap(char *args[MAX_CMD_ARG_COUNT], int ar
 		}
 		else
 		{
-			BitMap* bitmap_outlier = new BitMap(m_glbMeta[OUTL_PAT_NAME]->lines);
+			BitMap* bitmap_outlier = new BitMap(OutlierCount());
 			bitmap_outlier->SetSize();
 			if(mCount == 1)
 			{
@@ -4804,7 +5196,7 @@ int LogStoreApi::SearchByLogic(char *args[MAX_CMD_ARG_COUNT], int argCount, OUT
 
     auto get_total_lines = [&](int pid) -> int {
         if(pid == OUTL_PAT_NAME) {
-            if(m_glbMeta.count(OUTL_PAT_NAME)) return m_glbMeta[OUTL_PAT_NAME]->lines;
+            if(FindCoffer(OUTL_PAT_NAME)) return OutlierCount();
             return 0;
         }
         if(m_patterns.count(pid)) return m_patterns[pid]->Count;
@@ -4818,8 +5210,8 @@ int LogStoreApi::SearchByLogic(char *args[MAX_CMD_ARG_COUNT], int argCount, OUT
             bm->SetSize(); 
             full[it.first]=bm; 
         } 
-        if(m_glbMeta.count(OUTL_PAT_NAME)) {
-            BitMap* bm = new BitMap(m_glbMeta[OUTL_PAT_NAME]->lines);
+        if(FindCoffer(OUTL_PAT_NAME)) {
+            BitMap* bm = new BitMap(OutlierCount());
             bm->SetSize();
             full[OUTL_PAT_NAME] = bm;
         }
@@ -4925,7 +5317,7 @@ int LogStoreApi::SearchByWildcard_Token(char *args[MAX_CMD_ARG_COUNT], int argCo
         Search_SingleSegment((char*)value.c_str(), bitmaps);
         RunStatus.SearchPatternTime = ___StatTime_End(tt1);
         timeval tt2 = ___StatTime_Start();
-        BitMap* bitmap_outlier = new BitMap(m_glbMeta[OUTL_PAT_NAME]->lines);
+        BitMap* bitmap_outlier = new BitMap(OutlierCount());
         bitmap_outlier->SetSize();
         if(!optStrict){
             GetOutliers_SinglToken((char*)value.c_str(), bitmap_outlier);
@@ -4952,13 +5344,10 @@ int LogStoreApi::SearchByWildcard_Token(char *args[MAX_CMD_ARG_COUNT], int argCo
         Search_SingleSegment(fargs[0], bitmaps);
         {
             std::lock_guard<std::mutex> lock(m_runStatusMutex);
-            {
-                std::lock_guard<std::mutex> lock(m_runStatusMutex);
-                RunStatus.SearchPatternTime = ___StatTime_End(tt1);
-            }
+            RunStatus.SearchPatternTime = ___StatTime_End(tt1);
         }
         timeval tt2 = ___StatTime_Start();
-        BitMap* bitmap_outlier = new BitMap(m_glbMeta[OUTL_PAT_NAME]->lines);
+        BitMap* bitmap_outlier = new BitMap(OutlierCount());
         bitmap_outlier->SetSize();
         GetOutliers_SinglToken(fargs[0], bitmap_outlier);
         bitmaps[OUTL_PAT_NAME] = bitmap_outlier;
@@ -5018,7 +5407,7 @@ int LogStoreApi::SearchByWildcard_Token(char *args[MAX_CMD_ARG_COUNT], int argCo
                 Search_MultiSegments(fargs, fcount, bitmaps);
                 RunStatus.SearchPatternTime = ___StatTime_End(tt1);
                 timeval tt2 = ___StatTime_Start();
-                BitMap* bitmap_outlier = new BitMap(m_glbMeta[OUTL_PAT_NAME]->lines);
+                BitMap* bitmap_outlier = new BitMap(OutlierCount());
                 bitmap_outlier->SetSize();
                 GetOutliers_MultiToken(fargs, 0, fcount-1, bitmap_outlier);
                 bitmaps[OUTL_PAT_NAME] = bitmap_outlier;
@@ -5185,7 +5574,7 @@ int LogStoreApi::SearchByWildcard_Token_JSON(char *args[MAX_CMD_ARG_COUNT], int
     if(fcount == 1)
     {
         Search_SingleSegment(fargs[0], bitmaps);
-        BitMap* bitmap_outlier = new BitMap(m_glbMeta[OUTL_PAT_NAME]->lines);
+        BitMap* bitmap_outlier = new BitMap(OutlierCount());
         bitmap_outlier->SetSize();
         GetOutliers_SinglToken(fargs[0], bitmap_outlier);
         bitmaps[OUTL_PAT_NAME] = bitmap_outlier;
@@ -5197,7 +5586,7 @@ int LogStoreApi::SearchByWildcard_Token_JSON(char *args[MAX_CMD_ARG_COUNT], int
         if(flag == 0)
         {
             Search_MultiSegments(fargs, fcount, bitmaps);
-            BitMap* bitmap_outlier = new BitMap(m_glbMeta[OUTL_PAT_NAME]->lines);
+            BitMap* bitmap_outlier = new BitMap(OutlierCount());
             bitmap_outlier->SetSize();
             GetOutliers_MultiToken(fargs, 0, fcount-1, bitmap_outlier);
             bitmaps[OUTL_PAT_NAME] = bitmap_outlier;
@@ -5275,7 +5664,7 @@ int LogStoreApi::CountByWildcard_Token(char *args[MAX_CMD_ARG_COUNT], int argCou
         Search_SingleSegment(fargs[0], bitmaps);
         RunStatus.SearchPatternTime = ___StatTime_End(tt1);
         timeval tt2 = ___StatTime_Start();
-        BitMap* bitmap_outlier = new BitMap(m_glbMeta[OUTL_PAT_NAME]->lines);
+        BitMap* bitmap_outlier = new BitMap(OutlierCount());
         bitmap_outlier->SetSize();
         GetOutliers_SinglToken(fargs[0], bitmap_outlier);
         bitmaps[OUTL_PAT_NAME] = bitmap_outlier;
@@ -5295,7 +5684,7 @@ int LogStoreApi::CountByWildcard_Token(char *args[MAX_CMD_ARG_COUNT], int argCou
             Search_MultiSegments(fargs, fcount, bitmaps);
             RunStatus.SearchPatternTime = ___StatTime_End(tt1);
             timeval tt2 = ___StatTime_Start();
-            BitMap* bitmap_outlier = new BitMap(m_glbMeta[OUTL_PAT_NAME]->lines);
+            BitMap* bitmap_outlier = new BitMap(OutlierCount());
             bitmap_outlier->SetSize();
             GetOutliers_MultiToken(fargs, 0, fcount-1, bitmap_outlier);
             bitmaps[OUTL_PAT_NAME] = bitmap_outlier;
@@ -5428,7 +5817,7 @@ int LogStoreApi::GetMatchedTimeRange(char *args[MAX_CMD_ARG_COUNT], int argCount
     tmin = LLONG_MAX; tmax = LLONG_MIN;
     LISTBITMAPS bitmaps; int r = BuildBitmapsForQuery(args, argCount, bitmaps);
     if(r <= 0) { for(auto &kv: bitmaps){ if(kv.second) delete kv.second; } return 0; }
-    if(m_timeValues.empty()) { for(auto &kv: bitmaps){ if(kv.second) delete kv.second; } return 0; }
+    if(EnsureTime() == 0) { for(auto &kv: bitmaps){ if(kv.second) delete kv.second; } return 0; }
     for(LISTBITMAPS::iterator it=bitmaps.begin(); it!=bitmaps.end(); ++it){ BitMap* bm=it->second; if(!bm) continue; int n=bm->GetSize(); for(int i=0;i<n;i++){ int idx=bm->GetIndex(i); if(idx>=0 && (size_t)idx<m_timeValues.size()){ long long v=m_timeValues[idx]; if(v<tmin) tmin=v; if(v>tmax) tmax=v; } } delete bm; }
     if(tmin==LLONG_MAX) return 0; return 1;
 }
@@ -5436,7 +5825,7 @@ int LogStoreApi::GetMatchedTimeRange(char *args[MAX_CMD_ARG_COUNT], int argCount
 int LogStoreApi::Timechart_Count_BySpan(char *args[MAX_CMD_ARG_COUNT], int argCount, long long span_ms, std::map<long long,int>& buckets)
 {
     buckets.clear(); if(span_ms<=0) return 0; LISTBITMAPS bitmaps; int r=BuildBitmapsForQuery(args, argCount, bitmaps); if(r<=0) { for(auto &kv: bitmaps){ if(kv.second) delete kv.second; } return 0; }
-    if(m_timeValues.empty()){ for(auto &kv: bitmaps){ if(kv.second) delete kv.second; } return 0; }
+    if(EnsureTime() == 0){ for(auto &kv: bitmaps){ if(kv.second) delete kv.second; } return 0; }
     for(LISTBITMAPS::iterator it=bitmaps.begin(); it!=bitmaps.end(); ++it){ BitMap* bm=it->second; if(!bm) continue; int n=bm->GetSize(); for(int i=0;i<n;i++){ int idx=bm->GetIndex(i); if(idx>=0 && (size_t)idx<m_timeValues.size()){ long long v=m_timeValues[idx]; long long b = (v / span_ms) * span_ms; buckets[b] += 1; } } delete bm; }
     return (int)buckets.size();
 }
@@ -5445,7 +5834,7 @@ int LogStoreApi::Timechart_Count_ByBins(char *args[MAX_CMD_ARG_COUNT], int argCo
 {
     counts.clear(); if(bins<=0) return 0; if(end_ms<=start_ms) return 0; long long width = (end_ms - start_ms) / bins; if(width<=0) width = 1; counts.resize(bins, 0);
     LISTBITMAPS bitmaps; int r=BuildBitmapsForQuery(args, argCount, bitmaps); if(r<=0) { for(auto &kv: bitmaps){ if(kv.second) delete kv.second; } return 0; }
-    if(m_timeValues.empty()){ for(auto &kv: bitmaps){ if(kv.second) delete kv.second; } return 0; }
+    if(EnsureTime() == 0){ for(auto &kv: bitmaps){ if(kv.second) delete kv.second; } return 0; }
     for(LISTBITMAPS::iterator it=bitmaps.begin(); it!=bitmaps.end(); ++it){ BitMap* bm=it->second; if(!bm) continue; int n=bm->GetSize(); for(int i=0;i<n;i++){ int idx=bm->GetIndex(i); if(idx>=0 && (size_t)idx<m_timeValues.size()){ long long v=m_timeValues[idx]; if(v<start_ms || v>end_ms) continue; long long off = v - start_ms; int bi = (int)(off / width); if(bi >= bins) bi = bins-1; counts[bi] += 1; } } delete bm; }
     return (int)counts.size();
 }
@@ -5463,7 +5852,7 @@ int LogStoreApi::Timechart_Count_BySpan_Group(char *args[MAX_CMD_ARG_COUNT], int
     bool isEmpty = (argCount == 1 && (args[0] == NULL || args[0][0] == '\0'));
     LISTBITMAPS bitmaps; int r=BuildBitmapsForQuery(args, argCount, bitmaps); 
     if(r<=0 && !isEmpty){ for(auto &kv: bitmaps){ if(kv.second) delete kv.second; } return 0; }
-    if(m_timeValues.empty()){ for(auto &kv: bitmaps){ if(kv.second) delete kv.second; } return 0; }
+    if(EnsureTime() == 0){ for(auto &kv: bitmaps){ if(kv.second) delete kv.second; } return 0; }
     VarAliasManager* mgr=VarAliasManager::getInstance(); std::vector<int> vids=mgr->getVarIds(groupAlias);
     for(size_t gi=0; gi<vids.size(); gi++){
         int gvar = vids[gi]; int pid = (gvar & 0xFFFF0000);
@@ -5493,7 +5882,7 @@ int LogStoreApi::Timechart_Count_BySpan_Group(char *args[MAX_CMD_ARG_COUNT], int
             for(int i=0;i<n;i++){
                 int glen = 0;
                 if (dic) {
-                    int dicIdx = atoi(meta->data + i * meta->eleLen, meta->eleLen);
+                    int dicIdx = GetEntryValue(meta->data, meta->eleLen, i);
                     if (dicIdx < dic->lines) {
                         int off = GetDicOffsetByEntry(m_subpatterns[gvar], dicIdx, glen);
                         RemovePadding(dic->data + off, glen, buf); glen = strlen(buf);
@@ -5513,7 +5902,7 @@ int LogStoreApi::Timechart_Count_BySpan_Group(char *args[MAX_CMD_ARG_COUNT], int
                 if(idx<0 || (size_t)idx>=m_timeValues.size()) continue;
                 int glen = 0;
                 if (dic) {
-                    int dicIdx = atoi(meta->data + idx * meta->eleLen, meta->eleLen);
+                    int dicIdx = GetEntryValue(meta->data, meta->eleLen, idx);
                     if (dicIdx < dic->lines) {
                         int off = GetDicOffsetByEntry(m_subpatterns[gvar], dicIdx, glen);
                         RemovePadding(dic->data + off, glen, buf); glen = strlen(buf);
@@ -5538,7 +5927,7 @@ int LogStoreApi::Timechart_Count_ByBins_Group(char *args[MAX_CMD_ARG_COUNT], int
     bool isEmpty = (argCount == 1 && (args[0] == NULL || args[0][0] == '\0'));
     LISTBITMAPS bitmaps; int r=BuildBitmapsForQuery(args, argCount, bitmaps); 
     if(r<=0 && !isEmpty){ for(auto &kv: bitmaps){ if(kv.second) delete kv.second; } return 0; }
-    if(m_timeValues.empty()){ for(auto &kv: bitmaps){ if(kv.second) delete kv.second; } return 0; }
+    if(EnsureTime() == 0){ for(auto &kv: bitmaps){ if(kv.second) delete kv.second; } return 0; }
     VarAliasManager* mgr=VarAliasManager::getInstance(); std::vector<int> vids=mgr->getVarIds(groupAlias);
     for(size_t gi=0; gi<vids.size(); gi++){
         int gvar = vids[gi]; int pid = (gvar & 0xFFFF0000);
@@ -5569,7 +5958,7 @@ int LogStoreApi::Timechart_Count_ByBins_Group(char *args[MAX_CMD_ARG_COUNT], int
                 long long v=m_timeValues[i]; if(v<start_ms || v>end_ms) continue; long long off=v-start_ms; int bi=(int)(off/width); if(bi>=bins) bi=bins-1;
                 int glen = 0;
                 if (dic) {
-                    int dicIdx = atoi(meta->data + i * meta->eleLen, meta->eleLen);
+                    int dicIdx = GetEntryValue(meta->data, meta->eleLen, i);
                     if (dicIdx < dic->lines) {
                         int off = GetDicOffsetByEntry(m_subpatterns[gvar], dicIdx, glen);
                         RemovePadding(dic->data + off, glen, buf); glen = strlen(buf);
@@ -5588,7 +5977,7 @@ int LogStoreApi::Timechart_Count_ByBins_Group(char *args[MAX_CMD_ARG_COUNT], int
                 if(idx<0 || (size_t)idx>=m_timeValues.size()) continue; long long v=m_timeValues[idx]; if(v<start_ms || v>end_ms) continue; long long off=v-start_ms; int bi=(int)(off/width); if(bi>=bins) bi=bins-1;
                 int glen = 0;
                 if (dic) {
-                    int dicIdx = atoi(meta->data + idx * meta->eleLen, meta->eleLen);
+                    int dicIdx = GetEntryValue(meta->data, meta->eleLen, idx);
                     if (dicIdx < dic->lines) {
                         int off = GetDicOffsetByEntry(m_subpatterns[gvar], dicIdx, glen);
                         RemovePadding(dic->data + off, glen, buf); glen = strlen(buf);
@@ -5717,7 +6106,7 @@ int LogStoreApi::FilterNumericVar(int varId, const char* expr, BitMap* bitmap){
         }
         if(matchedDicIndices.empty()) return 0;
 
-        int matchedCount = 0; int entryLen = entryMeta->eleLen;
+        int matchedCount = 0; int entryLen = __entry_pad_len(entryMeta);
         for(int idx : matchedDicIndices){
             char paddingStr[MAX_DICENTY_LEN]; IntPadding(idx, entryLen, paddingStr);
             matchedCount += QueryByBM_Pushdown_ForDic(entryname, paddingStr, 1, bitmap);
@@ -5727,8 +6116,29 @@ int LogStoreApi::FilterNumericVar(int varId, const char* expr, BitMap* bitmap){
 
     int varfname = varId + (varType == VAR_TYPE_SUB ? VAR_TYPE_SUB : VAR_TYPE_VAR);
     if(op==0){ char buf[64]; snprintf(buf,sizeof(buf),"%ld",A); int pass = CheckBloom(varfname, buf); if(pass==0) return 0; }
-    Coffer* meta=nullptr; int ret = DeCompressCapsule(varfname, meta, 1); if(ret <= 0) return 0;
+    if(CheckCapsuleRange(varfname, op, A, B) == 0) return 0;
     int matched = 0;
+    std::vector<long long> ints;
+    int rows = ReadIntCapsule(varfname, ints);
+    if(rows >= 0){
+        //typed FOR/DELTA column: compare the int64 values, the capsule is never decompressed to text
+        long long lo = LLONG_MIN, hi = LLONG_MAX;
+        switch(op){
+            case 0: lo = hi = A; break;
+            case 1: if(A == LLONG_MAX) return 0; lo = (long long)A + 1; break;
+            case 2: if(A == LLONG_MIN) return 0; hi = (long long)A - 1; break;
+            case 3: lo = A; break;
+            case 4: hi = A; break;
+            case 6: lo = A; hi = B; break;
+        }
+        const long long* v = ints.data();
+        for(int i=0; i< rows; i++){
+            bool ok = (op == 5) ? (v[i] != A) : (v[i] >= lo && v[i] <= hi);
+            if(ok){ bitmap->Union(i); matched++; }
+        }
+        return matched;
+    }
+    Coffer* meta=nullptr; int ret = DeCompressCapsule(varfname, meta, 1); if(ret <= 0) return 0;
     if(meta->eleLen > 0){
         for(int i=0; i< meta->lines; i++){
             char buf[MAX_VALUE_LEN]={0};
@@ -5773,11 +6183,61 @@ int LogStoreApi::FilterNumericVar(int varId, const char* expr, BitMap* bitmap){
     return matched;
 }
 
+//column statistics from the meta line, 0 when no row of the fixed width capsule varfname can contain
+//queryStr, so the capsule is never read. Only space free queries that fit the width are judged: a space
+//may match the padding, and the scanners treat over long queries each in their own way.
+int LogStoreApi::CheckCapsuleStats(int varfname, const char* queryStr){
+    Coffer* meta = FindCoffer(varfname);
+    if(meta == NULL || !meta->hasStats) return 1;
+    int qLen = strlen(queryStr);
+    if(qLen == 0 || qLen > meta->eleLen) return 1;
+    short tag = 0;
+    for(int i = 0; i < qLen; i++){
+        if(queryStr[i] == ' ') return 1;
+        tag |= GetCharTag(queryStr[i]);
+    }
+    if(qLen > meta->stats.maxLen){
+        Statistic.length_filtered_cap_cnt++;
+        Statistic.total_filtered_cap_cnt++;
+        return 0;
+    }
+    if((tag & meta->stats.charMask) != tag){
+        Statistic.tag_filtered_cap_cnt++;
+        Statistic.total_filtered_cap_cnt++;
+        return 0;
+    }
+    return 1;
+}
+
+//numeric range of the capsule against a FilterNumericVar expression, 0 when no row can satisfy it
+int LogStoreApi::CheckCapsuleRange(int varfname, int op, long A, long B){
+    Coffer* meta = FindCoffer(varfname);
+    if(meta == NULL || !meta->hasStats) return 1;
+    const CofferStats& st = meta->stats;
+    bool may = true;
+    if(st.numeric == 0) may = false;
+    else{
+        switch(op){
+            case 0: may = (A >= st.vmin && A <= st.vmax); break;
+            case 1: may = (st.vmax > A); break;
+            case 2: may = (st.vmin < A); break;
+            case 3: may = (st.vmax >= A); break;
+            case 4: may = (st.vmin <= A); break;
+            case 5: may = !(st.vmin == A && st.vmax == A); break;
+            case 6: may = (A <= st.vmax && B >= st.vmin); break;
+        }
+    }
+    if(!may){
+        Statistic.total_filtered_cap_cnt++;
+        return 0;
+    }
+    return 1;
+}
+
 int LogStoreApi::CheckBloom(int varfname, const char* value){
     int base = (varfname & (~0xF));
     int bloomId = base + VAR_TYPE_BLOOM;
-    LISTMETAS::iterator it = m_glbMeta.find(bloomId);
-    if(it == m_glbMeta.end() || it->second == NULL) return 1;
+    if(FindCoffer(bloomId) == NULL) return 1;
     Coffer* meta=nullptr; int r = DeCompressCapsule(bloomId, meta, 1); if(r <= 0 || !meta || !meta->data) return 1;
     if(meta->srcLen < 24) return 1;
     unsigned long long m_bits = *(unsigned long long*)(meta->data + 0);
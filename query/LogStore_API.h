@@ -2,7 +2,10 @@
 #define CMD_LOGSTOREAPI_H
 
 #include <zstd.h>
+#include <mutex>
+#include <atomic>
 #include "../compression/Coffer.h"
+#include "../compression/TimeColumn.h"
 
 #include "CmdDefine.h"
 #include "LogStructure.h"
@@ -42,6 +45,15 @@ typedef map<string, LISTBITMAPS> LISTSESSIONS;
 
 typedef char* CELL;
 
+//rows of one decoded seekable frame, materialization reads a row through it while the row falls inside
+typedef struct FrameCursor
+{
+	int first;
+	int count;
+	string buf;
+	FrameCursor(){ first = 0; count = 0; }
+}FrameCursor;
+
 
 typedef int(*pLoadPatCallback)(char*);
 
@@ -61,17 +73,33 @@ private:
 	int m_nServerHandle;
 	int m_fd;
 	FILE* m_fptr;
-	int m_glbMetaHeadLen;
+	long long m_glbMetaHeadLen;//absolute file offset of the first capsule
+	long long m_glbBase;//start of this capsule group in a streamed archive
+	long long m_glbEnd;//end of the last capsule of this group
+	unsigned char* m_map;//mapping of the archive from m_mapBase to the end of the file, NULL: read through m_fptr
+	size_t m_mapLen;
+	long long m_mapBase;//page aligned file offset of m_map
 	unsigned char m_lzmaMethod;
 	int m_maxBitmapSize;
 
-	LISTMETAS m_glbMeta;
+	LISTMETAS m_glbMeta;//coffers in use; for a binary directory made on first lookup by FindCoffer
+	char* m_dir;//decompressed binary capsule directory, NULL for a text meta
+	int m_dirCount;
+	unsigned int m_dirRecSize;
+	std::mutex m_metaMutex;
+	map<int, ZSTD_DDict*> m_ddicts;//digested zstd dictionaries by capsule name
 	LISTPATS m_patterns;
 	LISTSUBPATS m_subpatterns;
 	LISTSESSIONS m_sessions;
 	LISTOUTS m_varouts;
+	std::vector<int> m_varoutNames;//var outlier capsules, loaded on first use
 	char m_filePath[MAX_DIR_PATH];
 	CELL* m_outliers;
+	//outliers, var outliers and the time column are decompressed by the first query that needs them
+	std::mutex m_lazyMutex;
+	std::atomic<bool> m_outliersReady;
+	std::atomic<bool> m_varoutsReady;
+	std::atomic<bool> m_timeReady;
 	BitMap* m_glbExchgLogicmap;//to cache bitmap on logics
 	BitMap* m_glbExchgPatmap;//to cache bitmap on pats
 	BitMap* m_glbExchgBitmap;//to cache bitmap on vars
@@ -79,6 +107,7 @@ private:
     BitMap* m_glbExchgSubTempBitmap;//to cache bitmap on subvars while multi-pushdown
     // time-related caches
     std::vector<long long> m_timeValues;
+    std::vector<TimeBlock> m_timeBlocks;//per block min/max of the binary time column
     struct SegInfo { int sline; int eline; long long tmin; long long tmax; };
     std::vector<SegInfo> m_segments;
 
@@ -96,11 +125,19 @@ public:
 private:
 	int LoadFileToMem(const char *varname, int startPos, int bufLen, OUT char *mbuf);
 	unsigned char* LoadFileToMem(const char *varname, int startPos, int bufLen);
+	Coffer* FindCoffer(int patName);
+	int LoadCapsule(Coffer* coffer);
+	int ReadIntCapsule(int patName, std::vector<long long>& values);
 	int DeCompressCapsule(int patName, OUT Coffer* &coffer, int type=0);
+	int DeCompressCapsuleRows(int patName, int rowStart, int rowCount, OUT char* buf);
+	int UseFrames(Coffer* meta, BitMap* bitmap, int entryCnt);
+	char* SeekRow(int patName, Coffer* meta, int frameRows, int row, FrameCursor& cur);
+	ZSTD_DDict* LoadDictionary(int dictName);
 	int LzmaDeCompression(IN char* inBuf, OUT char* outBuf);
 	int DeepCloneMap(LISTBITMAPS source, LISTBITMAPS& des);
 
 	int BootLoader(char* path, char* file);
+    int MapArchive();
     int LoadGlbMetaHeader(char* filename, size_t& desLen, size_t& srcLen);
     int LoadGlbMetadata(char* filename, size_t desLen, size_t srcLen);
     int LoadMainPatternToGlbMap(IN char* deCompressedBuf, IN int srcLen);
@@ -109,9 +146,13 @@ private:
     int AddSubPatternToMap(int vid, char type, char* content);
     int LoadOutliers(IN char* deCompressedBuf, int sLen, int lineCount);
     int LoadVarOutliers(int filename, int lines, int srcLen);
+    CELL* Outliers();
+    int OutlierCount();
+    VarOutliers* VarOuts(int varFullName);
     // time index & column
     int LoadTimeColumn();
     int LoadTimeIndex();
+    int EnsureTime();
     BitMap* BuildTimeBitmap(long long start_ms, long long end_ms);
     void ApplyTimeFilterToBitmaps(LISTBITMAPS& bitmaps, long long start_ms, long long end_ms);
 
@@ -147,6 +188,8 @@ private:
 	int GetVarOutliers_BM(int varName, const char *queryStr, int queryType, BitMap* bitmap, BitMap* refBitmap);
 	int FilterNumericVar(int varId, const char* expr, BitMap* bitmap);
 	int CheckBloom(int varfname, const char* value);
+	int CheckCapsuleStats(int varfname, const char* queryStr);
+	int CheckCapsuleRange(int varfname, int op, long A, long B);
 	int GetOutliers_MultiToken(char *args[MAX_CMD_ARG_COUNT], int argCountS, int argCountE, BitMap* bitmap, bool beReverse=false);
 	int GetOutliers_SinglToken(char *arg, BitMap* bitmap, bool beReverse=false);
 	int GetOutliers_MultiToken_RefMap(char *args[MAX_CMD_ARG_COUNT], int argCountS, int argCountE, BitMap* bitmap, BitMap* refbitmap, bool beReverse=false);
@@ -174,7 +217,7 @@ private:
 	int SearchByLogic_norm_or(char *args[MAX_CMD_ARG_COUNT], int argCountS, int argCountE, OUT LISTBITMAPS& bitmaps);
 	int SearchByLogic_not(char *args[MAX_CMD_ARG_COUNT], int argCountS, int argCountE, OUT LISTBITMAPS& bitmap);
 
-	int RebuiltData_Subpat(char* data, int entryLen, int index, int no, int outfilename, string constStr, OUT char* vars);
+	int RebuiltData_Subpat(char* content, int entryLen, int index, int no, int outfilename, string constStr, OUT char* vars);
 	int Materialization(int pid, BitMap* bitmap, int bitmapSize, int matSize);
 	int Materialization_JSON(int pid, BitMap* bitmap, int bitmapSize, int matSize, std::string &json_out);
 	int Materializ_Pats(int varname, BitMap* bitmap, int entryCnt, OUT char* vars);
@@ -192,7 +235,8 @@ public:
 	** reference : establish access to logStore
 	** return : patterns count 0: disconnected
 	*/
-	int Connect(char *logStorePath, char* fileName);
+	int Connect(char *logStorePath, char* fileName, long long groupOffset = 0);
+	long long GetGroupEnd();
 
 	/*
 	** reference : close a connection access to logStore
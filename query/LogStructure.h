@@ -33,6 +33,7 @@ using namespace std;
 #define MAX_DICENTY_LEN       10
 #define MAX_MATERIAL_SIZE     200
 #define MAX_SESSION_SIZE      10  
+#define MAP_WILLNEED_MIN      16384 //mapped capsules larger than this get MADV_WILLNEED before decompression
 
 //multi thread ctrl
 #define MAX_THREAD_PARALLEL		1
@@ -85,6 +86,10 @@ using namespace std;
 #define VAR_TYPE_TIMECOL   8  //.time column
 #define VAR_TYPE_TIMEINDEX 9  //.time index
 #define VAR_TYPE_BLOOM     10
+#define VAR_TYPE_ZDICT     11 //zstd dictionary
+#define VAR_TYPE_HLL       12 //column distinct sketch
+
+#define ELE_BITPACKED      -6 //eleLen of bit-packed .entry: [int bits][bit stream][8 bytes pad]
 
 #define MAIN_PAT_NAME      VAR_TYPE_TMPLS//"templates.txt"
 #define SUBV_PAT_NAME      VAR_TYPE_VARLIST//"variables.txt"
@@ -2,6 +2,12 @@
 #include <regex.h>
 
 #include <sys/time.h>
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PACKED_X86 1
+#endif
 
 //cache badc and goods to speedup, shoule release mem after quit
 map<string, int*> map_badc; 
@@ -2455,6 +2461,258 @@ int DicPatternMatch(SubPattern* pat, const char* source, int matchType, OUT RegM
 	return regResult->Count;
 }
 
+/////////////////////////bit-packed entry columns/////////////////////////
+#define PACKED_BLOCK 1024
+
+typedef void (*UnpackFunc)(const unsigned char*, int, int, int, unsigned int*);
+typedef void (*MatchFunc)(const unsigned int*, int, const int*, int, unsigned char*);
+
+static inline int packed_bits(const char* data)
+{
+	int bits;
+	memcpy(&bits, data, sizeof(int));
+	return bits;
+}
+
+static inline unsigned int packed_at(const unsigned char* p, int bits, long long idx)
+{
+	unsigned long long bit = (unsigned long long)idx * bits;
+	unsigned long long w;
+	memcpy(&w, p + (bit >> 3), sizeof(w));
+	return (unsigned int)((w >> (bit & 7)) & ((1ULL << bits) - 1));
+}
+
+static void unpack_scalar(const unsigned char* p, int bits, int start, int cnt, unsigned int* out)
+{
+	for(int i=0;i<cnt;i++)
+	{
+		out[i] = packed_at(p, bits, (long long)start + i);
+	}
+}
+
+static void match_scalar(const unsigned int* v, int cnt, const int* vals, int valCnt, unsigned char* marks)
+{
+	for(int i=0;i<cnt;i++)
+	{
+		unsigned char hit = 0;
+		for(int k=0;k<valCnt;k++) hit |= (v[i] == (unsigned int)vals[k]);
+		marks[i] = hit;
+	}
+}
+
+#ifdef PACKED_X86
+//8 rows per gather, a lane reads 4 bytes so bits + 7 must fit in 32
+__attribute__((target("avx2")))
+static void unpack_avx2(const unsigned char* p, int bits, int start, int cnt, unsigned int* out)
+{
+	if(bits > 25)
+	{
+		unpack_scalar(p, bits, start, cnt, out);
+		return;
+	}
+	const __m256i lane = _mm256_mullo_epi32(_mm256_setr_epi32(0,1,2,3,4,5,6,7), _mm256_set1_epi32(bits));
+	const __m256i mask = _mm256_set1_epi32((int)((1u << bits) - 1));
+	const __m256i seven = _mm256_set1_epi32(7);
+	int i = 0;
+	for(; i + 8 <= cnt; i += 8)
+	{
+		unsigned long long bit = (unsigned long long)(start + i) * bits;
+		__m256i off = _mm256_add_epi32(lane, _mm256_set1_epi32((int)(bit & 7)));
+		__m256i w = _mm256_i32gather_epi32((const int*)(p + (bit >> 3)), _mm256_srli_epi32(off, 3), 1);
+		w = _mm256_srlv_epi32(w, _mm256_and_si256(off, seven));
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_and_si256(w, mask));
+	}
+	unpack_scalar(p, bits, start + i, cnt - i, out + i);
+}
+
+__attribute__((target("avx2")))
+static void match_avx2(const unsigned int* v, int cnt, const int* vals, int valCnt, unsigned char* marks)
+{
+	int i = 0;
+	for(; i + 8 <= cnt; i += 8)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i*)(v + i));
+		__m256i hit = _mm256_setzero_si256();
+		for(int k=0;k<valCnt;k++)
+		{
+			hit = _mm256_or_si256(hit, _mm256_cmpeq_epi32(x, _mm256_set1_epi32(vals[k])));
+		}
+		int m = _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+		for(int j=0;j<8;j++) marks[i + j] = (m >> j) & 1;
+	}
+	match_scalar(v + i, cnt - i, vals, valCnt, marks + i);
+}
+#endif
+
+static bool packed_simd()
+{
+	static bool simd = [](){
+		const char* sv = getenv("LOGGREP_SIMD");
+		if(sv && atoi(sv) == 0) return false;
+#ifdef PACKED_X86
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#else
+		return false;
+#endif
+	}();
+	return simd;
+}
+
+static UnpackFunc get_unpack()
+{
+#ifdef PACKED_X86
+	if(packed_simd()) return unpack_avx2;
+#endif
+	return unpack_scalar;
+}
+
+static MatchFunc get_match()
+{
+#ifdef PACKED_X86
+	if(packed_simd()) return match_avx2;
+#endif
+	return match_scalar;
+}
+
+int GetEntryValue(const char* data, int eleLen, int index)
+{
+	if(eleLen == ELE_BITPACKED)
+	{
+		return packed_at((const unsigned char*)data + sizeof(int), packed_bits(data), index);
+	}
+	return atoi((char*)data + index * eleLen, eleLen);
+}
+
+void Packed_Unpack(const char* data, int start, int cnt, unsigned int* out)
+{
+	get_unpack()((const unsigned char*)data + sizeof(int), packed_bits(data), start, cnt, out);
+}
+
+//many dic hits: test through a lookup table instead of comparing with each one
+static unsigned char* packed_table(const int* vals, int valCnt, unsigned int& tableLen)
+{
+	tableLen = 0;
+	if(valCnt <= 4) return NULL;
+	for(int k=0;k<valCnt;k++) if(vals[k] >= 0 && (unsigned int)vals[k] >= tableLen) tableLen = vals[k] + 1;
+	unsigned char* table = new unsigned char[tableLen + 1];
+	memset(table, 0, tableLen + 1);
+	for(int k=0;k<valCnt;k++) if(vals[k] >= 0) table[vals[k]] = 1;
+	return table;
+}
+
+int Packed_Equal(const char* data, int lines, const int* vals, int valCnt, BitMap* bitmap)
+{
+	UnpackFunc unpack = get_unpack();
+	MatchFunc match = get_match();
+	const unsigned char* p = (const unsigned char*)data + sizeof(int);
+	int bits = packed_bits(data);
+	unsigned int tableLen;
+	unsigned char* table = packed_table(vals, valCnt, tableLen);
+	unsigned int buf[PACKED_BLOCK];
+	unsigned char marks[PACKED_BLOCK];
+	for(int s=0;s<lines;s+=PACKED_BLOCK)
+	{
+		int cnt = (lines - s < PACKED_BLOCK) ? lines - s : PACKED_BLOCK;
+		unpack(p, bits, s, cnt, buf);
+		if(table)
+		{
+			for(int i=0;i<cnt;i++) marks[i] = buf[i] < tableLen && table[buf[i]];
+		}
+		else
+		{
+			match(buf, cnt, vals, valCnt, marks);
+		}
+		for(int i=0;i<cnt;i++)
+		{
+			if(marks[i]) bitmap->Union(s + i);
+		}
+	}
+	if(table) delete[] table;
+	return bitmap->GetSize();
+}
+
+int Packed_Equal_Pushdown(const char* data, int lines, const int* vals, int valCnt, BitMap* bitmap)
+{
+	if(bitmap->GetSize() == 0)//if bitmap is empty, return directly
+	{
+		return 0;
+	}
+	if(bitmap->BeSizeFul())//if bitmap is a universal set, then use union
+	{
+		bitmap->Reset();
+		return Packed_Equal(data, lines, vals, valCnt, bitmap);
+	}
+	const unsigned char* p = (const unsigned char*)data + sizeof(int);
+	int bits = packed_bits(data);
+	unsigned int tableLen;
+	unsigned char* table = packed_table(vals, valCnt, tableLen);
+	int bitmapSize = bitmap->GetSize();
+	bitmap->ResetSize();//only simple set Index[] size
+	for(int i=0;i< bitmapSize;i++)
+	{
+		int idx = bitmap->GetIndex(i);
+		bool hit = false;
+		if(idx < lines)
+		{
+			unsigned int v = packed_at(p, bits, idx);
+			if(table)
+			{
+				hit = v < tableLen && table[v];
+			}
+			else
+			{
+				for(int k=0;k<valCnt && !hit;k++) hit = (v == (unsigned int)vals[k]);
+			}
+		}
+		if(hit)
+		{
+			bitmap->Inset(idx);// only set Index[]
+		}
+		else
+		{
+			bitmap->Reset(idx);// only set bitmap as 0
+		}
+	}
+	if(table) delete[] table;
+	return bitmap->GetSize();
+}
+
+int Packed_Equal_Pushdown_RefMap(const char* data, int lines, const int* vals, int valCnt, BitMap* bitmap, BitMap* refBitmap)
+{
+	if(refBitmap->GetSize() == 0)//if bitmap is empty, return directly
+	{
+		return 0;
+	}
+	if(refBitmap->BeSizeFul())//if bitmap is a universal set, then use union
+	{
+		return Packed_Equal(data, lines, vals, valCnt, bitmap);
+	}
+	const unsigned char* p = (const unsigned char*)data + sizeof(int);
+	int bits = packed_bits(data);
+	unsigned int tableLen;
+	unsigned char* table = packed_table(vals, valCnt, tableLen);
+	int bitmapSize = refBitmap->GetSize();
+	for(int i=0;i< bitmapSize;i++)
+	{
+		int idx = refBitmap->GetIndex(i);
+		if(idx >= lines) continue;
+		unsigned int v = packed_at(p, bits, idx);
+		bool hit = false;
+		if(table)
+		{
+			hit = v < tableLen && table[v];
+		}
+		else
+		{
+			for(int k=0;k<valCnt && !hit;k++) hit = (v == (unsigned int)vals[k]);
+		}
+		if(hit) bitmap->Union(idx);
+	}
+	if(table) delete[] table;
+	return bitmap->GetSize();
+}
+
 int Alg_Test()
 {
 	
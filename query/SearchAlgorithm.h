@@ -76,6 +76,16 @@ extern int GetCvars_Fixed(char* text, int lineLen, int lineCnt, OUT char *vars,
 extern int GetCvarsByBitmap_Diff(char* text, int sLen, int minLineLen, BitMap* bitmap, OUT char *vars, int entryCnt, int varsLineLen, bool flag=true);
 extern int GetCvars_Diff(char* text, int sLen, OUT char *vars, int entryCnt, int varsLineLen, bool flag=true);
 
+/*
+** bit-packed entry columns (eleLen == ELE_BITPACKED), values are dic indexes
+** Packed_*: same bitmap semantics as BM_Fixed_Align / BM_Fixed_Pushdown / BM_Fixed_Pushdown_RefMap
+*/
+extern int GetEntryValue(const char* data, int eleLen, int index);
+extern void Packed_Unpack(const char* data, int start, int cnt, unsigned int* out);
+extern int Packed_Equal(const char* data, int lines, const int* vals, int valCnt, BitMap* bitmap);
+extern int Packed_Equal_Pushdown(const char* data, int lines, const int* vals, int valCnt, BitMap* bitmap);
+extern int Packed_Equal_Pushdown_RefMap(const char* data, int lines, const int* vals, int valCnt, BitMap* bitmap, BitMap* refBitmap);
+
 int MatchInSubpatVar_Forward(int strTag_mark, int maxlen_mark, const char* source, int souLen, int& souIndex);
 int MatchInSubpatVar_Backward(int strTag_mark, int maxlen_mark, const char* source, int& souIndex);
 int MatchInSubPatConst_Forward(const char* patConst, int patLen, const char* source, int souLen, int& souIndex);
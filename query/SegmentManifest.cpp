@@ -0,0 +1,401 @@
+#include "SegmentManifest.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <cctype>
+#include <strings.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zstd.h>
+#include "../compression/constant.h"
+#include "../compression/CapsuleDir.h"
+#include "../compression/TimeParser.h"
+
+static uint32_t manifest_crc32(const char* data, size_t len){
+    uint32_t crc = 0xFFFFFFFFu;
+    for(size_t i=0;i<len;i++){
+        crc ^= (uint8_t)data[i];
+        for(int j=0;j<8;j++){ uint32_t mask = -(int)(crc & 1); crc = (crc >> 1) ^ (0xEDB88320u & mask); }
+    }
+    return ~crc;
+}
+
+static std::string manifest_join(const std::string& dir, const std::string& name){
+    if(dir.empty()) return name;
+    if(dir[dir.size()-1]=='/') return dir + name;
+    return dir + "/" + name;
+}
+
+static int manifest_read_file(const std::string& path, std::string& out){
+    out.clear();
+    FILE* f = fopen(path.c_str(), "rb");
+    if(!f) return -1;
+    char tmp[65536];
+    size_t r;
+    while((r = fread(tmp, 1, sizeof(tmp), f)) > 0) out.append(tmp, r);
+    fclose(f);
+    return (int)out.size();
+}
+
+//case folded byte trigram, the bloom key
+static inline uint32_t gram_at(const char* p){
+    return ((uint32_t)(uint8_t)tolower((uint8_t)p[0]) << 16) | ((uint32_t)(uint8_t)tolower((uint8_t)p[1]) << 8) | (uint32_t)(uint8_t)tolower((uint8_t)p[2]);
+}
+
+static inline void gram_bits(uint32_t g, uint32_t mask, uint32_t pos[SEG_BLOOM_K]){
+    uint64_t x = g + 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    uint32_t h1 = (uint32_t)x, h2 = (uint32_t)(x >> 32) | 1;
+    for(int i=0;i<SEG_BLOOM_K;i++) pos[i] = (h1 + (uint32_t)i * h2) & mask;
+}
+
+static uint32_t bloom_max_bits(){
+    const char* v = getenv("LOGGREP_MANIFEST_BLOOM_BITS");
+    if(!v) return SEG_BLOOM_MAX_BITS;
+    long long x = strtoll(v, NULL, 10);
+    if(x <= 0) return 0;
+    uint32_t bits = SEG_BLOOM_MIN_BITS;
+    while(bits < (uint32_t)(1<<24) && (long long)bits * 2 <= x) bits <<= 1;
+    return bits;
+}
+
+//capsule sizes and template ids from the directory of the first capsule group
+static void summarize_archive(const std::string& path, SegmentEntry& out){
+    FILE* f = fopen(path.c_str(), "rb");
+    if(!f) return;
+    size_t destLen = 0, srcLen = 0;
+    std::string cbuf, meta;
+    if(fread(&destLen, sizeof(size_t), 1, f) == 1 && fread(&srcLen, sizeof(size_t), 1, f) == 1
+        && destLen > 0 && srcLen > 0 && destLen < (1u<<30) && srcLen < (1u<<30))
+    {
+        cbuf.resize(destLen);
+        if(fread(&cbuf[0], 1, destLen, f) == destLen)
+        {
+            meta.resize(srcLen);
+            size_t n = ZSTD_decompress(&meta[0], srcLen, cbuf.data(), destLen);
+            if(ZSTD_isError(n)) meta.clear();
+            else meta.resize(n);
+        }
+    }
+    fclose(f);
+    uint32_t recSize = 0;
+    int count = capsule_dir_count(meta.data(), meta.size(), recSize);
+    if(count <= 0) return;
+    for(int i=0;i<count;i++){
+        const CapsuleRecord* r = capsule_dir_at(meta.data(), recSize, i);
+        out.capsules++;
+        out.capsuleBytes += r->destLen;
+        out.rawBytes += r->srcLen;
+        uint32_t sid = (uint32_t)r->id >> POS_TEMPLATE;
+        if(sid) out.templates.push_back(sid);
+    }
+    std::sort(out.templates.begin(), out.templates.end());
+    out.templates.erase(std::unique(out.templates.begin(), out.templates.end()), out.templates.end());
+}
+
+int segment_summarize(const std::string& path, const char* buf, size_t len, long long startMs, long long endMs, SegmentEntry& out){
+    size_t slash = path.rfind('/');
+    out = SegmentEntry();
+    out.name = slash == std::string::npos ? path : path.substr(slash + 1);
+    //timestamps as the compressor reads them into the time column
+    TimestampCache cache;
+    long long tmin = LLONG_MAX, tmax = LLONG_MIN;
+    bool untimed = false;
+    std::vector<uint64_t> seen((1u<<24) / 64, 0);
+    std::vector<uint32_t> grams;
+    size_t pos = 0;
+    while(pos < len){
+        const char* nl = (const char*)memchr(buf + pos, '\n', len - pos);
+        size_t end = nl ? (size_t)(nl - buf) : len;
+        int lineLen = (int)(end - pos);
+        long long ts = 0;
+        std::pair<int,int> span = detect_timestamp_span(buf + pos, lineLen);
+        if(span.first >= 0 && cache.parse(buf + pos + span.first, span.second, ts)){
+            if(ts < tmin) tmin = ts;
+            if(ts > tmax) tmax = ts;
+        }
+        else untimed = true;
+        for(size_t i = pos; i + 2 < end; i++){
+            uint32_t g = gram_at(buf + i);
+            if(seen[g >> 6] & (1ULL << (g & 63))) continue;
+            seen[g >> 6] |= 1ULL << (g & 63);
+            grams.push_back(g);
+        }
+        out.lines++;
+        pos = end + 1;
+    }
+    if(untimed || out.lines == 0){
+        if(startMs < tmin) tmin = startMs;
+        if(endMs > tmax) tmax = endMs;
+    }
+    out.tmin = tmin;
+    out.tmax = tmax;
+
+    uint32_t maxBits = bloom_max_bits();
+    if(maxBits > 0){
+        uint32_t bits = SEG_BLOOM_MIN_BITS;
+        while(bits < maxBits && (uint64_t)bits < (uint64_t)grams.size() * SEG_BLOOM_BITS_PER_GRAM) bits <<= 1;
+        out.bloomBits = bits;
+        out.bloom.assign(bits / 8, '\0');
+        uint32_t p[SEG_BLOOM_K];
+        for(size_t i=0;i<grams.size();i++){
+            gram_bits(grams[i], bits - 1, p);
+            for(int k=0;k<SEG_BLOOM_K;k++) out.bloom[p[k] >> 3] |= (char)(1 << (p[k] & 7));
+        }
+    }
+    summarize_archive(path, out);
+    return 1;
+}
+
+/////////////////////////record/////////////////
+
+static void put(std::string& s, const void* p, size_t n){ s.append((const char*)p, n); }
+
+static std::string encode_record(uint8_t op, const SegmentEntry& e){
+    std::string payload;
+    put(payload, &op, 1);
+    uint16_t nameLen = (uint16_t)e.name.size();
+    put(payload, &nameLen, sizeof(nameLen));
+    payload.append(e.name, 0, nameLen);
+    if(op == SEG_MANIFEST_ADD){
+        int64_t v[5] = {e.tmin, e.tmax, e.lines, e.capsuleBytes, e.rawBytes};
+        put(payload, v, sizeof(v));
+        int32_t capsules = e.capsules;
+        put(payload, &capsules, sizeof(capsules));
+        uint32_t tplCnt = (uint32_t)e.templates.size();
+        put(payload, &tplCnt, sizeof(tplCnt));
+        if(tplCnt) put(payload, &e.templates[0], tplCnt * sizeof(uint32_t));
+        uint32_t bloomBits = e.bloomBits;
+        put(payload, &bloomBits, sizeof(bloomBits));
+        payload.append(e.bloom);
+    }
+    std::string rec;
+    uint32_t magic = SEG_MANIFEST_MAGIC, len = (uint32_t)payload.size();
+    uint32_t crc = manifest_crc32(payload.data(), payload.size());
+    put(rec, &magic, sizeof(magic));
+    put(rec, &len, sizeof(len));
+    rec.append(payload);
+    put(rec, &crc, sizeof(crc));
+    return rec;
+}
+
+typedef struct RecordCursor
+{
+    const char* p;
+    size_t left;
+    bool get(void* dst, size_t n){ if(n > left) return false; memcpy(dst, p, n); p += n; left -= n; return true; }
+}RecordCursor;
+
+//returns the length of the valid prefix of data
+long long SegmentManifest::Parse(const std::string& data){
+    m_entries.clear();
+    m_dead = 0;
+    size_t pos = 0;
+    while(pos + 12 <= data.size()){
+        uint32_t magic, len, crc;
+        memcpy(&magic, data.data() + pos, 4);
+        memcpy(&len, data.data() + pos + 4, 4);
+        if(magic != SEG_MANIFEST_MAGIC || len > data.size() - pos - 12) break;
+        const char* payload = data.data() + pos + 8;
+        memcpy(&crc, payload + len, 4);
+        if(crc != manifest_crc32(payload, len)) break;
+        RecordCursor c = {payload, len};
+        uint8_t op = 0;
+        uint16_t nameLen = 0;
+        if(!c.get(&op, 1) || !c.get(&nameLen, 2) || nameLen > c.left) break;
+        SegmentEntry e;
+        e.name.assign(c.p, nameLen);
+        c.p += nameLen; c.left -= nameLen;
+        if(op == SEG_MANIFEST_ADD){
+            int64_t v[5];
+            int32_t capsules;
+            uint32_t tplCnt, bloomBits;
+            if(!c.get(v, sizeof(v)) || !c.get(&capsules, 4) || !c.get(&tplCnt, 4) || tplCnt > c.left / 4) break;
+            e.tmin = v[0]; e.tmax = v[1]; e.lines = v[2]; e.capsuleBytes = v[3]; e.rawBytes = v[4];
+            e.capsules = capsules;
+            e.templates.resize(tplCnt);
+            if(tplCnt) c.get(&e.templates[0], tplCnt * 4);
+            if(!c.get(&bloomBits, 4) || (size_t)bloomBits / 8 != c.left) break;
+            e.bloomBits = bloomBits;
+            e.bloom.assign(c.p, c.left);
+            if(m_entries.count(e.name)) m_dead++;
+            m_entries[e.name] = e;
+        }
+        else if(op == SEG_MANIFEST_DROP){
+            if(m_entries.erase(e.name)) m_dead++;
+            m_dead++;
+        }
+        else break;
+        pos += 12 + len;
+    }
+    return (long long)pos;
+}
+
+/////////////////////////manifest/////////////////
+
+SegmentManifest::SegmentManifest(): m_fd(-1), m_dead(0) {}
+
+SegmentManifest::~SegmentManifest(){ Close(); }
+
+void SegmentManifest::Close(){
+    if(m_fd >= 0){ ::close(m_fd); m_fd = -1; }
+}
+
+int SegmentManifest::Load(const std::string& dir){
+    m_path = manifest_join(dir, SEG_MANIFEST_NAME);
+    std::string data;
+    if(manifest_read_file(m_path, data) <= 0){ m_entries.clear(); return 0; }
+    Parse(data);
+    return Size();
+}
+
+int SegmentManifest::Open(const std::string& dir){
+    Close();
+    m_path = manifest_join(dir, SEG_MANIFEST_NAME);
+    std::string data;
+    manifest_read_file(m_path, data);
+    long long valid = Parse(data);
+    m_fd = ::open(m_path.c_str(), O_CREAT|O_WRONLY|O_APPEND, 0644);
+    if(m_fd < 0) return -1;
+    //a torn record from a crash, later appends must not land behind it
+    if(valid < (long long)data.size() && ftruncate(m_fd, (off_t)valid) != 0) return -1;
+    //segments removed while no writer was running
+    for(std::map<std::string, SegmentEntry>::iterator it = m_entries.begin(); it != m_entries.end(); ){
+        struct stat st;
+        if(stat(manifest_join(dir, it->first).c_str(), &st) != 0){ m_entries.erase(it++); m_dead++; }
+        else ++it;
+    }
+    if(m_dead > 0 && m_dead >= Size()) Rewrite();
+    return Size();
+}
+
+int SegmentManifest::Append(const SegmentEntry& e){
+    if(m_fd < 0) return -1;
+    std::string rec = encode_record(SEG_MANIFEST_ADD, e);
+    struct stat st;
+    if(fstat(m_fd, &st) != 0) return -1;
+    ssize_t w = ::write(m_fd, rec.data(), rec.size());
+    if(w != (ssize_t)rec.size()){
+        ftruncate(m_fd, st.st_size);
+        return -1;
+    }
+    fdatasync(m_fd);
+    if(m_entries.count(e.name)) m_dead++;
+    m_entries[e.name] = e;
+    return 1;
+}
+
+int SegmentManifest::Drop(const std::string& name){
+    if(m_fd < 0 || m_entries.find(name) == m_entries.end()) return 0;
+    SegmentEntry e;
+    e.name = name;
+    std::string rec = encode_record(SEG_MANIFEST_DROP, e);
+    struct stat st;
+    if(fstat(m_fd, &st) != 0) return -1;
+    if(::write(m_fd, rec.data(), rec.size()) != (ssize_t)rec.size()){
+        ftruncate(m_fd, st.st_size);
+        return -1;
+    }
+    m_entries.erase(name);
+    m_dead += 2;
+    if(m_dead >= Size()) Rewrite();
+    return 1;
+}
+
+//live records into a new file, renamed over the old one
+int SegmentManifest::Rewrite(){
+    std::string tmp = m_path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_CREAT|O_TRUNC|O_WRONLY, 0644);
+    if(fd < 0) return -1;
+    std::string out;
+    for(std::map<std::string, SegmentEntry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it){
+        out.append(encode_record(SEG_MANIFEST_ADD, it->second));
+    }
+    bool ok = ::write(fd, out.data(), out.size()) == (ssize_t)out.size() && fsync(fd) == 0;
+    ::close(fd);
+    if(!ok || rename(tmp.c_str(), m_path.c_str()) != 0){ unlink(tmp.c_str()); return -1; }
+    Close();
+    m_fd = ::open(m_path.c_str(), O_CREAT|O_WRONLY|O_APPEND, 0644);
+    m_dead = 0;
+    return m_fd < 0 ? -1 : 1;
+}
+
+const SegmentEntry* SegmentManifest::Find(const std::string& name) const{
+    std::map<std::string, SegmentEntry>::const_iterator it = m_entries.find(name);
+    return it == m_entries.end() ? NULL : &it->second;
+}
+
+/////////////////////////filter/////////////////
+
+SegmentFilter::SegmentFilter(): m_hasTime(false), m_tstart(LLONG_MIN), m_tend(LLONG_MAX) {}
+
+static long long filter_time_arg(const char* s){
+    long long out = 0;
+    if(parse_timestamp_ms(s, (int)strlen(s), out)) return out;
+    return atoll(s);
+}
+
+int SegmentFilter::Build(char* args[], int argCount){
+    m_hasTime = false;
+    m_grams.clear();
+    bool logic = false, skipValue = false;
+    std::vector<std::string> lits;
+    for(int i=0;i<argCount;i++){
+        const char* a = args[i];
+        if(!a || !*a) continue;
+        size_t n = strlen(a);
+        if(strcmp(a, "-time")==0 && i+2<argCount){
+            m_tstart = filter_time_arg(args[i+1]);
+            m_tend = filter_time_arg(args[i+2]);
+            m_hasTime = true;
+            i += 2;
+            continue;
+        }
+        if(strcasecmp(a, "and")==0) continue;
+        if(strcasecmp(a, "or")==0 || strcasecmp(a, "not")==0 || strspn(a, "(),")==n){ logic = true; continue; }
+        //split field operator (server tokenizer): the field is an alias, a compared value is not text
+        if(strspn(a, ":=<>!")==n){
+            if(!lits.empty()) lits.pop_back();
+            skipValue = strcmp(a, ":")!=0;
+            continue;
+        }
+        if(skipValue){ skipValue = false; continue; }
+        lits.push_back(a);
+    }
+    //or/not/groups: a segment may match without a given literal
+    for(size_t i=0;i<lits.size() && !logic;i++){
+        std::string s = lits[i];
+        size_t colon = s.find(':');
+        if(colon != std::string::npos && colon > 0) s = s.substr(colon + 1);
+        //numeric filters, options and groups are not literal text
+        if(s.find_first_of("<>=!()|\"\\") != std::string::npos) continue;
+        size_t start = 0;
+        while(start < s.size()){
+            size_t stop = s.find_first_of("*?", start);
+            if(stop == std::string::npos) stop = s.size();
+            for(size_t j = start; j + 3 <= stop; j++) m_grams.push_back(gram_at(s.c_str() + j));
+            start = stop + 1;
+        }
+    }
+    std::sort(m_grams.begin(), m_grams.end());
+    m_grams.erase(std::unique(m_grams.begin(), m_grams.end()), m_grams.end());
+    return (m_hasTime || !m_grams.empty()) ? 1 : 0;
+}
+
+bool SegmentFilter::Keep(const SegmentEntry& e) const{
+    if(m_hasTime && (e.tmax < m_tstart || e.tmin > m_tend)) return false;
+    if(e.bloomBits == 0 || (e.bloomBits & (e.bloomBits - 1)) != 0 || e.bloom.size() * 8 != e.bloomBits) return true;
+    uint32_t p[SEG_BLOOM_K];
+    for(size_t i=0;i<m_grams.size();i++){
+        gram_bits(m_grams[i], e.bloomBits - 1, p);
+        for(int k=0;k<SEG_BLOOM_K;k++){
+            if(!(e.bloom[p[k] >> 3] & (1 << (p[k] & 7)))) return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,87 @@
+#ifndef LOGGREP_SEGMENT_MANIFEST_H
+#define LOGGREP_SEGMENT_MANIFEST_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+// Per index segment manifest, <index dir>/segments.manifest, appended by RollingWriter on every flush.
+// One record per flushed segment, so the dispatcher can skip segments before it opens their archives.
+//   uint32 magic, uint32 payload length, payload, uint32 crc32 of the payload
+// A record goes out in a single write, a reader stops at the first record whose length or crc is off,
+// which is where a crash or a concurrent append left the tail. Retention appends drop records, the file
+// is rewritten (tmp + rename) once they outnumber the live segments.
+#define SEG_MANIFEST_NAME "segments.manifest"
+#define SEG_MANIFEST_MAGIC 0x4D53474Cu //"LGSM"
+#define SEG_MANIFEST_ADD 1
+#define SEG_MANIFEST_DROP 2
+
+// token summary: bloom over the case folded byte trigrams of every line. A query literal can only match
+// a segment holding all of its trigrams, substring and wildcard matching included.
+#define SEG_BLOOM_K 3
+#define SEG_BLOOM_BITS_PER_GRAM 10
+#define SEG_BLOOM_MIN_BITS (1<<10)
+#define SEG_BLOOM_MAX_BITS (1<<18) //32KB a segment, LOGGREP_MANIFEST_BLOOM_BITS overrides
+
+typedef struct SegmentEntry
+{
+    std::string name;       //archive file name in the index dir
+    long long tmin, tmax;   //log time range, lines without a timestamp count at flush time
+    long long lines;
+    long long capsuleBytes; //compressed capsule bytes
+    long long rawBytes;     //capsule bytes before compression
+    int capsules;
+    std::vector<uint32_t> templates;
+    uint32_t bloomBits;     //power of two, 0: no token summary
+    std::string bloom;
+    SegmentEntry(): tmin(0), tmax(0), lines(0), capsuleBytes(0), rawBytes(0), capsules(0), bloomBits(0) {}
+}SegmentEntry;
+
+// lines, time range and token bloom from the raw buffer, capsule sizes and template ids from the
+// directory of the archive at path (left 0 when it is not a capsule archive)
+int segment_summarize(const std::string& path, const char* buf, size_t len, long long startMs, long long endMs, SegmentEntry& out);
+
+class SegmentManifest
+{
+public:
+    SegmentManifest();
+    ~SegmentManifest();
+
+    //writer side: load, cut a torn tail, compact, keep the file open for appends
+    int Open(const std::string& dir);
+    int Append(const SegmentEntry& e);
+    int Drop(const std::string& name);
+    void Close();
+
+    //reader side, read only
+    int Load(const std::string& dir);
+    const SegmentEntry* Find(const std::string& name) const;
+    int Size() const { return (int)m_entries.size(); }
+
+private:
+    std::string m_path;
+    int m_fd;
+    int m_dead; //drop records and dropped adds still in the file
+    std::map<std::string, SegmentEntry> m_entries;
+
+    long long Parse(const std::string& data);
+    int Rewrite();
+};
+
+// what a query needs from a segment: its -time range and the trigrams of its literals
+class SegmentFilter
+{
+public:
+    SegmentFilter();
+    //from query args as LogStoreApi reads them, returns 1 when something can be pruned
+    int Build(char* args[], int argCount);
+    bool Keep(const SegmentEntry& e) const;
+
+private:
+    bool m_hasTime;
+    long long m_tstart, m_tend;
+    std::vector<uint32_t> m_grams;
+};
+
+#endif
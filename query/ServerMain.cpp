@@ -122,6 +122,7 @@ static void recover_wal_dir(const std::string& dir){
   int throttle_ms = 50; const char* tv=getenv("LOGGREP_RECOVER_THROTTLE_MS"); if(tv){ int x=atoi(tv); if(x>=0) throttle_ms=x; }
   DIR* d = opendir(dir.c_str());
   if(!d) return;
+  SegmentManifest manifest; manifest.Open(dir);
   struct dirent* ent;
   while((ent = readdir(d))){
     std::string n = ent->d_name;
@@ -138,6 +139,7 @@ static void recover_wal_dir(const std::string& dir){
       std::string out = dir + std::string("/ing_recover_") + std::to_string(ts) + std::string(".log.zip");
       int rc = -1; for(int i=0;i<retries;i++){ rc = compress_from_memory(buf.c_str(), (int)buf.size(), out.c_str()); if(rc==0) break; usleep(1000*throttle_ms); }
       if(rc==0){
+        SegmentEntry se; segment_summarize(out, buf.data(), buf.size(), ts, (long long)time(NULL)*1000LL + 999, se); manifest.Append(se);
         std::string mpath = out + std::string(".meta");
         FILE* mf = fopen(mpath.c_str(), "w");
         if(mf){
@@ -184,7 +186,8 @@ static void handle_client(int cfd){ std::string hdrs=read_headers(cfd); if(hdrs.
       auto kv=parse_kv(body); auto qkv=parse_kv(qs); for(auto &it: qkv){ if(!kv.count(it.first)) kv[it.first]=it.second; } std::string index = kv.count("index")? kv["index"]: std::string(); std::string q= kv.count("q")? kv["q"]: std::string(); int limit= kv.count("limit")? atoi(kv["limit"].c_str()) : 100; bool want_pretty = kv.count("pretty") ? (!kv["pretty"].empty()) : false; if(index.empty()||q.empty()){ respond_json(cfd, 400, std::string("{\"error\":\"missing index or q\"}")); }
       else{
         auto it = g_index_map.find(index); if(it==g_index_map.end()){ respond_json(cfd, 400, std::string("{\"error\":\"unknown index\"}")); }
-        else { std::string dir = it->second; LogDispatcher disp; int c=disp.Connect((char*)dir.c_str()); if(c<=0){ respond_json(cfd, 200, std::string("{\"error\":\"no segment\"}")); }
+        else { std::string dir = it->second; std::vector<std::string> pmem = tokenize_query(q.substr(0, q.find('|'))); char* pargs[MAX_CMD_ARG_COUNT]; int pac=0; for(size_t i=0;i<pmem.size() && pac<MAX_CMD_ARG_COUNT;i++){ pargs[pac++]=(char*)pmem[i].c_str(); }
+          LogDispatcher disp; int c=disp.Connect((char*)dir.c_str(), pargs, pac); if(c<=0 && !disp.IsConnect()){ respond_json(cfd, 200, std::string("{\"error\":\"no segment\"}")); }
         else{
           std::string baseq=q; bool handled=false; size_t barpos=baseq.find('|'); std::string right; std::string left;
           if(barpos!=std::string::npos){ right=baseq.substr(barpos+1); left=baseq.substr(0,barpos); SPLCommand cmd; if(parse_spl(right, cmd)){
@@ -52,6 +52,31 @@ double StatisticsAPI::ParseNumeric(const char* value, int len) {
     return result;
 }
 
+bool StatisticsAPI::ReadIntColumn(int patName, std::vector<long long>& values) {
+    return m_api != NULL && m_api->ReadIntCapsule(patName, values) >= 0;
+}
+
+bool StatisticsAPI::ForEachNumeric(int patName, BitMap* filter, const std::function<void(double)>& fn) {
+    bool useFilter = (filter != NULL && filter->GetSize() > 0);
+    std::vector<long long> ints;
+    if (ReadIntColumn(patName, ints)) {
+        for (int i = 0; i < (int)ints.size(); i++) {
+            if (useFilter && filter->GetValue(i) == 0) continue;
+            fn((double)ints[i]);
+        }
+        return true;
+    }
+    Coffer* meta;
+    if (DeCompressCapsule(patName, meta) <= 0 || !meta || !meta->data) return false;
+    char buffer[MAX_VALUE_LEN];
+    for (int i = 0; i < meta->lines; i++) {
+        if (useFilter && filter->GetValue(i) == 0) continue;
+        int len = (meta->eleLen > 0) ? ReadValue_Fixed(meta->data, i, meta->eleLen, buffer, sizeof(buffer)) : ReadValue_Diff(meta->data, meta->srcLen, i, buffer, sizeof(buffer));
+        if (len > 0) fn(ParseNumeric(buffer, len));
+    }
+    return true;
+}
+
 void StatisticsAPI::RemovePadding(const char* padded, int len, char* result, int& resultLen) {
     int i = 0;
     while (i < len && padded[i] == ' ') i++;
@@ -78,8 +103,8 @@ double StatisticsAPI::GetVarAvg(int varname, BitMap* filter) {
         if (DeCompressCapsule(dicname, dicMeta, 1) <= 0 || !dicMeta || !dicMeta->data) return 0.0;
         char* entryBuf = entryMeta->data; int entryLen = entryMeta->eleLen;
         for (int i = 0; i < entryMeta->lines; i++) {
-            if (useFilter && filter->GetValue(i) == 0) { entryBuf += entryLen; continue; }
-            int dicIdx = atoi(entryBuf, entryLen); entryBuf += entryLen;
+            if (useFilter && filter->GetValue(i) == 0) continue;
+            int dicIdx = GetEntryValue(entryBuf, entryLen, i);
             if (dicIdx < dicMeta->lines) {
                 int dicLen = 0; int offset = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[varname], dicIdx, dicLen);
                 m_api->RemovePadding(dicMeta->data + offset, dicLen, buffer);
@@ -88,13 +113,7 @@ double StatisticsAPI::GetVarAvg(int varname, BitMap* filter) {
         }
     } else {
         int targetVar = varname + (varType == VAR_TYPE_SUB ? VAR_TYPE_SUB : VAR_TYPE_VAR);
-        Coffer* meta;
-        if (DeCompressCapsule(targetVar, meta) <= 0 || !meta || !meta->data) return 0.0;
-        for (int i = 0; i < meta->lines; i++) {
-            if (useFilter && filter->GetValue(i) == 0) continue;
-            int len = (meta->eleLen > 0) ? ReadValue_Fixed(meta->data, i, meta->eleLen, buffer, sizeof(buffer)) : ReadValue_Diff(meta->data, meta->srcLen, i, buffer, sizeof(buffer));
-            if (len > 0) { sum += ParseNumeric(buffer, len); count++; }
-        }
+        if (!ForEachNumeric(targetVar, filter, [&](double v) { sum += v; count++; })) return 0.0;
     }
     return (count > 0) ? (sum / count) : 0.0;
 }
@@ -110,8 +129,8 @@ double StatisticsAPI::GetVarMax(int varname, BitMap* filter) {
         if (DeCompressCapsule(dicname, dicMeta, 1) <= 0 || !dicMeta || !dicMeta->data) return 0.0;
         char* entryBuf = entryMeta->data; int entryLen = entryMeta->eleLen;
         for (int i = 0; i < entryMeta->lines; i++) {
-            if (useFilter && filter->GetValue(i) == 0) { entryBuf += entryLen; continue; }
-            int dicIdx = atoi(entryBuf, entryLen); entryBuf += entryLen;
+            if (useFilter && filter->GetValue(i) == 0) continue;
+            int dicIdx = GetEntryValue(entryBuf, entryLen, i);
             if (dicIdx < dicMeta->lines) {
                 int dicLen = 0; int offset = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[varname], dicIdx, dicLen);
                 m_api->RemovePadding(dicMeta->data + offset, dicLen, buffer);
@@ -120,13 +139,7 @@ double StatisticsAPI::GetVarMax(int varname, BitMap* filter) {
         }
     } else {
         int targetVar = varname + (varType == VAR_TYPE_SUB ? VAR_TYPE_SUB : VAR_TYPE_VAR);
-        Coffer* meta;
-        if (DeCompressCapsule(targetVar, meta) <= 0 || !meta || !meta->data) return 0.0;
-        for (int i = 0; i < meta->lines; i++) {
-            if (useFilter && filter->GetValue(i) == 0) continue;
-            int len = (meta->eleLen > 0) ? ReadValue_Fixed(meta->data, i, meta->eleLen, buffer, sizeof(buffer)) : ReadValue_Diff(meta->data, meta->srcLen, i, buffer, sizeof(buffer));
-            if (len > 0) { double v = ParseNumeric(buffer, len); if (!found || v > maxVal) { maxVal = v; found = true; } }
-        }
+        if (!ForEachNumeric(targetVar, filter, [&](double v) { if (!found || v > maxVal) { maxVal = v; found = true; } })) return 0.0;
     }
     return found ? maxVal : 0.0;
 }
@@ -142,8 +155,8 @@ double StatisticsAPI::GetVarMin(int varname, BitMap* filter) {
         if (DeCompressCapsule(dicname, dicMeta, 1) <= 0 || !dicMeta || !dicMeta->data) return 0.0;
         char* entryBuf = entryMeta->data; int entryLen = entryMeta->eleLen;
         for (int i = 0; i < entryMeta->lines; i++) {
-            if (useFilter && filter->GetValue(i) == 0) { entryBuf += entryLen; continue; }
-            int dicIdx = atoi(entryBuf, entryLen); entryBuf += entryLen;
+            if (useFilter && filter->GetValue(i) == 0) continue;
+            int dicIdx = GetEntryValue(entryBuf, entryLen, i);
             if (dicIdx < dicMeta->lines) {
                 int dicLen = 0; int offset = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[varname], dicIdx, dicLen);
                 m_api->RemovePadding(dicMeta->data + offset, dicLen, buffer);
@@ -152,13 +165,7 @@ double StatisticsAPI::GetVarMin(int varname, BitMap* filter) {
         }
     } else {
         int targetVar = varname + (varType == VAR_TYPE_SUB ? VAR_TYPE_SUB : VAR_TYPE_VAR);
-        Coffer* meta;
-        if (DeCompressCapsule(targetVar, meta) <= 0 || !meta || !meta->data) return 0.0;
-        for (int i = 0; i < meta->lines; i++) {
-            if (useFilter && filter->GetValue(i) == 0) continue;
-            int len = (meta->eleLen > 0) ? ReadValue_Fixed(meta->data, i, meta->eleLen, buffer, sizeof(buffer)) : ReadValue_Diff(meta->data, meta->srcLen, i, buffer, sizeof(buffer));
-            if (len > 0) { double v = ParseNumeric(buffer, len); if (!found || v < minVal) { minVal = v; found = true; } }
-        }
+        if (!ForEachNumeric(targetVar, filter, [&](double v) { if (!found || v < minVal) { minVal = v; found = true; } })) return 0.0;
     }
     return found ? minVal : 0.0;
 }
@@ -173,8 +180,8 @@ double StatisticsAPI::GetVarSum(int varname, BitMap* filter) {
         if (DeCompressCapsule(dicname, dicMeta, 1) <= 0 || !dicMeta || !dicMeta->data) return 0.0;
         char* entryBuf = entryMeta->data; int entryLen = entryMeta->eleLen;
         for (int i = 0; i < entryMeta->lines; i++) {
-            if (useFilter && filter->GetValue(i) == 0) { entryBuf += entryLen; continue; }
-            int dicIdx = atoi(entryBuf, entryLen); entryBuf += entryLen;
+            if (useFilter && filter->GetValue(i) == 0) continue;
+            int dicIdx = GetEntryValue(entryBuf, entryLen, i);
             if (dicIdx < dicMeta->lines) {
                 int dicLen = 0; int offset = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[varname], dicIdx, dicLen);
                 m_api->RemovePadding(dicMeta->data + offset, dicLen, buffer);
@@ -183,13 +190,7 @@ double StatisticsAPI::GetVarSum(int varname, BitMap* filter) {
         }
     } else {
         int targetVar = varname + (varType == VAR_TYPE_SUB ? VAR_TYPE_SUB : VAR_TYPE_VAR);
-        Coffer* meta;
-        if (DeCompressCapsule(targetVar, meta) <= 0 || !meta || !meta->data) return 0.0;
-        for (int i = 0; i < meta->lines; i++) {
-            if (useFilter && filter->GetValue(i) == 0) continue;
-            int len = (meta->eleLen > 0) ? ReadValue_Fixed(meta->data, i, meta->eleLen, buffer, sizeof(buffer)) : ReadValue_Diff(meta->data, meta->srcLen, i, buffer, sizeof(buffer));
-            if (len > 0) sum += ParseNumeric(buffer, len);
-        }
+        if (!ForEachNumeric(targetVar, filter, [&](double v) { sum += v; })) return 0.0;
     }
     return sum;
 }
@@ -215,8 +216,8 @@ int StatisticsAPI::GetVarDistinctCount(int varname, BitMap* filter) {
         if (DeCompressCapsule(dicname, dicMeta, 1) <= 0 || !dicMeta || !dicMeta->data) return 0;
         char* entryBuf = entryMeta->data; int entryLen = entryMeta->eleLen;
         for (int i = 0; i < entryMeta->lines; i++) {
-            if (useFilter && filter->GetValue(i) == 0) { entryBuf += entryLen; continue; }
-            int dicIdx = atoi(entryBuf, entryLen); entryBuf += entryLen;
+            if (useFilter && filter->GetValue(i) == 0) continue;
+            int dicIdx = GetEntryValue(entryBuf, entryLen, i);
             if (dicIdx < dicMeta->lines) {
                 int dicLen = 0; int offset = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[varname], dicIdx, dicLen);
                 m_api->RemovePadding(dicMeta->data + offset, dicLen, buffer);
@@ -246,8 +247,8 @@ void StatisticsAPI::BuildHLL(int varname, BitMap* filter, HyperLogLog& h) {
         if (DeCompressCapsule(dicname, dicMeta, 1) <= 0 || !dicMeta || !dicMeta->data) return;
         char* entryBuf = entryMeta->data; int entryLen = entryMeta->eleLen;
         for (int i = 0; i < entryMeta->lines; i++) {
-            if (useFilter && filter->GetValue(i) == 0) { entryBuf += entryLen; continue; }
-            int dicIdx = atoi(entryBuf, entryLen); entryBuf += entryLen;
+            if (useFilter && filter->GetValue(i) == 0) continue;
+            int dicIdx = GetEntryValue(entryBuf, entryLen, i);
             if (dicIdx < dicMeta->lines) {
                 int dicLen = 0; int offset = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[varname], dicIdx, dicLen);
                 m_api->RemovePadding(dicMeta->data + offset, dicLen, buffer);
@@ -266,6 +267,14 @@ void StatisticsAPI::BuildHLL(int varname, BitMap* filter, HyperLogLog& h) {
     }
 }
 
+bool StatisticsAPI::MergeStoredHLL(int varname, HyperLogLog& h) {
+    int sketchId = (varname & (~0xF)) + VAR_TYPE_HLL;
+    if (m_api->FindCoffer(sketchId) == NULL) return false;
+    Coffer* meta;
+    if (DeCompressCapsule(sketchId, meta, 1) <= 0 || !meta || !meta->data) return false;
+    return h.mergePacked(meta->data, meta->srcLen);
+}
+
 std::map<std::string, int> StatisticsAPI::GetVarFrequency(int varname, int topK, BitMap* filter) {
     std::map<std::string, int> frequency;
     int varType = m_api->GetVarType(varname);
@@ -277,8 +286,8 @@ std::map<std::string, int> StatisticsAPI::GetVarFrequency(int varname, int topK,
         if (DeCompressCapsule(dicname, dicMeta, 1) <= 0 || !dicMeta || !dicMeta->data) return frequency;
         char* entryBuf = entryMeta->data; int entryLen = entryMeta->eleLen;
         for (int i = 0; i < entryMeta->lines; i++) {
-            if (useFilter && filter->GetValue(i) == 0) { entryBuf += entryLen; continue; }
-            int dicIdx = atoi(entryBuf, entryLen); entryBuf += entryLen;
+            if (useFilter && filter->GetValue(i) == 0) continue;
+            int dicIdx = GetEntryValue(entryBuf, entryLen, i);
             if (dicIdx < dicMeta->lines) {
                 int dicLen = 0; int offset = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[varname], dicIdx, dicLen);
                 m_api->RemovePadding(dicMeta->data + offset, dicLen, buffer);
@@ -338,7 +347,7 @@ std::map<std::string, double> StatisticsAPI::GetVarGroupByAvg(int groupVar, int
         if (useFilter && filter->GetValue(i) == 0) continue;
         int gl = 0;
         if (gDic) {
-            int idx = atoi(gMeta->data + i * gMeta->eleLen, gMeta->eleLen);
+            int idx = GetEntryValue(gMeta->data, gMeta->eleLen, i);
             if (idx < gDic->lines) {
                 int off = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[groupVar], idx, gl);
                 m_api->RemovePadding(gDic->data + off, gl, groupBuf);
@@ -349,7 +358,7 @@ std::map<std::string, double> StatisticsAPI::GetVarGroupByAvg(int groupVar, int
         }
         int vl = 0;
         if (vDic) {
-            int idx = atoi(vMeta->data + i * vMeta->eleLen, vMeta->eleLen);
+            int idx = GetEntryValue(vMeta->data, vMeta->eleLen, i);
             if (idx < vDic->lines) {
                 int off = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[valueVar], idx, vl);
                 m_api->RemovePadding(vDic->data + off, vl, valueBuf);
@@ -389,7 +398,7 @@ std::map<std::string, double> StatisticsAPI::GetVarGroupBySum(int groupVar, int
         if (useFilter && filter->GetValue(i) == 0) continue;
         int gl = 0;
         if (gDic) {
-            int idx = atoi(gMeta->data + i * gMeta->eleLen, gMeta->eleLen);
+            int idx = GetEntryValue(gMeta->data, gMeta->eleLen, i);
             if (idx < gDic->lines) {
                 int off = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[groupVar], idx, gl);
                 m_api->RemovePadding(gDic->data + off, gl, groupBuf);
@@ -400,7 +409,7 @@ std::map<std::string, double> StatisticsAPI::GetVarGroupBySum(int groupVar, int
         }
         int vl = 0;
         if (vDic) {
-            int idx = atoi(vMeta->data + i * vMeta->eleLen, vMeta->eleLen);
+            int idx = GetEntryValue(vMeta->data, vMeta->eleLen, i);
             if (idx < vDic->lines) {
                 int off = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[valueVar], idx, vl);
                 m_api->RemovePadding(vDic->data + off, vl, valueBuf);
@@ -430,7 +439,7 @@ std::map<std::string, int> StatisticsAPI::GetVarGroupByCount(int groupVar, BitMa
         if (useFilter && filter->GetValue(i) == 0) continue;
         int gl = 0;
         if (gDic) {
-            int idx = atoi(gMeta->data + i * gMeta->eleLen, gMeta->eleLen);
+            int idx = GetEntryValue(gMeta->data, gMeta->eleLen, i);
             if (idx < gDic->lines) {
                 int off = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[groupVar], idx, gl);
                 m_api->RemovePadding(gDic->data + off, gl, groupBuf);
@@ -468,7 +477,7 @@ std::map<std::string, int> StatisticsAPI::GetVarGroupByDistinctCount(int groupVa
         if (useFilter && filter->GetValue(i) == 0) continue;
         int gl = 0;
         if (gDic) {
-            int idx = atoi(gMeta->data + i * gMeta->eleLen, gMeta->eleLen);
+            int idx = GetEntryValue(gMeta->data, gMeta->eleLen, i);
             if (idx < gDic->lines) {
                 int off = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[groupVar], idx, gl);
                 m_api->RemovePadding(gDic->data + off, gl, groupBuf);
@@ -479,7 +488,7 @@ std::map<std::string, int> StatisticsAPI::GetVarGroupByDistinctCount(int groupVa
         }
         int vl = 0;
         if (vDic) {
-            int idx = atoi(vMeta->data + i * vMeta->eleLen, vMeta->eleLen);
+            int idx = GetEntryValue(vMeta->data, vMeta->eleLen, i);
             if (idx < vDic->lines) {
                 int off = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[valueVar], idx, vl);
                 m_api->RemovePadding(vDic->data + off, vl, valueBuf);
@@ -505,7 +514,7 @@ double StatisticsAPI::GetVarMedian(int varname, BitMap* filter) {
         if (DeCompressCapsule(dicname, dicMeta, 1) <= 0 || !dicMeta) return 0.0;
         for (int i = 0; i < entryMeta->lines; i++) {
             if (useFilter && filter->GetValue(i) == 0) continue;
-            int idx = atoi(entryMeta->data + i * entryMeta->eleLen, entryMeta->eleLen);
+            int idx = GetEntryValue(entryMeta->data, entryMeta->eleLen, i);
             if (idx < dicMeta->lines) {
                 int len = 0; int off = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[varname], idx, len);
                 m_api->RemovePadding(dicMeta->data + off, len, buffer);
@@ -514,13 +523,7 @@ double StatisticsAPI::GetVarMedian(int varname, BitMap* filter) {
         }
     } else {
         int targetVar = varname + (varType == VAR_TYPE_SUB ? VAR_TYPE_SUB : VAR_TYPE_VAR);
-        Coffer* meta;
-        if (DeCompressCapsule(targetVar, meta) <= 0 || !meta) return 0.0;
-        for (int i = 0; i < meta->lines; i++) {
-            if (useFilter && filter->GetValue(i) == 0) continue;
-            int len = (meta->eleLen > 0) ? ReadValue_Fixed(meta->data, i, meta->eleLen, buffer, sizeof(buffer)) : ReadValue_Diff(meta->data, meta->srcLen, i, buffer, sizeof(buffer));
-            if (len > 0) values.push_back(ParseNumeric(buffer, len));
-        }
+        if (!ForEachNumeric(targetVar, filter, [&](double v) { values.push_back(v); })) return 0.0;
     }
     if (values.empty()) return 0.0;
     std::sort(values.begin(), values.end());
@@ -539,7 +542,7 @@ double StatisticsAPI::GetVarStdDev(int varname, BitMap* filter) {
         if (DeCompressCapsule(dicname, dicMeta, 1) <= 0 || !dicMeta) return 0.0;
         for (int i = 0; i < entryMeta->lines; i++) {
             if (useFilter && filter->GetValue(i) == 0) continue;
-            int idx = atoi(entryMeta->data + i * entryMeta->eleLen, entryMeta->eleLen);
+            int idx = GetEntryValue(entryMeta->data, entryMeta->eleLen, i);
             if (idx < dicMeta->lines) {
                 int len = 0; int off = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[varname], idx, len);
                 m_api->RemovePadding(dicMeta->data + off, len, buffer);
@@ -548,13 +551,7 @@ double StatisticsAPI::GetVarStdDev(int varname, BitMap* filter) {
         }
     } else {
         int targetVar = varname + (varType == VAR_TYPE_SUB ? VAR_TYPE_SUB : VAR_TYPE_VAR);
-        Coffer* meta;
-        if (DeCompressCapsule(targetVar, meta) <= 0 || !meta) return 0.0;
-        for (int i = 0; i < meta->lines; i++) {
-            if (useFilter && filter->GetValue(i) == 0) continue;
-            int len = (meta->eleLen > 0) ? ReadValue_Fixed(meta->data, i, meta->eleLen, buffer, sizeof(buffer)) : ReadValue_Diff(meta->data, meta->srcLen, i, buffer, sizeof(buffer));
-            if (len > 0) values.push_back(ParseNumeric(buffer, len));
-        }
+        if (!ForEachNumeric(targetVar, filter, [&](double v) { values.push_back(v); })) return 0.0;
     }
     if (values.empty()) return 0.0;
     double sum = 0, sq_sum = 0;
@@ -574,7 +571,7 @@ double StatisticsAPI::GetVarPercentile(int varname, double p, BitMap* filter) {
         if (DeCompressCapsule(dicname, dicMeta, 1) <= 0 || !dicMeta) return 0.0;
         for (int i = 0; i < entryMeta->lines; i++) {
             if (useFilter && filter->GetValue(i) == 0) continue;
-            int idx = atoi(entryMeta->data + i * entryMeta->eleLen, entryMeta->eleLen);
+            int idx = GetEntryValue(entryMeta->data, entryMeta->eleLen, i);
             if (idx < dicMeta->lines) {
                 int len = 0; int off = m_api->GetDicOffsetByEntry(m_api->m_subpatterns[varname], idx, len);
                 m_api->RemovePadding(dicMeta->data + off, len, buffer);
@@ -583,13 +580,7 @@ double StatisticsAPI::GetVarPercentile(int varname, double p, BitMap* filter) {
         }
     } else {
         int targetVar = varname + (varType == VAR_TYPE_SUB ? VAR_TYPE_SUB : VAR_TYPE_VAR);
-        Coffer* meta;
-        if (DeCompressCapsule(targetVar, meta) <= 0 || !meta) return 0.0;
-        for (int i = 0; i < meta->lines; i++) {
-            if (useFilter && filter->GetValue(i) == 0) continue;
-            int len = (meta->eleLen > 0) ? ReadValue_Fixed(meta->data, i, meta->eleLen, buffer, sizeof(buffer)) : ReadValue_Diff(meta->data, meta->srcLen, i, buffer, sizeof(buffer));
-            if (len > 0) values.push_back(ParseNumeric(buffer, len));
-        }
+        if (!ForEachNumeric(targetVar, filter, [&](double v) { values.push_back(v); })) return 0.0;
     }
     if (values.empty()) return 0.0;
     std::sort(values.begin(), values.end());
@@ -8,6 +8,7 @@
 #include <vector>
 #include <string>
 #include <utility>
+#include <functional>
 
 // 前向声明
 class LogStoreApi;
@@ -37,6 +38,12 @@ private:
     
     // 辅助函数：解析数值
     double ParseNumeric(const char* value, int len);
+
+    // 辅助函数：FOR/DELTA 整型列从压缩数据直接读出 int64, 不解压成文本; 不是整型列时返回 false
+    bool ReadIntColumn(int patName, std::vector<long long>& values);
+
+    // 辅助函数：非字典数值列逐行回调, 整型列走 ReadIntColumn, 其它列解压后按文本解析; 列读不出时返回 false
+    bool ForEachNumeric(int patName, BitMap* filter, const std::function<void(double)>& fn);
     
     // 辅助函数：去除填充
     void RemovePadding(const char* padded, int len, char* result, int& resultLen);
@@ -79,6 +86,8 @@ public:
     // 获取唯一值数量
     int GetVarDistinctCount(int varname, BitMap* filter = NULL);
     void BuildHLL(int varname, BitMap* filter, HyperLogLog& h);
+    // 合并压缩时写入的列 HLL 胶囊（无过滤条件时使用），没有时返回 false
+    bool MergeStoredHLL(int varname, HyperLogLog& h);
     
     // 获取频率分布（返回 Top-K）
     std::map<std::string, int> GetVarFrequency(int varname, int topK = 10, BitMap* filter = NULL);
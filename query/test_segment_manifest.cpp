@@ -0,0 +1,125 @@
+/**
+ * segments.manifest 往返测试: segment_summarize -> Append/Drop -> Load, 以及 SegmentFilter 的剪枝
+ *
+ * 编译运行：
+ * cd query
+ * make test_segment_manifest && ./test_segment_manifest
+ * 返回值为失败的检查数
+ */
+
+#include "SegmentManifest.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static int failures = 0;
+#define CHECK(cond) do{ if(!(cond)){ printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } }while(0)
+
+static void touch(const string& path){
+    FILE* f = fopen(path.c_str(), "wb");
+    if(f) fclose(f);
+}
+
+static bool sameEntry(const SegmentEntry& a, const SegmentEntry& b){
+    return a.name == b.name && a.tmin == b.tmin && a.tmax == b.tmax && a.lines == b.lines
+        && a.capsuleBytes == b.capsuleBytes && a.rawBytes == b.rawBytes && a.capsules == b.capsules
+        && a.templates == b.templates && a.bloomBits == b.bloomBits && a.bloom == b.bloom;
+}
+
+static bool keep(const SegmentEntry& e, vector<string> args){
+    vector<char*> argv;
+    for(auto& a: args) argv.push_back(&a[0]);
+    SegmentFilter f;
+    f.Build(&argv[0], argv.size());
+    return f.Keep(e);
+}
+
+int main()
+{
+    char tmpl[] = "/tmp/lgmanifestXXXXXX";
+    char* dir = mkdtemp(tmpl);
+    if(dir == NULL){ printf("mkdtemp failed\n"); return 1; }
+    string d = dir;
+
+    //two segments summarized from raw lines, no archive behind them
+    string log1 = "2023-08-28 10:00:01 sshd[1]: Accepted password for alice\n"
+                  "2023-08-28 10:05:00 sshd[2]: Failed password for bob\n";
+    string log2 = "2023-08-29 09:00:00 kernel: eth0 link up\n";
+    SegmentEntry e1, e2;
+    CHECK(segment_summarize(d + "/seg1.zip", log1.data(), log1.size(), 0, 0, e1) >= 0);
+    CHECK(segment_summarize(d + "/seg2.zip", log2.data(), log2.size(), 0, 0, e2) >= 0);
+    CHECK(e1.name == "seg1.zip" && e1.lines == 2 && e1.tmin < e1.tmax && e1.tmax < e2.tmin);
+    CHECK(e1.bloomBits >= SEG_BLOOM_MIN_BITS && e1.bloom.size() * 8 == e1.bloomBits);
+    e1.templates.push_back(1 << 16);
+    e1.templates.push_back(7 << 16);
+    e1.capsules = 12;
+    e1.capsuleBytes = 4096;
+    e1.rawBytes = 65536;
+    touch(d + "/seg1.zip");
+    touch(d + "/seg2.zip");
+
+    {
+        SegmentManifest w;
+        CHECK(w.Open(d) == 0);
+        CHECK(w.Append(e1) == 1);
+        CHECK(w.Append(e2) == 1);
+        w.Close();
+    }
+    SegmentManifest r;
+    CHECK(r.Load(d) == 2);
+    CHECK(r.Find("seg1.zip") && sameEntry(*r.Find("seg1.zip"), e1));
+    CHECK(r.Find("seg2.zip") && sameEntry(*r.Find("seg2.zip"), e2));
+    CHECK(r.Find("seg3.zip") == NULL);
+
+    //a torn tail is ignored by readers and cut by the next writer
+    string path = d + "/" + SEG_MANIFEST_NAME;
+    struct stat st;
+    stat(path.c_str(), &st);
+    off_t whole = st.st_size;
+    FILE* f = fopen(path.c_str(), "ab");
+    uint32_t torn[3] = {SEG_MANIFEST_MAGIC, 1000, 0};
+    fwrite(torn, sizeof(torn), 1, f);
+    fclose(f);
+    CHECK(r.Load(d) == 2);
+    {
+        SegmentManifest w;
+        CHECK(w.Open(d) == 2);
+        stat(path.c_str(), &st);
+        CHECK(st.st_size == whole);
+        //dropping one of two segments compacts the file down to the survivor
+        CHECK(w.Drop("seg1.zip") == 1);
+        CHECK(w.Drop("seg1.zip") == 0);
+        w.Close();
+    }
+    CHECK(r.Load(d) == 1 && r.Find("seg1.zip") == NULL && r.Find("seg2.zip") && sameEntry(*r.Find("seg2.zip"), e2));
+    stat(path.c_str(), &st);
+    CHECK(st.st_size < whole);
+
+    //a corrupt record stops the reader there
+    f = fopen(path.c_str(), "r+b");
+    fseek(f, 12, SEEK_SET);
+    fputc(0xFF, f);
+    fclose(f);
+    CHECK(r.Load(d) == 0);
+
+    //the filter keeps a segment only when its time range and trigrams allow a match
+    CHECK(keep(e1, {"Failed", "and", "bob"}));
+    CHECK(!keep(e1, {"eth0"}));
+    CHECK(keep(e1, {"eth0", "or", "bob"}));
+    CHECK(keep(e1, {"pass*word"}));
+    CHECK(keep(e2, {"-time", "2023-08-29 00:00:00", "2023-08-30 00:00:00", "link"}));
+    CHECK(!keep(e1, {"-time", "2023-08-29 00:00:00", "2023-08-30 00:00:00", "bob"}));
+
+    unlink(path.c_str());
+    unlink((d + "/seg1.zip").c_str());
+    unlink((d + "/seg2.zip").c_str());
+    rmdir(dir);
+    printf("%s: %d failed checks\n", failures ? "FAILED" : "OK", failures);
+    return failures;
+}